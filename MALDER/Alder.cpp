@@ -8,6 +8,8 @@
 #include <cstdio>
 #include <cstring>
 
+#include <unistd.h>
+
 #include <omp.h>
 #include <fftw3.h>
 
@@ -16,9 +18,11 @@
 #include "MiscUtils.hpp"
 #include "CorrJack.hpp"
 #include "ExpFitALD.hpp"
+#include "Jackknife.hpp"
 #include "Timer.hpp"
 #include "Alder.hpp"
 #include "AlderParams.hpp"
+#include "CpuKernels.hpp"
 
 #define FFT_CONVOLUTION
 
@@ -35,20 +39,285 @@ namespace ALD {
   using std::min;
   using std::lower_bound;
   using std::accumulate;
+  using std::fill;
+  using std::find;
 
   double sq(double x) { return x*x; }
 
-  Alder::AffineData::AffineData(int n=0, int _num_refs=0) {
+  Alder::AffineData::AffineData(int n=0, int _num_refs=0, int num_sketches=0) {
     count = 0;
     ws = ss = s2 = 0.0;
     wg = gg = gs = vector <double> (n);
-    gigj = vector < vector <double> > (n, vector <double> (n));
+    if (_num_refs == 1 && num_sketches == 0)
+      gigj = vector < vector <double> > (n, vector <double> (n));
+    sketch_sums = vector <double> (num_sketches);
+    s11_m = s11_d = 0.0;
+    if (num_sketches) s11_p = s11_c = vector <double> (n);
     num_refs = _num_refs;
   }
 
+  Alder::LdCorrBin::LdCorrBin(int C, const vector <string> &ids)
+    : corr_data(C, ids), test_data(C, ids), ref_data(C, ids), has_corr(false),
+      has_polyache(false) {}
+
+  void Alder::LdCorrBin::add(const LdCorrBin &other) {
+    corr_data.add(other.corr_data);
+    test_data.add(other.test_data);
+    ref_data.add(other.ref_data);
+  }
+
+  Alder::ConvFFT::ConvFFT(int _N, int _len, int _lag)
+    : N(_N), Nby2(_N>>1), len(_len ? _len : _N), lag(_len ? _lag : 0),
+      block(_len ? _N - 2*_lag : 0), pending_scale(0), pending_accum(NULL) {
+    fx = (double *) fftw_malloc(sizeof(double)*len);
+    gy = (double *) fftw_malloc(sizeof(double)*len);
+    pending = (double *) fftw_malloc(sizeof(double)*len);
+    z = (fftw_complex *) fftw_malloc(sizeof(fftw_complex)*N);
+    fft_z = (fftw_complex *) fftw_malloc(sizeof(fftw_complex)*N);
+#pragma omp critical
+    plan = fftw_plan_dft_1d(N, z, fft_z, FFTW_FORWARD, FFTW_ESTIMATE);
+  }
+
+  Alder::ConvFFT::~ConvFFT() {
+    fftw_destroy_plan(plan);
+    fftw_free(fx); fftw_free(gy); fftw_free(pending);
+    fftw_free(z); fftw_free(fft_z);
+  }
+
+  void Alder::ConvFFT::transform(const double *re, const double *im) {
+    for (int b = 0; b < N; b++) {
+      z[b][0] = re[b];
+      z[b][1] = im != NULL ? im[b] : 0;
+    }
+    fftw_execute(plan);
+  }
+
+  int Alder::ConvFFT::segmented_length(const vector <char> &bin_used, int lag, int N) {
+    double best_cost = 0.9 * N * log((double) N); // (margin for the block overhead)
+    int best_N = 0;
+    for (int seg_N = 2; seg_N < N; seg_N *= 2) {
+      if (seg_N <= 2*lag) continue;
+      int num_bins = bin_used.size(), block = seg_N-2*lag, num_blocks = 0;
+      for (int start = 0; start < num_bins; start += block) { // blocks without data are skipped
+	const char *end = &bin_used[0] + min(start + block, num_bins);
+	num_blocks += find(&bin_used[start], end, 1) != end;
+      }
+      double cost = (double) num_blocks * seg_N * log((double) seg_N);
+      if (cost < best_cost) {
+	best_cost = cost;
+	best_N = seg_N;
+      }
+    }
+    return best_N;
+  }
+
+  // overlap-save: per block [start, start+block), x is placed at [lag, lag+block) and y at
+  // [start-lag, start-lag+N) is the window, so the circular correlation at lags -lag..lag
+  // wraps no data; blocks where x is zero add nothing and are skipped (e.g. the guard gaps
+  // of packed contigs)
+  void Alder::ConvFFT::segmented_accum(const double *x, const double *y, fftw_complex *z_accum,
+				       double scale) {
+    for (int start = 0; start < len; start += block) {
+      int end = min(start + block, len), b = start;
+      while (b < end && x[b] == 0) b++;
+      if (b == end) continue;
+      for (int p = 0; p < N; p++) {
+	int yb = start - lag + p;
+	bool in_range = yb >= 0 && yb < len;
+	z[p][0] = in_range && p >= lag && p < lag+block ? x[yb] : 0;
+	z[p][1] = in_range ? y[yb] : 0;
+      }
+      fftw_execute(plan);
+      cpu_kernels.packed_cross_accum(fft_z, N, z_accum, scale); // Xbar * Y
+    }
+  }
+
+  // with Z = FFT(x + i*y): X[b] = (Z[b] + conj(Z[N-b])) / 2, Y[b] = (Z[b] - conj(Z[N-b])) / 2i
+  void Alder::ConvFFT::cross_accum(fftw_complex *z_accum, double scale) {
+    if (block) {
+      segmented_accum(fx, gy, z_accum, scale);
+      return;
+    }
+    transform(fx, gy);
+    cpu_kernels.packed_cross_accum(fft_z, N, z_accum, scale); // Xbar * Y
+  }
+
+  // defer: hold the term until the next self term (with the same accumulator) or flush
+  void Alder::ConvFFT::self_accum(fftw_complex *z_accum, double scale, bool defer) {
+    if (block) {
+      segmented_accum(fx, fx, z_accum, scale);
+      return;
+    }
+    if (!defer) {
+      transform(fx, NULL);
+      cpu_kernels.sq_mod_accum(fft_z, Nby2, z_accum, scale);
+      return;
+    }
+    if (pending_accum != NULL && pending_accum != z_accum)
+      flush();
+    if (pending_accum == NULL) {
+      memcpy(pending, fx, sizeof(double)*N);
+      pending_scale = scale;
+      pending_accum = z_accum;
+      return;
+    }
+    transform(pending, fx);
+    // |X|^2 * pending_scale + |Y|^2 * scale
+    cpu_kernels.packed_self_pair_accum(fft_z, N, z_accum, pending_scale, scale);
+    pending_accum = NULL;
+  }
+
+  void Alder::ConvFFT::flush(void) {
+    if (pending_accum == NULL) return;
+    transform(pending, NULL);
+    cpu_kernels.sq_mod_accum(fft_z, Nby2, pending_accum, pending_scale);
+    pending_accum = NULL;
+  }
+
+  void Alder::ConvFFT::spectra(fftw_complex *X, fftw_complex *Y) {
+    transform(fx, Y != NULL ? gy : NULL);
+    if (Y == NULL) {
+      memcpy(X, fft_z, sizeof(fftw_complex)*(Nby2+1));
+      return;
+    }
+    for (int b = 0; b <= Nby2; b++) {
+      const double *Zb = fft_z[b], *Zm = fft_z[(N-b)&(N-1)];
+      X[b][0] = (Zb[0] + Zm[0]) / 2; X[b][1] = (Zb[1] - Zm[1]) / 2;
+      Y[b][0] = (Zb[1] + Zm[1]) / 2; Y[b][1] = (Zm[0] - Zb[0]) / 2;
+    }
+  }
+
+  Alder::LooSpectra::LooSpectra(int _N) : N(_N), Nby2(_N>>1) {
+    F = (fftw_complex *) fftw_malloc(sizeof(fftw_complex)*(Nby2+1));
+    G = (fftw_complex *) fftw_malloc(sizeof(fftw_complex)*(Nby2+1));
+    sum_cross = (fftw_complex *) fftw_malloc(sizeof(fftw_complex)*(Nby2+1));
+    z = (fftw_complex *) fftw_malloc(sizeof(fftw_complex)*(Nby2+1));
+    r = (double *) fftw_malloc(sizeof(double)*(N+1));
+    r[N] = 0;
+    memset(sum_cross, 0, sizeof(fftw_complex)*(Nby2+1));
+#pragma omp critical
+    plan = fftw_plan_dft_c2r_1d(N, z, r, FFTW_ESTIMATE);
+  }
+
+  Alder::LooSpectra::~LooSpectra() {
+    fftw_destroy_plan(plan);
+    fftw_free(F); fftw_free(G); fftw_free(sum_cross); fftw_free(z); fftw_free(r);
+  }
+
+  // fft_z: packed transform of (fx_j, gy_j); r = inverse transform of E_j (see run_chrom)
+  void Alder::LooSpectra::add_indiv(const fftw_complex *fft_z, int n) {
+    for (int b = 0; b <= Nby2; b++) {
+      const double *Zb = fft_z[b], *Zm = fft_z[(N-b)&(N-1)];
+      double xr = (Zb[0] + Zm[0]) / 2, xi = (Zb[1] - Zm[1]) / 2;
+      double yr = (Zb[1] + Zm[1]) / 2, yi = (Zm[0] - Zb[0]) / 2;
+      double xy_r = xr * yr + xi * yi, xy_i = xr * yi - xi * yr; // Xbar * Y
+      sum_cross[b][0] += xy_r;
+      sum_cross[b][1] += xy_i;
+      z[b][0] = (n * xy_r - (F[b][0] * yr + F[b][1] * yi) - (xr * G[b][0] + xi * G[b][1]))
+	/ (n-1);
+      z[b][1] = (n * xy_i - (F[b][0] * yi - F[b][1] * yr) - (xr * G[b][1] - xi * G[b][0]))
+	/ (n-1);
+    }
+    fftw_execute(plan);
+  }
+
+  // bins of A = sum_j L(fx_j,gy_j) and T = L(F,G)
+  void Alder::LooSpectra::totals(double *A, double *T, int numbins) {
+    memcpy(z, sum_cross, sizeof(fftw_complex)*(Nby2+1));
+    fftw_execute(plan);
+    for (int b = 0; b < numbins; b++) A[b] = (r[b] + r[N-b]) / N;
+    for (int b = 0; b <= Nby2; b++) {
+      z[b][0] = F[b][0] * G[b][0] + F[b][1] * G[b][1];
+      z[b][1] = F[b][0] * G[b][1] - F[b][1] * G[b][0];
+    }
+    fftw_execute(plan);
+    for (int b = 0; b < numbins; b++) T[b] = (r[b] + r[N-b]) / N;
+  }
+
+  // in-place r2c transforms: the float inputs are written into the half spectra (N/2+1
+  // complex = N+2 floats) and overwritten by their transforms; both fit in cf.z (N double
+  // complex), fft_gy at an even offset to keep the 16-byte alignment
+  Alder::FloatFFT::FloatFFT(ConvFFT &cf, int _check_indiv)
+    : N(cf.N), check(false), check_indiv(_check_indiv), num_terms(0), num_checks(0) {
+    int Nby2 = N>>1;
+    fft_fx = (fftwf_complex *) cf.z;
+    fft_gy = fft_fx + ((Nby2+2) & ~1);
+    diff = (fftw_complex *) fftw_malloc(sizeof(fftw_complex)*(Nby2+1));
+    memset(diff, 0, sizeof(fftw_complex)*(Nby2+1));
+#pragma omp critical
+    {
+      plans[0] = fftwf_plan_dft_r2c_1d(N, (float *) fft_fx, fft_fx, FFTW_ESTIMATE);
+      plans[1] = fftwf_plan_dft_r2c_1d(N, (float *) fft_gy, fft_gy, FFTW_ESTIMATE);
+    }
+  }
+
+  Alder::FloatFFT::~FloatFFT() {
+    fftwf_destroy_plan(plans[0]);
+    fftwf_destroy_plan(plans[1]);
+    fftw_free(diff);
+  }
+
+  // transforms fx (and gy unless NULL)
+  void Alder::FloatFFT::execute(const double *fx, const double *gy) {
+    float *fx_f = (float *) fft_fx;
+    for (int b = 0; b < N; b++) fx_f[b] = fx[b];
+    fftwf_execute(plans[0]);
+    if (gy != NULL) {
+      float *gy_f = (float *) fft_gy;
+      for (int b = 0; b < N; b++) gy_f[b] = gy[b];
+      fftwf_execute(plans[1]);
+    }
+    num_terms++;
+    num_checks += check;
+  }
+
+  const double Alder::MAX_LD_CORR_DIST = 0.02;
   const int Alder::LIM_SIGNIFICANCE_FAILURES = 2;
   const double Alder::LD_COS_SIGNIF_THRESH = 0.05;
   const double Alder::PCA_VARIANCE_THRESH = 0.9;
+  const double Alder::SPARSE_MAX_FRAC = 1/16.0;
+  const double Alder::FFT_COST_FACTOR = 1.0;
+
+  // per-snp genotype transforms f(gtype, s) scattered into bins by Alder::scatter_indiv
+  struct GenoTimesWeight { // gtype * w[s]
+    const double *w;
+    GenoTimesWeight(const double *_w) : w(_w) {}
+    double operator()(int gtype, int s) const { return gtype * w[s]; }
+  };
+  struct GenoPoly { // gtype * (a*sum[s] + c*gtype)
+    const int *sum; int a, c;
+    GenoPoly(const int *_sum, int _a, int _c) : sum(_sum), a(_a), c(_c) {}
+    double operator()(int gtype, int s) const { return gtype * (a*sum[s] + c*gtype); }
+  };
+  struct CenteredGeno { // mean * (gtype - mean), or (gtype - mean)^2, with mean = sum[s] / n
+    const int *sum; double n; bool square;
+    CenteredGeno(const int *_sum, double _n, bool _square) : sum(_sum), n(_n), square(_square) {}
+    double operator()(int gtype, int s) const {
+      double m = sum[s] / n;
+      return square ? sq(gtype - m) : m * (gtype - m);
+    }
+  };
+  struct TwoRefFx { // 2-ref: gtype * w[s] if snp has no missing data
+    const double *w; const int *num_missing;
+    TwoRefFx(const double *_w, const int *_num_missing) : w(_w), num_missing(_num_missing) {}
+    double operator()(int gtype, int s) const { return (num_missing[s]==0) * gtype * w[s]; }
+  };
+  struct TwoRefGy { // 2-ref: gtype (or mean if missing) * w[s], normalized
+    const double *w; const int *num_missing, *sum; int n;
+    TwoRefGy(const double *_w, const int *_num_missing, const int *_sum, int _n) :
+      w(_w), num_missing(_num_missing), sum(_sum), n(_n) {}
+    double operator()(int gtype, int s) const {
+      int k = num_missing[s];
+      return (gtype*(gtype!=9) + (gtype==9)*sum[s]/(double) (n-k))
+	* w[s] / ((1+(k==0)) * (n-k-1));
+    }
+  };
+
+  template <class F> struct SkipNanWeight { // f, or 0 at snps without a weight
+    F f; const double *w;
+    SkipNanWeight(const F &_f, const double *_w) : f(_f), w(_w) {}
+    double operator()(int gtype, int s) const { return isnan(w[s]) ? 0 : f(gtype, s); }
+  };
 
   string Alder::format_mean_std(pair <double, double> mean_std) {
     if (isnan(mean_std.first)) return "too much noise";
@@ -60,10 +329,10 @@ namespace ALD {
     return string(buf);
   }
 
-  double Alder::compute_geno_mean(int s, const char *geno, int stride) {
+  double Alder::compute_geno_mean(int s, const char *const *rows, int stride) {
     int sum_x = 0, n = 0;
     for (int i = 0; i < stride; i++) {
-      int x = geno[s*stride+i];
+      int x = rows[s][i];
       if (x != 9) {
 	sum_x += x; n++;
       }
@@ -71,38 +340,76 @@ namespace ALD {
     return n == 0 ? NAN : sum_x / (double) n;
   }
 
-  double Alder::compute_ld(int s1, int s2, const char *geno, int stride) {
-    int sum_x = 0, sum_y = 0, sum_xy = 0, n = 0;
-    for (int i = 0; i < stride; i++) {
-      int x = geno[s1*stride+i], y = geno[s2*stride+i];
-      if (x != 9 && y != 9) {
-	sum_x += x; sum_y += y; sum_xy += x*y; n++;
-      }
-    }
-    return n <= 1 ? NAN : (sum_xy - sum_x * sum_y / (double) n) / (n-1);
+  double Alder::compute_ld(int s1, int s2, const char *const *rows, int stride) {
+    int sums[3]; // x, y, xy
+    int n = cpu_kernels.ld_moments(rows[s1], rows[s2], stride, sums);
+    return n <= 1 ? NAN : (sums[2] - sums[0] * sums[1] / (double) n) / (n-1);
   }
 
   double Alder::compute_ld(int s1, int s2) {
-    return compute_ld(s1, s2, mixed_geno, num_mixed_indivs);
+    if (pair_is_sparse(s1, s2)) {
+      double S[3][3];
+      int n = sparse_pair_moments(s1, s2, S);
+      return n <= 1 ? NAN : (S[1][1] - S[1][0] * S[0][1] / n) / (n-1);
+    }
+    return compute_ld(s1, s2, &mixed_rows[0], num_mixed_indivs);
   }
 
-  double Alder::compute_polyache_central_moment11sq(int s1, int s2, const char *geno, int stride) {
-    int n = 0;
-    double S10 = 0, S01 = 0, S20 = 0, S11 = 0, S02 = 0, S21 = 0, S12 = 0, S22 = 0;
-    for (int i = 0; i < stride; i++) {
-      int x = geno[s1*stride+i], y = geno[s2*stride+i];
+  bool Alder::pair_is_sparse(int s1, int s2) {
+    return snp_sparse_geno[s1] != -1 && snp_sparse_geno[s2] != -1;
+  }
+
+  // computes moments S[a][b] = sum of x^a y^b (a, b <= 2) of test pop genotypes x at s1, y at s2
+  // over indivs with both non-missing; returns the number of such indivs
+  // (s1 and s2 must be sparse: visits only indivs with non-default genotypes at s1 or s2)
+  int Alder::sparse_pair_moments(int s1, int s2, double S[3][3]) {
+    int n = 0, num_default = num_mixed_indivs;
+    for (int a = 0; a <= 2; a++)
+      for (int b = 0; b <= 2; b++)
+	S[a][b] = 0;
+    int e1 = sparse_start[s1], e2 = sparse_start[s2];
+    while (e1 < sparse_start[s1+1] || e2 < sparse_start[s2+1]) { // merge sorted indiv lists
+      int i1 = e1 < sparse_start[s1+1] ? sparse_indivs[e1] : num_mixed_indivs;
+      int i2 = e2 < sparse_start[s2+1] ? sparse_indivs[e2] : num_mixed_indivs;
+      int i = min(i1, i2);
+      if (i1 == i) e1++;
+      if (i2 == i) e2++;
+      num_default--;
+      double x = mixed_rows[s1][i], y = mixed_rows[s2][i];
       if (x != 9 && y != 9) {
 	n++;
-	S10 += x;
-	S01 += y;
-	S20 += sq(x);
-	S11 += x*y;
-	S02 += sq(y);
-	S21 += sq(x)*y;
-	S12 += x*sq(y);
-	S22 += sq(x)*sq(y);
+	double xp[3] = {1, x, x*x}, yp[3] = {1, y, y*y};
+	for (int a = 0; a <= 2; a++)
+	  for (int b = 0; b <= 2; b++)
+	    S[a][b] += xp[a] * yp[b];
       }
     }
+    double x = snp_sparse_geno[s1], y = snp_sparse_geno[s2];
+    double xp[3] = {1, x, x*x}, yp[3] = {1, y, y*y};
+    for (int a = 0; a <= 2; a++)
+      for (int b = 0; b <= 2; b++)
+	S[a][b] += num_default * xp[a] * yp[b];
+    return n + num_default;
+  }
+
+  // same as sparse_pair_moments, for genotype rows stored densely (any snps s1, s2)
+  int Alder::dense_pair_moments(int s1, int s2, const char *const *rows, int stride,
+				double S[3][3]) {
+    int Si[3][3];
+    int n = cpu_kernels.polyache_moments(rows[s1], rows[s2], stride, Si);
+    for (int a = 0; a <= 2; a++)
+      for (int b = 0; b <= 2; b++)
+	S[a][b] = Si[a][b];
+    return n;
+  }
+
+  double Alder::compute_polyache_central_moment11sq(int s1, int s2, const char *const *rows,
+						    int stride) {
+    double S[3][3];
+    int n = rows == &mixed_rows[0] && pair_is_sparse(s1, s2) ? sparse_pair_moments(s1, s2, S)
+      : dense_pair_moments(s1, s2, rows, stride, S);
+    double S10 = S[1][0], S01 = S[0][1], S20 = S[2][0], S11 = S[1][1];
+    double S02 = S[0][2], S21 = S[2][1], S12 = S[1][2], S22 = S[2][2];
     double S0 = n;
     double S0p2 = S0*(S0-1);
     double S0p3 = S0p2*(S0-2);
@@ -118,83 +425,146 @@ namespace ALD {
   }
 
   double Alder::compute_polyache_central_moment11sq(int s1, int s2) {
-    return compute_polyache_central_moment11sq(s1, s2, mixed_geno, num_mixed_indivs);
+    return compute_polyache_central_moment11sq(s1, s2, &mixed_rows[0], num_mixed_indivs);
   }
 
   bool Alder::x2_suff_accurate(pair <double, double> x2_mean_std) {
     return x2_mean_std.first > 5*x2_mean_std.second;
   }
 
+  // adds the terms of the snp pairs of chrom c with s1 in layers [layer_begin, layer_end)
+  // (s1 - chrom start = layer mod stride), in layer order, to corr, test and ref (NULL: skip)
+  void Alder::add_ld_corr_layers(int c, int ref_ind, double bin_min, double bin_max,
+				 int stride, int layer_begin, int layer_end, Corr *corr, Corr *test,
+				 Corr *ref) {
+    const short *ref_ld_block = ref_ld_index == NULL ? NULL : ref_ld_blocks[ref_ind];
+    int snp_start = chrom_start_inds[c], snp_end = chrom_start_inds[c+1];
+    for (int layer = layer_begin; layer < layer_end; layer++)
+      for (int s1 = snp_start+layer; s1 < snp_end; s1 += stride) {
+	for (int s2 = lower_bound(snp_pos.begin()+s1, snp_pos.begin()+snp_end,
+				  snp_pos[s1] + bin_min) - snp_pos.begin();
+	     s2 < snp_end && snp_pos[s2] < snp_pos[s1] + bin_max; s2++) {
+	  // (D, D^2) of the ref pop from the index, if available
+	  const short *ld_ref = ref_ld_block == NULL ? NULL : ref_ld_block + 2 *
+	    (ref_ld_index->row_start[snp_ld_index[s1]] + snp_ld_index[s2]-snp_ld_index[s1]-1);
+	  if (corr != NULL) {
+	    double LD_test = compute_ld(s1, s2);
+	    double LD_ref = ld_ref != NULL ? RefLdIndex::dequantize(ld_ref[0], RefLdIndex::D_SCALE)
+	      : compute_ld(s1, s2, &ref_rows[ref_ind][0], num_ref_indivs[ref_ind]);
+	    corr->add_term(LD_test, LD_ref); // checks for nan
+	  }
+	  if (test != NULL)
+	    test->add_unbiased_sq_term(compute_polyache_central_moment11sq(s1, s2));
+	  if (ref != NULL)
+	    ref->add_unbiased_sq_term(ld_ref != NULL ?
+	      RefLdIndex::dequantize(ld_ref[1], RefLdIndex::D2_SCALE) :
+	      compute_polyache_central_moment11sq(s1, s2, &ref_rows[ref_ind][0],
+						  num_ref_indivs[ref_ind]));
+	}
+      }
+  }
+
   // stores polyache data in:
   // - test_data.count, test_data.sum_x2 and test_data.sum_y2 (same)
   // - ref_data.count, ref_data.sum_x2 and ref_data.sum_y2 (same)
-  void Alder::compute_ld_corr_terms(int ref_ind, double bin_min, double bin_max,
+  bool Alder::compute_ld_corr_terms(int ref_ind, double bin_min, double bin_max,
 				   CorrJack &corr_data, CorrJack &test_data, CorrJack &ref_data,
 				   bool use_early_exit, bool compute_corr_data,
 				   bool compute_polyache_data) {
+    bool complete = true;
     bool done_ld_prod = !compute_corr_data;
     bool done_polyache_test = !compute_polyache_data, done_polyache_ref = !compute_polyache_data;
 
-    // iterate through s1 in layers:
-    // at end of each offset layer, jackknife to decide if enough precision
+    // iterate through s1 in layers (offsets mod s1_stride), in groups ending at power-of-2
+    // numbers of layers: at end of each group, jackknife to decide if enough precision
     const int num_early_checks = 6;
     const int s1_stride = 1<<num_early_checks;
-    int num_checks_left = num_early_checks+1;
-    for (int s1_offset = 0; s1_offset < s1_stride; s1_offset++) {
+    int num_groups = use_early_exit ? num_early_checks+1 : 1;
+    vector <int> group_ends(num_groups, s1_stride);
+    for (int g = 0; g < num_groups-1; g++) group_ends[g] = 1<<g;
+    // streaming: a pass per group would reread the genome each time, so the sums of every
+    // group are computed chrom by chrom in one pass (the checks then only save the merging)
+    bool one_pass = geno.is_streaming() && num_groups > 1;
+    vector < vector <Corr> > corr_parts, test_parts, ref_parts; // by group, chrom
+    if (one_pass) {
+      corr_parts = test_parts = ref_parts =
+	vector < vector <Corr> > (num_groups, vector <Corr> (num_chroms_used));
+      geno.start_pass();
 #pragma omp parallel for schedule(static,1)
       for (int c = 0; c < num_chroms_used; c++) {
-	int snp_start = chrom_start_inds[c], snp_end = chrom_start_inds[c+1];
-	for (int s1 = snp_start+s1_offset; s1 < snp_end; s1 += s1_stride) {
-	  for (int s2 = lower_bound(snp_pos.begin()+s1, snp_pos.begin()+snp_end,
-				    snp_pos[s1] + bin_min) - snp_pos.begin();
-	       s2 < snp_end && snp_pos[s2] < snp_pos[s1] + bin_max; s2++) {
-	    if (!done_ld_prod) {
-	      double LD_test = compute_ld(s1, s2);
-	      double LD_ref = compute_ld(s1, s2, ref_genos[ref_ind], num_ref_indivs[ref_ind]);
-	      corr_data.data[c].add_term(LD_test, LD_ref); // checks for nan
-	    }
-	    if (!done_polyache_test)
-	      test_data.data[c].add_unbiased_sq_term(compute_polyache_central_moment11sq(s1, s2));
-	    if (!done_polyache_ref)
-	      ref_data.data[c].add_unbiased_sq_term(compute_polyache_central_moment11sq(s1, s2,
-					             ref_genos[ref_ind], num_ref_indivs[ref_ind]));
-	  }
+	geno.acquire(c);
+	for (int g = 0; g < num_groups; g++)
+	  add_ld_corr_layers(c, ref_ind, bin_min, bin_max, s1_stride, g ? group_ends[g-1] : 0,
+			     group_ends[g], done_ld_prod ? NULL : &corr_parts[g][c],
+			     done_polyache_test ? NULL : &test_parts[g][c],
+			     done_polyache_ref ? NULL : &ref_parts[g][c]);
+	geno.release(c);
+      }
+      geno.end_pass();
+    }
+    int num_checks_left = num_early_checks+1;
+    for (int g = 0; g < num_groups; g++) {
+      if (one_pass)
+	for (int c = 0; c < num_chroms_used; c++) {
+	  if (!done_ld_prod) corr_data.data[c].add(corr_parts[g][c]);
+	  if (!done_polyache_test) test_data.data[c].add(test_parts[g][c]);
+	  if (!done_polyache_ref) ref_data.data[c].add(ref_parts[g][c]);
+	}
+      else {
+	geno.start_pass();
+#pragma omp parallel for schedule(static,1)
+	for (int c = 0; c < num_chroms_used; c++) {
+	  geno.acquire(c);
+	  add_ld_corr_layers(c, ref_ind, bin_min, bin_max, s1_stride, g ? group_ends[g-1] : 0,
+			     group_ends[g], done_ld_prod ? NULL : &corr_data.data[c],
+			     done_polyache_test ? NULL : &test_data.data[c],
+			     done_polyache_ref ? NULL : &ref_data.data[c]);
+	  geno.release(c);
 	}
+	geno.end_pass();
       }
-      if (use_early_exit && !((s1_offset+1) & s1_offset)) { // power-of-2 stride
+      if (use_early_exit) {
 	if (!done_ld_prod) {
 	  pair <double, double> cos_mean_std = corr_data.jackknife_cos();
 	  if (erfc(cos_mean_std.first/cos_mean_std.second/sqrt(2.0)) * num_checks_left
 	      < LD_COS_SIGNIF_THRESH)
-	    done_ld_prod = true;
+	    done_ld_prod = true, complete = false;
 	}
-	if (!done_polyache_test)
-	  done_polyache_test = x2_suff_accurate(test_data.jackknife_x2_avg());
-	if (!done_polyache_ref)
-	  done_polyache_ref = x2_suff_accurate(ref_data.jackknife_x2_avg());
-	if (done_ld_prod && done_polyache_test && done_polyache_ref) return;
+	if (!done_polyache_test && x2_suff_accurate(test_data.jackknife_x2_avg()))
+	  done_polyache_test = true, complete = false;
+	if (!done_polyache_ref && x2_suff_accurate(ref_data.jackknife_x2_avg()))
+	  done_polyache_ref = true, complete = false;
+	if (done_ld_prod && done_polyache_test && done_polyache_ref) return complete;
 	num_checks_left--;
       }
     }
+    return complete;
   }
 
-  double Alder::compute_polyache(int s1, int s2, double pAx, double pAy) {
-    int n = 0;
-    double S10 = 0, S01 = 0, S20 = 0, S11 = 0, S02 = 0, S21 = 0, S12 = 0, S22 = 0;
-    for (int i = 0; i < num_mixed_indivs; i++) {
-      int x = mixed_geno[s1*num_mixed_indivs+i], y = mixed_geno[s2*num_mixed_indivs+i];
-      if (x != 9 && y != 9) {
-	n++;
-	S10 += x;
-	S01 += y;
-	S20 += sq(x);
-	S11 += x*y;
-	S02 += sq(y);
-	S21 += sq(x)*y;
-	S12 += x*sq(y);
-	S22 += sq(x)*sq(y);
-      }
+  bool Alder::aggregate_ld_corr_bin(const vector < map <int, LdCorrBin> > &cache, int level,
+				    int b, bool need_corr, bool need_polyache, LdCorrBin &bin) {
+    map <int, LdCorrBin>::const_iterator it = cache[level].find(b);
+    if (it != cache[level].end() && (!need_corr || it->second.has_corr) &&
+	(!need_polyache || it->second.has_polyache)) {
+      bin.add(it->second);
+      return true;
     }
+    if (level == 0) return false;
+    // bin b at this level is the union of bins 2b and 2b+1 at the next finer level
+    LdCorrBin halves(num_chroms_used, jack_ind_ids);
+    if (!aggregate_ld_corr_bin(cache, level-1, 2*b, need_corr, need_polyache, halves) ||
+	!aggregate_ld_corr_bin(cache, level-1, 2*b+1, need_corr, need_polyache, halves))
+      return false;
+    bin.add(halves);
+    return true;
+  }
+
+  double Alder::compute_polyache(int s1, int s2, double pAx, double pAy) {
+    double S[3][3];
+    int n = pair_is_sparse(s1, s2) ? sparse_pair_moments(s1, s2, S)
+      : dense_pair_moments(s1, s2, &mixed_rows[0], num_mixed_indivs, S);
+    double S10 = S[1][0], S01 = S[0][1], S20 = S[2][0], S11 = S[1][1];
+    double S02 = S[0][2], S21 = S[2][1], S12 = S[1][2], S22 = S[2][2];
     double S0 = n;
     double S0p2 = S0*(S0-1);
     double S0p3 = S0p2*(S0-2);
@@ -214,21 +584,287 @@ namespace ALD {
     return ans;
   }
 
-  void Alder::convolve_accum(fftw_plan *plans, int Nby2, fftw_complex *z_accum,
-			    fftw_complex *z1, fftw_complex *z2, double scale) {
-    fftw_execute(plans[0]);
-    fftw_execute(plans[1]);
-    for (int b = 0; b <= Nby2; b++) { // z1bar * z2
-      z_accum[b][0] += (z1[b][0] * z2[b][0] + z1[b][1] * z2[b][1]) * scale;
-      z_accum[b][1] += (z1[b][0] * z2[b][1] - z1[b][1] * z2[b][0]) * scale;
+  // set up snp_bin and snp_ignore tables for a weighted LD computation
+  // polyache requires no missing
+  void Alder::set_snp_tables(int num_refs, const vector <double> &weights, double binsize,
+			     int mincount) {
+    int maxmissing = num_refs == 2 ? num_mixed_indivs - mincount : 0;
+    for (int s = 0; s < (int) snp_pos.size(); s++) {
+      snp_bin[s] = (snp_pos[s] - snp_pos[chrom_start_inds[snp_chrom_ind_squash[s]]]) / binsize;
+      snp_ignore[s] = snp_num_missing[s] > maxmissing || isnan(weights[s]);
+    }
+  }
+
+  void Alder::convolve_accum(ConvFFT &cf, fftw_complex *z_accum, double scale, FloatFFT *ff) {
+    if (ff == NULL) {
+      cf.cross_accum(z_accum, scale);
+      return;
+    }
+    ff->execute(cf.fx, cf.gy);
+    if (!ff->check) {
+      cpu_kernels.conj_prod_accum_f(ff->fft_fx, ff->fft_gy, cf.Nby2, z_accum, scale);
+      return;
     }
+    // check term: accumulate the double-precision result, and the difference in ff->diff
+    cpu_kernels.conj_prod_accum_f(ff->fft_fx, ff->fft_gy, cf.Nby2, ff->diff, scale);
+    cf.cross_accum(z_accum, scale);
+    cf.cross_accum(ff->diff, -scale);
+    ff->check = false;
   }
   
-  void Alder::self_convolve_accum(fftw_plan *plan, int Nby2, fftw_complex *z_accum,
-				 fftw_complex *z1, double scale) {
-    fftw_execute(*plan);
-    for (int b = 0; b <= Nby2; b++) // z1bar * z1
-      z_accum[b][0] += (sq(z1[b][0]) + sq(z1[b][1])) * scale;
+  void Alder::self_convolve_accum(ConvFFT &cf, fftw_complex *z_accum, double scale,
+				 FloatFFT *ff) {
+    if (ff == NULL) {
+      cf.self_accum(z_accum, scale, true);
+      return;
+    }
+    ff->execute(cf.fx, NULL);
+    if (!ff->check) {
+      cpu_kernels.sq_mod_accum_f(ff->fft_fx, cf.Nby2, z_accum, scale);
+      return;
+    }
+    cpu_kernels.sq_mod_accum_f(ff->fft_fx, cf.Nby2, ff->diff, scale);
+    cf.self_accum(z_accum, scale, false);
+    cf.self_accum(ff->diff, -scale, false);
+    ff->check = false;
+  }
+
+  // adds f(default gtype, s) to fx_base[snp_bin[s]] for the non-ignored sparse snps of a chrom
+  template <class F> void Alder::scatter_default(int chrom, const F &f, double *fx_base) {
+    for (int s = chrom_start_inds[chrom]; s < chrom_start_inds[chrom+1]; s++)
+      if (snp_sparse_geno[s] != -1 && !snp_ignore[s])
+	fx_base[snp_bin[s]] += f(snp_sparse_geno[s], s);
+  }
+
+  // sets fx[snp_bin[s]] = sum of f(gtype of indiv i at s, s) over the non-ignored snps of a
+  // chrom, starting from fx_base (see scatter_default); visits only the dense snps and the
+  // sparse snps at which indiv i has a non-default genotype
+  template <class F> void Alder::scatter_indiv(int chrom, int i, const F &f,
+					       const double *fx_base, double *fx, int len) {
+    int snp_start = chrom_start_inds[chrom], snp_end = chrom_start_inds[chrom+1];
+    memcpy(fx, fx_base, len*sizeof(double));
+    for (vector <int>::const_iterator it = lower_bound(dense_snps.begin(), dense_snps.end(),
+						       snp_start);
+	 it != dense_snps.end() && *it < snp_end; it++)
+      if (!snp_ignore[*it])
+	fx[snp_bin[*it]] += f(mixed_rows[*it][i], *it);
+    const vector <int> &snps = indiv_sparse_snps[i];
+    for (vector <int>::const_iterator it = lower_bound(snps.begin(), snps.end(), snp_start);
+	 it != snps.end() && *it < snp_end; it++)
+      if (!snp_ignore[*it])
+	fx[snp_bin[*it]] += f(mixed_rows[*it][i], *it)
+	  - f(snp_sparse_geno[*it], *it);
+  }
+
+  // as above, scattering two transforms at once
+  template <class F, class G> void Alder::scatter_indiv(int chrom, int i, const F &f,
+							const double *fx_base, double *fx,
+							const G &g, const double *gy_base,
+							double *gy, int len) {
+    int snp_start = chrom_start_inds[chrom], snp_end = chrom_start_inds[chrom+1];
+    memcpy(fx, fx_base, len*sizeof(double));
+    memcpy(gy, gy_base, len*sizeof(double));
+    for (vector <int>::const_iterator it = lower_bound(dense_snps.begin(), dense_snps.end(),
+						       snp_start);
+	 it != dense_snps.end() && *it < snp_end; it++)
+      if (!snp_ignore[*it]) {
+	int gtype = mixed_rows[*it][i];
+	fx[snp_bin[*it]] += f(gtype, *it);
+	gy[snp_bin[*it]] += g(gtype, *it);
+      }
+    const vector <int> &snps = indiv_sparse_snps[i];
+    for (vector <int>::const_iterator it = lower_bound(snps.begin(), snps.end(), snp_start);
+	 it != snps.end() && *it < snp_end; it++)
+      if (!snp_ignore[*it]) {
+	int gtype = mixed_rows[*it][i], def = snp_sparse_geno[*it];
+	fx[snp_bin[*it]] += f(gtype, *it) - f(def, *it);
+	gy[snp_bin[*it]] += g(gtype, *it) - g(def, *it);
+      }
+  }
+
+  // polyache sketch mode: the sketched part of -S11*S11 * (2*S0p3 + S0p4) / (S0p3 * S0p4),
+  // stored in affine_data.sketch_ld (scaled as the final curve) and affine_data.sketch_sums
+  // write g_is = m_s + c_is with m_s the mean genotype at snp s (so sum_i c_is = 0)
+  // and let M[b] = sum_{s in b} m_s^2, P_i[b] = sum_{s in b} m_s c_is,
+  // C_ij[b] = sum_{s in b} c_is c_js, D[b] = sum_i C_ii[b]; then with L(f,g) denoting
+  // the (symmetric) binned cross-correlation computed by convolve_accum,
+  // sum_{i<j} L(S11_ij, S11_ij) = n(n-1)/2 L(M,M) - L(M,D) + (n-2) sum_i L(P_i,P_i)
+  //                               - 2 sum_i L(P_i,C_ii) + sum_{i<j} L(C_ij,C_ij)
+  // the first four terms are computed exactly by polyache_geno_terms (in place of the
+  // quadratic loop); the last, centered term is estimated here: with z a random +/-1 vector,
+  // v[b] = sum_{i<j} z_i z_j C_ij[b] = sum_{s in b} ((z.c_s)^2 - sum_i c_is^2) / 2
+  // has E[L(v,v)] = sum_{i<j} L(C_ij,C_ij)
+  // each sketch is transformed on its own using rev_c_arr (cleared on return), which allows
+  // leave-one-sketch-out estimates of the sketch variance
+  void Alder::polyache_sketch_terms(int chrom, ConvFFT &cf, fftw_complex *rev_c_arr,
+				    fftw_plan rev_plan, double *rev_r_arr, int numbins,
+				    int numbins_chrom, AffineData &affine_data) {
+    int snp_start = chrom_start_inds[chrom], snp_end = chrom_start_inds[chrom+1];
+    int n = num_mixed_indivs, N = cf.N, num_sketches = polyache_sketches;
+    double *fx = cf.fx;
+    double onebyN = 1.0/N;
+    double S0 = n;
+    double S0p2 = S0*(S0-1);
+    double S0p3 = S0p2*(S0-2);
+    double S0p4 = S0p3*(S0-3);
+
+    affine_data.sketch_ld = vector < vector <double> > (num_sketches,
+							 vector <double> (numbins));
+    for (int k = 0; k < num_sketches; k++) {
+      const vector <int> &z = sketch_signs[k];
+      int zsum = accumulate(z.begin(), z.end(), 0);
+      memset(fx, 0, sizeof(double)*N);
+      for (int s = snp_start; s < snp_end; s++)
+	if (!snp_ignore[s]) {
+	  const char *geno = mixed_rows[s];
+	  int zg = 0;
+	  if (snp_sparse_geno[s] == -1)
+	    for (int i = 0; i < n; i++) zg += z[i] * geno[i];
+	  else { // default genotype for all, then correct non-default indivs
+	    int def = snp_sparse_geno[s];
+	    zg = def * zsum;
+	    for (int e = sparse_start[s]; e < sparse_start[s+1]; e++)
+	      zg += z[sparse_indivs[e]] * (geno[sparse_indivs[e]] - def);
+	  }
+	  double m = snp_sum[s] / S0;
+	  fx[snp_bin[s]] += 0.5 * (sq(zg - m*zsum) - (snp_sum2[s] - m*snp_sum[s]));
+	}
+      affine_data.sketch_sums[k] = accumulate(fx, fx+numbins_chrom, 0.0);
+      memset(rev_c_arr, 0, sizeof(fftw_complex)*N);
+      self_convolve_accum(cf, rev_c_arr, -2*(2*S0p3 + S0p4) / (S0p3 * S0p4));
+      cf.flush();
+      fftw_execute(rev_plan);
+      for (int b = 0; b < min(numbins, numbins_chrom); b++) // /8: see final scaling in run_chrom
+	affine_data.sketch_ld[k][b] = (rev_r_arr[b] + rev_r_arr[N-b]) * onebyN / 8;
+    }
+    memset(rev_c_arr, 0, sizeof(fftw_complex)*N);
+  }
+
+  // polyache terms not involving the weights (the remaining terms of the original form in
+  // run_chrom), accumulated into rev_c_arr; stores ss, s2, gs, gg and gigj (or the s11_*
+  // totals in sketch mode) in affine_data
+  void Alder::polyache_geno_terms(int chrom, ConvFFT &cf, fftw_complex *rev_c_arr,
+				  FloatFFT *ff, int numbins_chrom, AffineData &affine_data) {
+    int snp_start = chrom_start_inds[chrom], snp_end = chrom_start_inds[chrom+1];
+    int n = num_mixed_indivs, N = cf.N, num_sketches = polyache_sketches;
+    double *fx = cf.fx, *gy = cf.gy;
+    double S0 = n;
+    double S0p2 = S0*(S0-1);
+    double S0p3 = S0p2*(S0-2);
+    double S0p4 = S0p3*(S0-3);
+    vector <double> fx_base(N), gy_base(N);
+
+    // (2*S20 - S10*S10) * S01*S01 / S0p4   (combining sym term in first)
+    memset(fx, 0, sizeof(double)*N); memset(gy, 0, sizeof(double)*N);
+    for (int s = snp_start; s < snp_end; s++)
+      if (!snp_ignore[s]) {
+	fx[snp_bin[s]] += 2*snp_sum2[s] - sq(snp_sum[s]);
+	gy[snp_bin[s]] += sq(snp_sum[s]);
+      }
+    affine_data.ss = accumulate(gy, gy+numbins_chrom, 0.0);
+    //(2*affine_data[c1].s2 - affine_data[c1].ss) * affine_data[c2].ss * 1 / S0p4
+    convolve_accum(cf, rev_c_arr, 1 / S0p4);
+
+    // -S02 * S20 / S0p4
+    memset(fx, 0, sizeof(double)*N);
+    for (int s = snp_start; s < snp_end; s++)
+      if (!snp_ignore[s])
+	fx[snp_bin[s]] += snp_sum2[s];
+    affine_data.s2 = accumulate(fx, fx+numbins_chrom, 0.0);
+    //affine_data[c1].s2 * affine_data[c2].s2 * -1/S0p4
+    self_convolve_accum(cf, rev_c_arr, -1/S0p4);
+
+    // (S10 * S11 * S01 - 2 * S21 * S01) * (4*S0p3 + S0p4) / (S0p3 * S0p4)   (combining sym term in second)
+    GenoPoly gs_2gg_term(&snp_sum[0], 1, -2), gs_term(&snp_sum[0], 1, 0);
+    fill(fx_base.begin(), fx_base.end(), 0.0);
+    fill(gy_base.begin(), gy_base.end(), 0.0);
+    scatter_default(chrom, gs_2gg_term, &fx_base[0]);
+    scatter_default(chrom, gs_term, &gy_base[0]);
+    for (int i = 0; i < n; i++) {
+      scatter_indiv(chrom, i, gs_2gg_term, &fx_base[0], fx, gs_term, &gy_base[0], gy, N);
+      affine_data.gs[i] = accumulate(gy, gy+numbins_chrom, 0.0);
+      //(affine_data[c1].gs[i] - 2*affine_data[c1].gg[i]) * affine_data[c2].gs[i] * (4*S0p3 + S0p4) / (S0p3 * S0p4)
+      if (ff != NULL) ff->check = i == ff->check_indiv;
+      convolve_accum(cf, rev_c_arr, (4*S0p3 + S0p4) / (S0p3 * S0p4), ff);
+    }
+
+    // -S11*S11 * (2*S0p3 + S0p4) / (S0p3 * S0p4)
+    if (num_sketches) { // terms involving snp means (see polyache_sketch_terms)
+      double c = -2*(2*S0p3 + S0p4) / (S0p3 * S0p4);
+      memset(fx, 0, sizeof(double)*N); memset(gy, 0, sizeof(double)*N);
+      for (int s = snp_start; s < snp_end; s++)
+	if (!snp_ignore[s]) {
+	  double m = snp_sum[s] / S0;
+	  fx[snp_bin[s]] += sq(m);
+	  gy[snp_bin[s]] += snp_sum2[s] - m*snp_sum[s];
+	}
+      affine_data.s11_m = accumulate(fx, fx+numbins_chrom, 0.0);
+      affine_data.s11_d = accumulate(gy, gy+numbins_chrom, 0.0);
+      convolve_accum(cf, rev_c_arr, -c);
+      self_convolve_accum(cf, rev_c_arr, c * S0p2 / 2);
+      CenteredGeno p_term(&snp_sum[0], S0, false), c_term(&snp_sum[0], S0, true);
+      fill(fx_base.begin(), fx_base.end(), 0.0);
+      fill(gy_base.begin(), gy_base.end(), 0.0);
+      scatter_default(chrom, p_term, &fx_base[0]);
+      scatter_default(chrom, c_term, &gy_base[0]);
+      for (int i = 0; i < n; i++) {
+	scatter_indiv(chrom, i, p_term, &fx_base[0], fx, c_term, &gy_base[0], gy, N);
+	affine_data.s11_p[i] = accumulate(fx, fx+numbins_chrom, 0.0);
+	affine_data.s11_c[i] = accumulate(gy, gy+numbins_chrom, 0.0);
+	if (ff != NULL) ff->check = i == ff->check_indiv;
+	convolve_accum(cf, rev_c_arr, -2*c, ff);
+	if (ff != NULL) ff->check = i == ff->check_indiv;
+	self_convolve_accum(cf, rev_c_arr, c * (S0-2), ff);
+      }
+    }
+    else {
+      // baseline: default genotype products at sparse snps
+      fill(fx_base.begin(), fx_base.end(), 0.0);
+      scatter_default(chrom, GenoPoly(&snp_sum[0], 0, 1), &fx_base[0]);
+      vector <int>::const_iterator dense_begin =
+	lower_bound(dense_snps.begin(), dense_snps.end(), snp_start);
+      for (int i = 0; i < n; i++)
+	for (int j = i+1; j < n; j++) {
+	  memcpy(fx, &fx_base[0], sizeof(double)*N);
+	  for (vector <int>::const_iterator it = dense_begin;
+	       it != dense_snps.end() && *it < snp_end; it++)
+	    if (!snp_ignore[*it])
+	      fx[snp_bin[*it]] += mixed_rows[*it][i] * mixed_rows[*it][j];
+	  // sparse snps at which i or j is non-default: merge the two sorted lists
+	  const vector <int> &snps_i = indiv_sparse_snps[i], &snps_j = indiv_sparse_snps[j];
+	  vector <int>::const_iterator it_i = lower_bound(snps_i.begin(), snps_i.end(), snp_start);
+	  vector <int>::const_iterator it_j = lower_bound(snps_j.begin(), snps_j.end(), snp_start);
+	  while (true) {
+	    int s_i = it_i != snps_i.end() ? *it_i : snp_end;
+	    int s_j = it_j != snps_j.end() ? *it_j : snp_end;
+	    int s = min(min(s_i, s_j), snp_end);
+	    if (s == snp_end) break;
+	    if (s_i == s) it_i++;
+	    if (s_j == s) it_j++;
+	    if (!snp_ignore[s])
+	      fx[snp_bin[s]] += mixed_rows[s][i] * mixed_rows[s][j]
+		- sq(snp_sparse_geno[s]);
+	  }
+	  affine_data.gigj[i][j] = accumulate(fx, fx+numbins_chrom, 0.0);
+	  //affine_data[c1].gigj[i][j] * affine_data[c2].gigj[i][j] * -2*(2*S0p3 + S0p4) / (S0p3 * S0p4)
+	  // factor of 2 for sym (i,j) <-> (j,i)
+	  if (ff != NULL) ff->check = i == min(ff->check_indiv, n-2) && j == i+1;
+	  self_convolve_accum(cf, rev_c_arr, -2*(2*S0p3 + S0p4) / (S0p3 * S0p4),
+			      ff);
+	}
+    }
+
+    // 2*S22 * (3*S0p3 + S0p4) / (S0p3 * S0p4)... along with square terms from the previous
+    GenoPoly gg_term(&snp_sum[0], 0, 1);
+    fill(fx_base.begin(), fx_base.end(), 0.0);
+    scatter_default(chrom, gg_term, &fx_base[0]);
+    for (int i = 0; i < n; i++) {
+      scatter_indiv(chrom, i, gg_term, &fx_base[0], fx, N);
+      affine_data.gg[i] = accumulate(fx, fx+numbins_chrom, 0.0);
+      //affine_data[c1].gg[i] * affine_data[c2].gg[i] * (4*S0p3 + S0p4) / (S0p3 * S0p4)
+      if (ff != NULL) ff->check = i == ff->check_indiv;
+      self_convolve_accum(cf, rev_c_arr, (4*S0p3 + S0p4) / (S0p3 * S0p4), ff);
+    }
   }
 
   // returns binned pairs: (weighted LD, count of pairs in bin)
@@ -236,12 +872,14 @@ namespace ALD {
   vector < pair <double, double> > Alder::run_chrom(int chrom, int num_refs,
 						   const vector <double> &weights, double binsize,
 						   int numbins, int mincount,
-						   AffineData &affine_data) {
+						   AffineData &affine_data, bool allow_float,
+						   const BinnedRun *binned) {
     
     int snp_start = chrom_start_inds[chrom], snp_end = chrom_start_inds[chrom+1];
     int numbins_chrom = (snp_pos[snp_end-1] - snp_pos[snp_start]) / binsize + 1;
     vector < pair <double, double> > ans(numbins);
-    affine_data = AffineData(num_mixed_indivs, num_refs);
+    int num_sketches = num_refs == 1 ? polyache_sketches : 0;
+    affine_data = AffineData(num_mixed_indivs, num_refs, num_sketches);
     affine_data.count = count(snp_num_missing.begin()+snp_start,
 			      snp_num_missing.begin()+snp_end, 0);
     
@@ -250,14 +888,28 @@ namespace ALD {
     while ((1<<shift) < numbins_chrom) shift++;
     shift++;
     int N = 1<<shift, Nby2 = N>>1;
+    // segmented convolution (2-ref, if cheaper): transforms and accumulators of length N over
+    // blocks of the chrom's signals of length len (see ConvFFT)
+    int len = N, lag = min(numbins, numbins_chrom) - 1;
+    int seg_N = 0;
+    if (segmented_fft && num_refs == 2 && !(allow_float && fft_float_tol > 0) &&
+	sample_loo_file == NULL) {
+      vector <char> bin_used(numbins_chrom);
+      for (int s = snp_start; s < snp_end; s++)
+	if (!snp_ignore[s]) bin_used[snp_bin[s]] = 1;
+      seg_N = ConvFFT::segmented_length(bin_used, lag, N);
+    }
+    if (seg_N) {
+      len = numbins_chrom;
+      N = seg_N; Nby2 = N>>1;
+      for (shift = 0; (1<<shift) < N; shift++);
+    }
+    chrom_fft_segment[chrom] = seg_N;
     double onebyN = 1.0/N;
 
     // allocate memory and make fftw plans
-    double *fx = (double *) fftw_malloc(sizeof(double)<<shift);
-    double *gy = (double *) fftw_malloc(sizeof(double)<<shift);    
-    fftw_complex *fft_fx = (fftw_complex *) fftw_malloc(sizeof(fftw_complex)<<shift);
-    fftw_complex *fft_gy = (fftw_complex *) fftw_malloc(sizeof(fftw_complex)<<shift);
-    fftw_plan plans[2];
+    ConvFFT cf(N, seg_N ? len : 0, lag);
+    double *fx = cf.fx, *gy = cf.gy;
 
     fftw_complex *rev_c_arr = (fftw_complex *) fftw_malloc(sizeof(fftw_complex)<<shift);
     double *rev_r_arr = (double *) fftw_malloc(sizeof(double)*(N+1));
@@ -265,15 +917,15 @@ namespace ALD {
     fftw_plan rev_plan;
     
 #pragma omp critical
-    {
-      plans[0] = fftw_plan_dft_r2c_1d(N, fx, fft_fx, FFTW_ESTIMATE);
-      plans[1] = fftw_plan_dft_r2c_1d(N, gy, fft_gy, FFTW_ESTIMATE);
-      rev_plan = fftw_plan_dft_c2r_1d(N, rev_c_arr, rev_r_arr, FFTW_ESTIMATE);
-    }
+    rev_plan = fftw_plan_dft_c2r_1d(N, rev_c_arr, rev_r_arr, FFTW_ESTIMATE);
+    // mixed precision: per-indiv transforms in single precision; in each group of per-indiv
+    // terms, the term of indiv i_check is computed in both precisions
+    int i_check = (FFT_FLOAT_CHECK_SEED * (unsigned int) (chrom+1)) % num_mixed_indivs;
+    FloatFFT *ff = allow_float && fft_float_tol > 0 ? new FloatFFT(cf, i_check) : NULL;
 
     // count: this runs for both 2-ref and single-ref polyache
-    memset(fx, 0, sizeof(double)<<shift);
-    memset(gy, 0, sizeof(double)<<shift);
+    memset(fx, 0, sizeof(double)*len);
+    memset(gy, 0, sizeof(double)*len);
     for (int s = snp_start; s < snp_end; s++) {
       if (snp_ignore[s]) continue;
 
@@ -288,7 +940,7 @@ namespace ALD {
     }
 #ifdef FFT_CONVOLUTION
     memset(rev_c_arr, 0, sizeof(fftw_complex)<<shift);
-    convolve_accum(plans, Nby2, rev_c_arr, fft_fx, fft_gy);
+    convolve_accum(cf, rev_c_arr);
     fftw_execute(rev_plan);
     for (int b = 0; b < min(numbins, numbins_chrom); b++)
       ans[b].second = (rev_r_arr[b] + rev_r_arr[N-b]) * onebyN;
@@ -301,23 +953,57 @@ namespace ALD {
     // indivs and all
     memset(rev_c_arr, 0, sizeof(fftw_complex)<<shift); // clear; accum all terms before rev fft
     int n = num_mixed_indivs;
+    // scatter baselines: contributions of default genotypes at sparse snps
+    vector <double> fx_base(len), gy_base(len);
     if (num_refs == 2) {
-      for (int i = 0; i <= num_mixed_indivs; i++) { // i == num_mixed_indivs is for the sum term
+      TwoRefFx fx_term(&weights[0], &snp_num_missing[0]);
+      TwoRefGy gy_term(&weights[0], &snp_num_missing[0], &snp_sum[0], n);
+      if (binned == NULL) {
+	scatter_default(chrom, fx_term, &fx_base[0]);
+	scatter_default(chrom, gy_term, &gy_base[0]);
+      }
+      // per-sample contributions: the 2-ref terms are sum_i L(fx_i,gy_i) - L(F,G)/n with L the
+      // binned correlation, fx_i, gy_i the signals of indiv i, F = sum_i fx_i (the sum term's
+      // fx) and G = sum_i gy_i; leaving out indiv j gives (n-1)/(n-2) (A - L(F,G)/(n-1) - E_j)
+      // with A = sum_i L(fx_i,gy_i) and E_j = (n L(fx_j,gy_j) - L(F,gy_j) - L(fx_j,G)) / (n-1)
+      // (exact at snps without missing data; at others, the normalization and imputed mean
+      // are kept), computed from the transforms of fx_j, gy_j (the packed transform of
+      // convolve_accum), F and G; loo_delta[j] = full - leave-j-out
+      LooSpectra *loo = sample_loo_file != NULL && ff == NULL && n >= 3 ?
+	new LooSpectra(N) : NULL;
+      if (loo != NULL) {
 	memset(fx, 0, sizeof(double)<<shift);
 	memset(gy, 0, sizeof(double)<<shift);
 	for (int s = snp_start; s < snp_end; s++) {
 	  if (snp_ignore[s]) continue;
 	  int k = snp_num_missing[s];
-
-	  int b = snp_bin[s];
-	  if (i < num_mixed_indivs) { // indiv
-	    int gtype = mixed_geno[s*num_mixed_indivs+i];
-	    if (k == 0) affine_data.wg[i] += gtype * weights[s]; // for affine term
-	    fx[b] += (k==0) * gtype * weights[s];
-	    gy[b] += (gtype*(gtype!=9) + (gtype==9)*snp_sum[s]/(double) (n-k))
-	      * weights[s] / ((1+(k==0)) * (n-k-1));
+	  fx[snp_bin[s]] += (k==0) * snp_sum[s] * weights[s];
+	  gy[snp_bin[s]] += n * snp_sum[s] * weights[s] / ((1+(k==0)) * (n-k) * (n-k-1.0));
+	}
+	cf.spectra(loo->F, loo->G);
+	affine_data.loo_delta = vector < vector <double> > (n, vector <double> (numbins));
+      }
+      for (int i = 0; i <= num_mixed_indivs; i++) { // i == num_mixed_indivs is for the sum term
+	if (i < num_mixed_indivs) { // indiv
+	  if (binned != NULL) { // bin sums from prepare_binned_runs
+	    long off = (long) i * numbins_chrom;
+	    memcpy(fx, &binned->fx[chrom][off], numbins_chrom*sizeof(double));
+	    memcpy(gy, &binned->gy[chrom][off], numbins_chrom*sizeof(double));
+	    memset(fx+numbins_chrom, 0, (len-numbins_chrom)*sizeof(double));
+	    memset(gy+numbins_chrom, 0, (len-numbins_chrom)*sizeof(double));
 	  }
-	  else { // sum term
+	  else
+	    scatter_indiv(chrom, i, fx_term, &fx_base[0], fx, gy_term, &gy_base[0], gy, len);
+	  affine_data.wg[i] = accumulate(fx, fx+numbins_chrom, 0.0); // for affine term
+	  if (ff != NULL) ff->check = i == ff->check_indiv;
+	}
+	else { // sum term
+	  memset(fx, 0, sizeof(double)*len);
+	  memset(gy, 0, sizeof(double)*len);
+	  for (int s = snp_start; s < snp_end; s++) {
+	    if (snp_ignore[s]) continue;
+	    int k = snp_num_missing[s];
+	    int b = snp_bin[s];
 	    if (k == 0) affine_data.ws += snp_sum[s] * weights[s]; // for affine term
 	    fx[b] += (k==0) * snp_sum[s] * weights[s];
 	    gy[b] -= snp_sum[s] * weights[s] / ((1+(k==0)) * (n-k) * (n-k-1));
@@ -325,13 +1011,27 @@ namespace ALD {
 	}
 	  
 #ifdef FFT_CONVOLUTION
-	convolve_accum(plans, Nby2, rev_c_arr, fft_fx, fft_gy);
+	convolve_accum(cf, rev_c_arr, 1.0, ff);
+	if (loo != NULL && i < num_mixed_indivs) {
+	  loo->add_indiv(cf.fft_z, n);
+	  for (int b = 0; b < min(numbins, numbins_chrom); b++)
+	    affine_data.loo_delta[i][b] = (loo->r[b] + loo->r[N-b]) * onebyN; // E_i for now
+	}
 #else
 	for (int b1 = 0; b1 < numbins_chrom; b1++)
 	  for (int b2 = max(0, b1-numbins+1); b2 < numbins_chrom && b2-b1 < numbins; b2++)
 	    ans[abs(b2-b1)].first += fx[b1] * gy[b2];
 #endif
       }
+      if (loo != NULL) {
+	vector <double> A(numbins), T(numbins);
+	loo->totals(&A[0], &T[0], min(numbins, numbins_chrom));
+	for (int i = 0; i < n; i++)
+	  for (int b = 0; b < min(numbins, numbins_chrom); b++)
+	    affine_data.loo_delta[i][b] = A[b] - T[b]/n
+	      - (n-1.0) / (n-2) * (A[b] - T[b]/(n-1) - affine_data.loo_delta[i][b]);
+	delete loo;
+      }
     }
     else { // polyache
       /*
@@ -360,28 +1060,31 @@ namespace ALD {
       double S0 = n;
       double S0p2 = S0*(S0-1);
       double S0p3 = S0p2*(S0-2);
-      double S0p4 = S0p3*(S0-3);
       
+      // sketch mode: sketched part of the S11^2 terms (done first, while rev_c_arr is free)
+      if (num_sketches)
+	polyache_sketch_terms(chrom, cf, rev_c_arr, rev_plan, rev_r_arr, numbins, numbins_chrom,
+			      affine_data);
+
       // -4*pAx*pAy * S10 * S01 / S0p2
       memset(fx, 0, sizeof(double)<<shift);
       for (int s = snp_start; s < snp_end; s++)
 	if (!snp_ignore[s])
 	  fx[snp_bin[s]] += weights[s] * snp_sum[s];
       affine_data.ws = accumulate(fx, fx+numbins_chrom, 0.0);
-      self_convolve_accum(plans, Nby2, rev_c_arr, fft_fx, -4 / S0p2);
+      self_convolve_accum(cf, rev_c_arr, -4 / S0p2);
       //affine_data[c1].ws * affine_data[c2].ws * -4 / S0p2
       
       // 4*pAx*pAy * S11 * (S0p2 + S0) / (S0 * S0p2)
+      GenoTimesWeight wg_term(&weights[0]);
+      vector <double> wg_base(N);
+      scatter_default(chrom, wg_term, &wg_base[0]);
       for (int i = 0; i < n; i++) {
-	memset(fx, 0, sizeof(double)<<shift);
-	for (int s = snp_start; s < snp_end; s++)
-	  if (!snp_ignore[s]) {
-	    int gtype = mixed_geno[s*num_mixed_indivs+i];
-	    fx[snp_bin[s]] += weights[s] * gtype;
-	  }
+	scatter_indiv(chrom, i, wg_term, &wg_base[0], fx, N);
 	affine_data.wg[i] = accumulate(fx, fx+numbins_chrom, 0.0);
 	//affine_data[c1].wg[i] * affine_data[c2].wg[i] * 4 * (S0p2 + S0) / (S0 * S0p2)
-	self_convolve_accum(plans, Nby2, rev_c_arr, fft_fx, 4 * (S0p2 + S0) / (S0 * S0p2));
+	if (ff != NULL) ff->check = i == ff->check_indiv;
+	self_convolve_accum(cf, rev_c_arr, 4 * (S0p2 + S0) / (S0 * S0p2), ff);
       }
 
       // 4*pAx * S10 * (S01*S01-S02) / S0p3   (combining sym term)
@@ -392,88 +1095,31 @@ namespace ALD {
 	  gy[snp_bin[s]] += sq(snp_sum[s]) - snp_sum2[s];
 	}
       //affine_data[c1].ws * (affine_data[c2].ss - affine_data[c2].s2) * 4 / S0p3
-      convolve_accum(plans, Nby2, rev_c_arr, fft_fx, fft_gy, 4 / S0p3);
+      convolve_accum(cf, rev_c_arr, 4 / S0p3);
 
       // 4*pAx * (S12 - S11*S01) * ((2*S0p2 + S0p3) / (S0p2 * S0p3))   (combining sym term)
+      GenoPoly gg_gs_term(&snp_sum[0], -1, 1);
+      fill(gy_base.begin(), gy_base.end(), 0.0);
+      scatter_default(chrom, gg_gs_term, &gy_base[0]);
       for (int i = 0; i < n; i++) {
-	memset(fx, 0, sizeof(double)<<shift); memset(gy, 0, sizeof(double)<<shift);
-	for (int s = snp_start; s < snp_end; s++)
-	  if (!snp_ignore[s]) {
-	    int gtype = mixed_geno[s*num_mixed_indivs+i];
-	    fx[snp_bin[s]] += weights[s] * gtype;
-	    gy[snp_bin[s]] += sq(gtype) - gtype * snp_sum[s];
-	  }
+	scatter_indiv(chrom, i, wg_term, &wg_base[0], fx, gg_gs_term, &gy_base[0], gy, N);
 	//affine_data[c1].wg[i] * (affine_data[c2].gg[i] - affine_data[c2].gs[i]) * 4*(2*S0p2+S0p3) / (S0p2*S0p3)
-	convolve_accum(plans, Nby2, rev_c_arr, fft_fx, fft_gy, 4*(2*S0p2+S0p3) / (S0p2*S0p3));
-      }
-
-      // (2*S20 - S10*S10) * S01*S01 / S0p4   (combining sym term in first)
-      memset(fx, 0, sizeof(double)<<shift); memset(gy, 0, sizeof(double)<<shift);
-      for (int s = snp_start; s < snp_end; s++)
-	if (!snp_ignore[s]) {
-	  fx[snp_bin[s]] += 2*snp_sum2[s] - sq(snp_sum[s]);
-	  gy[snp_bin[s]] += sq(snp_sum[s]);
-	}
-      affine_data.ss = accumulate(gy, gy+numbins_chrom, 0.0);
-      //(2*affine_data[c1].s2 - affine_data[c1].ss) * affine_data[c2].ss * 1 / S0p4
-      convolve_accum(plans, Nby2, rev_c_arr, fft_fx, fft_gy, 1 / S0p4);
-
-      // -S02 * S20 / S0p4
-      memset(fx, 0, sizeof(double)<<shift);
-      for (int s = snp_start; s < snp_end; s++)
-	if (!snp_ignore[s])
-	  fx[snp_bin[s]] += snp_sum2[s];
-      affine_data.s2 = accumulate(fx, fx+numbins_chrom, 0.0);
-      //affine_data[c1].s2 * affine_data[c2].s2 * -1/S0p4
-      self_convolve_accum(plans, Nby2, rev_c_arr, fft_fx, -1/S0p4);
-
-      // (S10 * S11 * S01 - 2 * S21 * S01) * (4*S0p3 + S0p4) / (S0p3 * S0p4)   (combining sym term in second)
-      for (int i = 0; i < n; i++) {
-	memset(fx, 0, sizeof(double)<<shift); memset(gy, 0, sizeof(double)<<shift);
-	for (int s = snp_start; s < snp_end; s++)
-	  if (!snp_ignore[s]) {
-	    int gtype = mixed_geno[s*num_mixed_indivs+i];
-	    fx[snp_bin[s]] += gtype * snp_sum[s] - 2*sq(gtype);
-	    gy[snp_bin[s]] += gtype * snp_sum[s];
-	  }
-	affine_data.gs[i] = accumulate(gy, gy+numbins_chrom, 0.0);
-	//(affine_data[c1].gs[i] - 2*affine_data[c1].gg[i]) * affine_data[c2].gs[i] * (4*S0p3 + S0p4) / (S0p3 * S0p4)
-	convolve_accum(plans, Nby2, rev_c_arr, fft_fx, fft_gy, (4*S0p3 + S0p4) / (S0p3 * S0p4));
+	if (ff != NULL) ff->check = i == ff->check_indiv;
+	convolve_accum(cf, rev_c_arr, 4*(2*S0p2+S0p3) / (S0p2*S0p3), ff);
       }
 
-      // -S11*S11 * (2*S0p3 + S0p4) / (S0p3 * S0p4)
-      for (int i = 0; i < n; i++)
-	for (int j = i+1; j < n; j++) {
-	  memset(fx, 0, sizeof(double)<<shift);
-	  for (int s = snp_start; s < snp_end; s++)
-	    if (!snp_ignore[s]) {
-	      int gtype_i = mixed_geno[s*num_mixed_indivs+i];
-	      int gtype_j = mixed_geno[s*num_mixed_indivs+j];
-	      fx[snp_bin[s]] += gtype_i * gtype_j;
-	    }
-	  affine_data.gigj[i][j] = accumulate(fx, fx+numbins_chrom, 0.0);
-	  //affine_data[c1].gigj[i][j] * affine_data[c2].gigj[i][j] * -2*(2*S0p3 + S0p4) / (S0p3 * S0p4)
-	  // factor of 2 for sym (i,j) <-> (j,i)
-	  self_convolve_accum(plans, Nby2, rev_c_arr, fft_fx, -2*(2*S0p3 + S0p4) / (S0p3 * S0p4));
-	}
-
-      // 2*S22 * (3*S0p3 + S0p4) / (S0p3 * S0p4)... along with square terms from the previous
-      for (int i = 0; i < n; i++) {
-	memset(fx, 0, sizeof(double)<<shift);
-	for (int s = snp_start; s < snp_end; s++)
-	  if (!snp_ignore[s]) {
-	    int gtype = mixed_geno[s*num_mixed_indivs+i];
-	    fx[snp_bin[s]] += sq(gtype);
-	  }
-	affine_data.gg[i] = accumulate(fx, fx+numbins_chrom, 0.0);
-	//affine_data[c1].gg[i] * affine_data[c2].gg[i] * (4*S0p3 + S0p4) / (S0p3 * S0p4)
-	self_convolve_accum(plans, Nby2, rev_c_arr, fft_fx, (4*S0p3 + S0p4) / (S0p3 * S0p4));
-      }
+      // remaining terms (not involving the weights)
+      polyache_geno_terms(chrom, cf, rev_c_arr, ff, numbins_chrom, affine_data);
 
       // divide the whole thing by 8 (4 for original polyache x 2 for double-count)
+      cf.flush();
       for (int b = 0; b <= Nby2; b++) {
 	rev_c_arr[b][0] /= 8;
 	rev_c_arr[b][1] /= 8;
+	if (ff != NULL) {
+	  ff->diff[b][0] /= 8;
+	  ff->diff[b][1] /= 8;
+	}
       }
     }
 #ifdef FFT_CONVOLUTION
@@ -481,13 +1127,204 @@ namespace ALD {
     for (int b = 0; b < min(numbins, numbins_chrom); b++)
       ans[b].first = (rev_r_arr[b] + rev_r_arr[N-b]) * onebyN;
 #endif
-    fftw_destroy_plan(plans[0]); fftw_free(fx); fftw_free(fft_fx);
-    fftw_destroy_plan(plans[1]); fftw_free(gy); fftw_free(fft_gy);
+    if (ff != NULL) {
+      // error estimate: single-precision error of the check terms (one per term group), times
+      // sqrt(number of terms / number of checks) (assuming independent errors), relative to
+      // the max magnitude of the weighted LD curve over the bins that can be fitted (b >= 1:
+      // bin 0, which dominates, is never fitted)
+      fftw_execute_dft_c2r(rev_plan, ff->diff, rev_r_arr);
+      double max_err = 0, max_ld = 0;
+      for (int b = 1; b < min(numbins, numbins_chrom); b++) {
+	if (ans[b].second == 0) continue;
+	max_err = max(max_err, fabs(rev_r_arr[b] + rev_r_arr[N-b]) * onebyN / ans[b].second);
+	max_ld = max(max_ld, fabs(ans[b].first) / ans[b].second);
+      }
+      double rel_err = max_ld == 0 || ff->num_checks == 0 ? 0
+	: max_err * sqrt((double) ff->num_terms / ff->num_checks) / max_ld;
+      delete ff;
+      chrom_fft_float_err[chrom] = rel_err;
+      if (rel_err > fft_float_tol) { // recompute in double precision
+	fftw_destroy_plan(rev_plan); fftw_free(rev_c_arr); fftw_free(rev_r_arr);
+	return run_chrom(chrom, num_refs, weights, binsize, numbins, mincount, affine_data,
+			 false, binned);
+      }
+    }
+    for (int k = 0; k < (int) affine_data.sketch_ld.size(); k++)
+      for (int b = 0; b < min(numbins, numbins_chrom); b++)
+	ans[b].first += affine_data.sketch_ld[k][b] / affine_data.sketch_ld.size();
     fftw_destroy_plan(rev_plan); fftw_free(rev_c_arr); fftw_free(rev_r_arr);
 
     return ans;
   }
 
+  // fused admixture test: z_accumA += scale_x * |XA|^2 + scale_g * conj(XA) * G (likewise for
+  // B) and z_accum2 += scale_2 * |XA - XB|^2, at b = 0..Nby2
+  static void fused_accum(const fftw_complex *XA, const fftw_complex *XB, const fftw_complex *G,
+			  int Nby2, double scale_x, double scale_g, double scale_2,
+			  fftw_complex *z_accumA, fftw_complex *z_accumB, fftw_complex *z_accum2) {
+    for (int b = 0; b <= Nby2; b++) {
+      double ar = XA[b][0], ai = XA[b][1], br = XB[b][0], bi = XB[b][1];
+      double gr = G[b][0], gi = G[b][1];
+      z_accumA[b][0] += (ar*ar + ai*ai) * scale_x + (ar*gr + ai*gi) * scale_g;
+      z_accumA[b][1] += (ar*gi - ai*gr) * scale_g;
+      z_accumB[b][0] += (br*br + bi*bi) * scale_x + (br*gr + bi*gi) * scale_g;
+      z_accumB[b][1] += (br*gi - bi*gr) * scale_g;
+      z_accum2[b][0] += (sq(ar-br) + sq(ai-bi)) * scale_2;
+    }
+  }
+
+  // with no missing data at the snps used, the 2-ref terms of run_chrom are |WG_i|^2 / (2(n-1))
+  // and -|WS|^2 / (2n(n-1)), where WG_i and WS are the transforms of the per-indiv and total
+  // signals wg_i, ws (linear in the weights): with weights wA - wB, these are differences of
+  // the signals of the 1-ref runs with weights wA and wB; the 1-ref terms involving the weights
+  // are |WG_i|^2, |WS|^2 and their products with the transforms of gg_i - gs_i and ss - s2,
+  // and the rest (polyache_sketch_terms, polyache_geno_terms) are shared by both 1-ref curves
+  // so per indiv, one packed transform of wg_i for wA and wB and one of gg_i - gs_i suffice
+  void Alder::run_chrom_fused(int chrom, const vector <double> &wA, const vector <double> &wB,
+			      double binsize, int numbins,
+			      vector < vector < pair <double, double> > > &ans,
+			      vector <AffineData> &affine_data) {
+
+    int snp_start = chrom_start_inds[chrom], snp_end = chrom_start_inds[chrom+1];
+    int numbins_chrom = (snp_pos[snp_end-1] - snp_pos[snp_start]) / binsize + 1;
+    int n = num_mixed_indivs;
+    ans = vector < vector < pair <double, double> > > (3, vector < pair <double, double> >
+						       (numbins));
+    affine_data = vector <AffineData> (3);
+    affine_data[0] = AffineData(n, 2);
+    affine_data[1] = AffineData(n, 1, polyache_sketches);
+    double num_complete = count(snp_num_missing.begin()+snp_start,
+				snp_num_missing.begin()+snp_end, 0);
+    affine_data[0].count = affine_data[1].count = num_complete;
+
+    int shift = 0;
+    while ((1<<shift) < numbins_chrom) shift++;
+    shift++;
+    int N = 1<<shift, Nby2 = N>>1;
+    double onebyN = 1.0/N;
+
+    ConvFFT cf(N);
+    double *fx = cf.fx, *gy = cf.gy;
+
+    // accumulators: terms shared by the 1-ref curves (rev_c_arr), the other terms of each 1-ref
+    // curve (accA, accB) and the 2-ref curve (acc2); spectra of the current signals (XA, XB, G)
+    fftw_complex *arrs[7];
+    for (int k = 0; k < 7; k++) {
+      arrs[k] = (fftw_complex *) fftw_malloc(sizeof(fftw_complex)<<shift);
+      memset(arrs[k], 0, sizeof(fftw_complex)<<shift);
+    }
+    fftw_complex *rev_c_arr = arrs[0], *accA = arrs[1], *accB = arrs[2], *acc2 = arrs[3];
+    fftw_complex *XA = arrs[4], *XB = arrs[5], *G = arrs[6];
+    double *rev_r_arr = (double *) fftw_malloc(sizeof(double)*(N+1));
+    rev_r_arr[N] = 0;
+    fftw_plan rev_plan;
+#pragma omp critical
+    rev_plan = fftw_plan_dft_c2r_1d(N, rev_c_arr, rev_r_arr, FFTW_ESTIMATE);
+
+    // count: the same for all three curves (no missing data at the snps used)
+    memset(fx, 0, sizeof(double)<<shift);
+    memset(gy, 0, sizeof(double)<<shift);
+    for (int s = snp_start; s < snp_end; s++)
+      if (!snp_ignore[s]) {
+	fx[snp_bin[s]] += 1.0;
+	gy[snp_bin[s]] += 0.5;
+      }
+    convolve_accum(cf, rev_c_arr);
+    fftw_execute(rev_plan);
+    for (int b = 0; b < min(numbins, numbins_chrom); b++)
+      for (int k = 0; k < 3; k++)
+	ans[k][b].second = (rev_r_arr[b] + rev_r_arr[N-b]) * onebyN;
+    memset(rev_c_arr, 0, sizeof(fftw_complex)<<shift);
+
+    double S0 = n;
+    double S0p2 = S0*(S0-1);
+    double S0p3 = S0p2*(S0-2);
+
+    if (polyache_sketches) // leaves rev_c_arr cleared
+      polyache_sketch_terms(chrom, cf, rev_c_arr, rev_plan, rev_r_arr, numbins, numbins_chrom,
+			    affine_data[1]);
+
+    // total terms: ws with ss - s2
+    memset(fx, 0, sizeof(double)<<shift);
+    memset(gy, 0, sizeof(double)<<shift);
+    for (int s = snp_start; s < snp_end; s++)
+      if (!snp_ignore[s]) {
+	fx[snp_bin[s]] += wA[s] * snp_sum[s];
+	gy[snp_bin[s]] += wB[s] * snp_sum[s];
+      }
+    double wsA = accumulate(fx, fx+numbins_chrom, 0.0);
+    double wsB = accumulate(gy, gy+numbins_chrom, 0.0);
+    cf.spectra(XA, XB);
+    memset(fx, 0, sizeof(double)<<shift);
+    for (int s = snp_start; s < snp_end; s++)
+      if (!snp_ignore[s])
+	fx[snp_bin[s]] += sq(snp_sum[s]) - snp_sum2[s];
+    cf.spectra(G, NULL);
+    fused_accum(XA, XB, G, Nby2, -4 / S0p2, 4 / S0p3, -1 / (2*S0p2), accA, accB, acc2);
+
+    // per-indiv terms: wg_i with gg_i - gs_i
+    GenoTimesWeight wgA_term(&wA[0]), wgB_term(&wB[0]);
+    GenoPoly gg_gs_term(&snp_sum[0], -1, 1);
+    vector <double> wgA_base(N), wgB_base(N), gg_gs_base(N);
+    scatter_default(chrom, wgA_term, &wgA_base[0]);
+    scatter_default(chrom, wgB_term, &wgB_base[0]);
+    scatter_default(chrom, gg_gs_term, &gg_gs_base[0]);
+    vector <double> wgB(n);
+    for (int i = 0; i < n; i++) {
+      scatter_indiv(chrom, i, wgA_term, &wgA_base[0], fx, wgB_term, &wgB_base[0], gy, N);
+      affine_data[1].wg[i] = accumulate(fx, fx+numbins_chrom, 0.0);
+      wgB[i] = accumulate(gy, gy+numbins_chrom, 0.0);
+      affine_data[0].wg[i] = affine_data[1].wg[i] - wgB[i];
+      cf.spectra(XA, XB);
+      scatter_indiv(chrom, i, gg_gs_term, &gg_gs_base[0], fx, N);
+      cf.spectra(G, NULL);
+      fused_accum(XA, XB, G, Nby2, 4 * (S0p2 + S0) / (S0 * S0p2),
+		  4*(2*S0p2+S0p3) / (S0p2*S0p3), 1 / (2*(S0-1)), accA, accB, acc2);
+    }
+    affine_data[0].ws = wsA - wsB;
+    affine_data[1].ws = wsA;
+
+    polyache_geno_terms(chrom, cf, rev_c_arr, NULL, numbins_chrom, affine_data[1]);
+    cf.flush();
+    affine_data[2] = affine_data[1];
+    affine_data[2].ws = wsB;
+    affine_data[2].wg = wgB;
+
+    // 1-ref: add the shared terms and divide by 8 (see run_chrom)
+    for (int b = 0; b <= Nby2; b++)
+      for (int j = 0; j < 2; j++) {
+	accA[b][j] = (accA[b][j] + rev_c_arr[b][j]) / 8;
+	accB[b][j] = (accB[b][j] + rev_c_arr[b][j]) / 8;
+      }
+    fftw_complex *accs[3] = {acc2, accA, accB};
+    for (int k = 0; k < 3; k++) {
+      fftw_execute_dft_c2r(rev_plan, accs[k], rev_r_arr);
+      for (int b = 0; b < min(numbins, numbins_chrom); b++) {
+	ans[k][b].first = (rev_r_arr[b] + rev_r_arr[N-b]) * onebyN;
+	for (int j = 0; j < (int) affine_data[k].sketch_ld.size(); j++)
+	  ans[k][b].first += affine_data[k].sketch_ld[j][b] / affine_data[k].sketch_ld.size();
+      }
+    }
+    fftw_destroy_plan(rev_plan); fftw_free(rev_r_arr);
+    for (int k = 0; k < 7; k++) fftw_free(arrs[k]);
+  }
+
+  // true if the 2-ref run with weights wA - wB and the 1-ref runs with weights wA and wB
+  // ignore the same snps on the chrom (see set_snp_tables), i.e., if no snp used by the 2-ref
+  // run has missing data and wA, wB are missing at the same snps
+  bool Alder::chrom_fused_eligible(int chrom, const vector <double> &wA,
+				   const vector <double> &wB, int mincount) {
+    int maxmissing = num_mixed_indivs - mincount;
+    for (int s = chrom_start_inds[chrom]; s < chrom_start_inds[chrom+1]; s++) {
+      int k = snp_num_missing[s];
+      bool ignore_A = k > 0 || isnan(wA[s]), ignore_B = k > 0 || isnan(wB[s]);
+      bool ignore_2 = k > maxmissing || isnan(wA[s] - wB[s]);
+      if (ignore_A != ignore_B || ignore_A != ignore_2)
+	return false;
+    }
+    return true;
+  }
+
   vector < pair <double, double> > Alder::run_chrom_naive(int chrom, int num_refs,
 							 const vector <double> &weights,
 							 double binsize, int numbins,
@@ -515,13 +1352,124 @@ namespace ALD {
     return ans;
   }
 
-  pair <double, double> Alder::compute_inter_chrom_affine(const vector <AffineData> &affdats) {
-    int num_refs = affdats[0].num_refs;
-    double aff = 0.0;
-    double tot_pair_count = 0.0;
-    double S0 = num_mixed_indivs;
-    double S0p2 = S0*(S0-1);
-    double S0p3 = S0p2*(S0-2);
+  // true if the chrom has no missing test pop data at the snps the pairwise algorithm uses
+  // (the FFT and pairwise algorithms handle missing data differently)
+  bool Alder::chrom_pairwise_eligible(int chrom, const vector <double> &weights, int mincount) {
+    int maxmissing = num_mixed_indivs - mincount;
+    for (int s = chrom_start_inds[chrom]; s < chrom_start_inds[chrom+1]; s++)
+      if (!isnan(weights[s]) && snp_num_missing[s] > 0 && snp_num_missing[s] <= maxmissing)
+	return false;
+    return true;
+  }
+
+  // sets chrom_use_pairwise by comparing predicted costs (in units of genotype operations):
+  // - FFT: (number of transforms) * FFT_COST_FACTOR * N log2(N) + scatter passes over snps
+  // - pairwise: (snp pairs within numbins) * n (* 2 for polyache), plus computing the
+  //   affine term data (quadratic in n for polyache)
+  void Alder::select_chrom_algos(int num_refs, const vector <double> &weights, int numbins,
+				 int mincount) {
+    double n = num_mixed_indivs;
+    bool print_chroms = !chrom_algos_printed;
+    chrom_algos_printed = true;
+    if (print_chroms)
+      printf("algorithm selection (predicted cost in genotype operations):\n");
+    double tot_cost = 0, tot_fft_cost = 0;
+    int num_pairwise = 0;
+    for (int c = 0; c < num_chroms_used; c++) {
+      int snp_start = chrom_start_inds[c], snp_end = chrom_start_inds[c+1];
+      vector <int> bins; // bins of snps used
+      for (int s = snp_start; s < snp_end; s++)
+	if (!snp_ignore[s]) bins.push_back(snp_bin[s]);
+      double num_snps = bins.size(), num_pairs = 0;
+      for (int j1 = 0, j2 = 0; j1 < (int) bins.size(); j1++) {
+	while (j2 < (int) bins.size() && bins[j2] - bins[j1] < numbins) j2++;
+	num_pairs += j2 - j1 - 1;
+      }
+      int shift = 0;
+      while ((1<<shift) < (bins.empty() ? 1 : bins.back()+1)) shift++;
+      shift++;
+      double N_log_N = (double) (1<<shift) * shift;
+      double num_ffts, num_scatters, pairwise_cost;
+      if (num_refs == 2) {
+	num_ffts = 2*(n+1) + 3;
+	num_scatters = n+2;
+	pairwise_cost = num_pairs * n + n * num_snps;
+      }
+      else {
+	num_ffts = 6*n + n*(n-1)/2 + 8;
+	num_scatters = 4*n + n*(n-1)/2 + 5;
+	pairwise_cost = 2 * num_pairs * n + (3*n + n*(n-1)/2) * num_snps;
+      }
+      double fft_cost = num_ffts * FFT_COST_FACTOR * N_log_N + num_scatters * num_snps;
+      bool eligible = chrom_pairwise_eligible(c, weights, mincount);
+      chrom_use_pairwise[c] = eligible && pairwise_cost < fft_cost;
+      if (print_chroms)
+	printf("  chrom %s: FFT %.3g, pairwise %.3g%s -> %s\n", jack_ind_ids[c].c_str(),
+	       fft_cost, pairwise_cost, eligible ? "" : " (not eligible: missing data)",
+	       chrom_use_pairwise[c] ? "pairwise" : "FFT");
+      num_pairwise += chrom_use_pairwise[c];
+      tot_cost += chrom_use_pairwise[c] ? pairwise_cost : fft_cost;
+      tot_fft_cost += fft_cost;
+    }
+    printf("algorithm selection: pairwise on %d of %d chroms (predicted cost %.3g vs %.3g all"
+	   " FFT)\n", num_pairwise, num_chroms_used, tot_cost, tot_fft_cost);
+  }
+
+  // computes affine term data directly, as done by run_chrom (for chroms run with the pairwise
+  // algorithm: assumes no missing data at the snps used)
+  void Alder::compute_affine_data(int chrom, int num_refs, const vector <double> &weights,
+				  AffineData &affine_data) {
+    int snp_start = chrom_start_inds[chrom], snp_end = chrom_start_inds[chrom+1];
+    int n = num_mixed_indivs;
+    affine_data = AffineData(n, num_refs);
+    affine_data.count = count(snp_num_missing.begin()+snp_start,
+			      snp_num_missing.begin()+snp_end, 0);
+    for (int s = snp_start; s < snp_end; s++) {
+      if (snp_ignore[s]) continue;
+      const char *geno = mixed_rows[s];
+      affine_data.ws += snp_sum[s] * weights[s];
+      for (int i = 0; i < n; i++)
+	affine_data.wg[i] += geno[i] * weights[s];
+      if (num_refs == 1) {
+	affine_data.ss += sq(snp_sum[s]);
+	affine_data.s2 += snp_sum2[s];
+	for (int i = 0; i < n; i++) {
+	  affine_data.gg[i] += sq(geno[i]);
+	  affine_data.gs[i] += geno[i] * snp_sum[s];
+	  for (int j = i+1; j < n; j++)
+	    affine_data.gigj[i][j] += geno[i] * geno[j];
+	}
+      }
+    }
+  }
+
+  vector < pair <double, double> > Alder::run_chrom_selected(int chrom, int num_refs,
+							    const vector <double> &weights,
+							    double binsize, int numbins,
+							    int mincount, bool use_naive_algo,
+							    AffineData &affine_data) {
+    geno.acquire(chrom);
+    vector < pair <double, double> > ans;
+    if (use_naive_algo)
+      ans = run_chrom_naive(chrom, num_refs, weights, binsize, numbins, mincount);
+    else if (chrom_use_pairwise[chrom]) {
+      compute_affine_data(chrom, num_refs, weights, affine_data);
+      ans = run_chrom_naive(chrom, num_refs, weights, binsize, numbins, mincount);
+    }
+    else
+      ans = run_chrom(chrom, num_refs, weights, binsize, numbins, mincount, affine_data);
+    geno.release(chrom);
+    return ans;
+  }
+
+  pair <double, double> Alder::compute_inter_chrom_affine(const vector <AffineData> &affdats,
+							 int skip_indiv) {
+    int num_refs = affdats[0].num_refs;
+    double aff = 0.0;
+    double tot_pair_count = 0.0;
+    double S0 = num_mixed_indivs;
+    double S0p2 = S0*(S0-1);
+    double S0p3 = S0p2*(S0-2);
     double S0p4 = S0p3*(S0-3);
     // note: this gets called with both all chroms and one left out
     for (int c1 = 0; c1 < (int) affdats.size(); c1++) {
@@ -530,11 +1478,19 @@ namespace ALD {
 	if (c2 == c1) continue;
 	tot_pair_count += affdats[c1].count * affdats[c2].count;
 	if (num_refs == 2) {
-	  for (int i = 0; i < num_mixed_indivs; i++)
-	    aff += 1.0/(num_mixed_indivs-1)
+	  int n = num_mixed_indivs - (skip_indiv != -1);
+	  double ws1 = affdats[c1].ws, ws2 = affdats[c2].ws;
+	  for (int i = 0; i < num_mixed_indivs; i++) {
+	    if (i == skip_indiv) {
+	      ws1 -= affdats[c1].wg[i];
+	      ws2 -= affdats[c2].wg[i];
+	      continue;
+	    }
+	    aff += 1.0/(n-1)
 	      * affdats[c1].wg[i] * affdats[c2].wg[i];
-	  aff -= 1.0/(num_mixed_indivs*(num_mixed_indivs-1))
-	    * affdats[c1].ws * affdats[c2].ws;
+	  }
+	  aff -= 1.0/(n*(n-1))
+	    * ws1 * ws2;
 	}
 	else { // polyache
 	  aff += affdats[c1].ws * affdats[c2].ws * -4 / S0p2;
@@ -548,9 +1504,22 @@ namespace ALD {
 	    aff += (affdats[c1].gs[i] - 2*affdats[c1].gg[i]) * affdats[c2].gs[i]
 	      * (4*S0p3 + S0p4) / (S0p3 * S0p4);
 	    aff += affdats[c1].gg[i] * affdats[c2].gg[i] * (4*S0p3 + S0p4) / (S0p3 * S0p4);
-	    for (int j = i+1; j < num_mixed_indivs; j++)
-	      aff += affdats[c1].gigj[i][j] * affdats[c2].gigj[i][j]
-		* -2*(2*S0p3 + S0p4) / (S0p3 * S0p4);
+	    if (affdats[c1].sketch_sums.empty())
+	      for (int j = i+1; j < num_mixed_indivs; j++)
+		aff += affdats[c1].gigj[i][j] * affdats[c2].gigj[i][j]
+		  * -2*(2*S0p3 + S0p4) / (S0p3 * S0p4);
+	  }
+	  int num_sketches = affdats[c1].sketch_sums.size();
+	  if (num_sketches) { // sketch mode: see run_chrom for the decomposition of S11^2
+	    double s11sq = S0p2/2 * affdats[c1].s11_m * affdats[c2].s11_m
+	      - (affdats[c1].s11_m * affdats[c2].s11_d + affdats[c1].s11_d * affdats[c2].s11_m) / 2;
+	    for (int i = 0; i < num_mixed_indivs; i++)
+	      s11sq += (S0-2) * affdats[c1].s11_p[i] * affdats[c2].s11_p[i]
+		- (affdats[c1].s11_p[i] * affdats[c2].s11_c[i]
+		   + affdats[c1].s11_c[i] * affdats[c2].s11_p[i]);
+	    for (int k = 0; k < num_sketches; k++)
+	      s11sq += affdats[c1].sketch_sums[k] * affdats[c2].sketch_sums[k] / num_sketches;
+	    aff += s11sq * -2*(2*S0p3 + S0p4) / (S0p3 * S0p4);
 	  }
 	}
       }
@@ -581,11 +1550,14 @@ namespace ALD {
   ExpFitALD Alder::exp_fit_jackknife(const vector <AlderResults> &results_jackknife,
 				    double mindis, double maxdis) {
 
-    ExpFitALD fits(num_chroms_used+1, mindis, maxdis, use_jackknife);
-    // jc == num_chroms_used is for all (no jackknife)
-    // don't bother computing jc in [0..num_chroms_used) if not use_jackknife
+    // number of jackknife reps: num_chroms_used unless results only cover a subset of chroms
+    int num_jacks = results_jackknife.size()-1;
+    bool use_jackknife_reps = use_jackknife && num_jacks > 1;
+    ExpFitALD fits(num_jacks+1, mindis, maxdis, use_jackknife_reps);
+    // jc == num_jacks is for all (no jackknife)
+    // don't bother computing jc in [0..num_jacks) if not use_jackknife_reps
 #pragma omp parallel for
-    for (int jc = use_jackknife ? 0 : num_chroms_used; jc <= num_chroms_used; jc++) {
+    for (int jc = use_jackknife_reps ? 0 : num_jacks; jc <= num_jacks; jc++) {
       const AlderResults &results = results_jackknife[jc];
       int bmin = 0;
       while (bmin < (int) results.d_Morgans.size()
@@ -597,37 +1569,48 @@ namespace ALD {
     return fits;
   }
 
-  vector <AlderResults> Alder::make_results(
-      const vector < vector < pair <double, double> > > &results_allchrom,
-      const vector <AffineData> &affine_data_allchrom, double binsize, bool use_naive_algo,
-      double fit_start_dis) {
-    
-    bool use_inter_chrom_affine = !use_naive_algo;
-    if (use_inter_chrom_affine) {
-      if (use_jackknife && num_chroms_used <= 2) {
+  bool Alder::inter_chrom_affine_ok(bool use_naive_algo, int num_chroms, bool verbose) {
+    if (use_naive_algo) return false;
+    if (use_jackknife && num_chroms <= 2) {
+      if (verbose) {
 	cout << "WARNING: fitting exponential + unconstrained affine (A * exp(-n*d) + C)" << endl;
 	cout << "need >= 3 chroms to use jackknife with inter-chrom affine terms" << endl << endl;
-	use_inter_chrom_affine = false;
       }
-      else if (num_chroms_used <= 1) {
+      return false;
+    }
+    if (num_chroms <= 1) {
+      if (verbose) {
 	cout << "WARNING: fitting exponential + unconstrained affine (A * exp(-n*d) + C)" << endl;
 	cout << "need >= 2 chroms to determine affine term from inter-chrom data" << endl << endl;
-	use_inter_chrom_affine = false;
       }
+      return false;
     }
-    int numbins = results_allchrom[0].size();
-    vector <AlderResults> results_jackknife(num_chroms_used+1);
-    for (int jc = 0; jc <= num_chroms_used; jc++) {
+    return true;
+  }
+
+  // chroms: indices of the chromosomes to use (results_allchrom entries for others are ignored);
+  // jackknife reps leave out each of these in turn
+  vector <AlderResults> Alder::make_results(
+      const vector < vector < pair <double, double> > > &results_allchrom,
+      const vector <AffineData> &affine_data_allchrom, double binsize, bool use_naive_algo,
+      double fit_start_dis, const vector <int> &chroms, bool verbose) {
+    
+    int num_chroms = chroms.size();
+    bool use_inter_chrom_affine = inter_chrom_affine_ok(use_naive_algo, num_chroms, verbose);
+    int numbins = results_allchrom[chroms[0]].size();
+    vector <AlderResults> results_jackknife(num_chroms+1);
+    for (int jc = 0; jc <= num_chroms; jc++) {
     	results_jackknife[jc].fit_start_dis = fit_start_dis;
-    	results_jackknife[jc].jack_id = jack_ind_ids[jc];
+    	results_jackknife[jc].jack_id = jc < num_chroms ? jack_ind_ids[chroms[jc]] : "none";
     	vector <double> &x = results_jackknife[jc].d_Morgans;
     	vector <double> &y = results_jackknife[jc].weighted_LD_avg;
     	vector <double> &count = results_jackknife[jc].bin_count;
     	x = y = count = vector <double> (numbins);
     	// set up the remove-one data
     	vector <AffineData> affdats_minus_jc;
-    	for (int c = 0; c < num_chroms_used; c++)
-    		if (c != jc) {
+    	for (int j = 0; j < num_chroms; j++)
+    		if (j != jc) {
+    			int c = chroms[j];
     			for (int b = 1; b < numbins; b++) {
     				x[b] = b * binsize;
     				y[b] += results_allchrom[c][b].first;
@@ -647,6 +1630,81 @@ namespace ALD {
     return results_jackknife;
   }
 
+  // results of a 2-ref run leaving out test indiv skip_indiv (see run_chrom; no jackknife reps)
+  AlderResults Alder::make_loo_results(const RunBins &bins, double fit_start_dis,
+				       int skip_indiv) {
+    bool use_inter_chrom_affine = inter_chrom_affine_ok(bins.use_naive_algo, bins.chroms.size(),
+							false);
+    int numbins = bins.results_allchrom[bins.chroms[0]].size();
+    AlderResults results;
+    results.fit_start_dis = fit_start_dis;
+    results.jack_id = "none";
+    vector <double> &x = results.d_Morgans, &y = results.weighted_LD_avg,
+      &count = results.bin_count;
+    x = y = count = vector <double> (numbins);
+    vector <AffineData> affdats;
+    for (int j = 0; j < (int) bins.chroms.size(); j++) {
+      int c = bins.chroms[j];
+      const vector <double> &delta = bins.affine_data_allchrom[c].loo_delta[skip_indiv];
+      for (int b = 1; b < numbins; b++) {
+	x[b] = b * bins.binsize;
+	y[b] += bins.results_allchrom[c][b].first - delta[b];
+	count[b] += bins.results_allchrom[c][b].second;
+      }
+      if (use_inter_chrom_affine)
+	affdats.push_back(bins.affine_data_allchrom[c]);
+    }
+    for (int b = 1; b < numbins; b++) y[b] /= count[b];
+    if (use_inter_chrom_affine) {
+      x.push_back(INFINITY);
+      pair <double, double> aff_tot_count = compute_inter_chrom_affine(affdats, skip_indiv);
+      y.push_back(aff_tot_count.first);
+      count.push_back(aff_tot_count.second);
+    }
+    return results;
+  }
+
+  // fits the curve leaving out each test indiv; influence = (n-1) (full fit - leave-one-out
+  // fit) of the decay rate (the sample jackknife pseudo-value less the full fit)
+  void Alder::report_sample_loo(const vector <int> &ref_inds, const RunBins &bins,
+				double fit_start_dis, double maxdis,
+				const vector <ExpFitALD> &fits_all_starts, int fit_test_ind) {
+    if (sample_loo_file == NULL || fits_all_starts.empty()) return;
+    for (int j = 0; j < (int) bins.chroms.size(); j++)
+      if (bins.affine_data_allchrom[bins.chroms[j]].loo_delta.empty()) {
+	cout << "sample_loo: per-sample contributions not available for this run" << endl << endl;
+	return;
+      }
+    int n = num_mixed_indivs;
+    string refs = ref_inds.size() == 2 ?
+      ref_pop_names[ref_inds[0]] + "-" + ref_pop_names[ref_inds[1]] : "weights";
+    double decay = fits_all_starts[fit_test_ind].get_var("decay").back();
+    double amp_exp = fits_all_starts[fit_test_ind].get_var("amp_exp").back();
+    vector <double> decay_loo(n), amp_exp_loo(n);
+#pragma omp parallel for
+    for (int i = 0; i < n; i++) {
+      ExpFitALD fit = exp_fit_jackknife(vector <AlderResults> (1, make_loo_results(bins,
+										  fit_start_dis,
+										  i)),
+					fit_start_dis, maxdis);
+      decay_loo[i] = fit.get_var("decay")[0];
+      amp_exp_loo[i] = fit.get_var("amp_exp")[0];
+    }
+    double mean = accumulate(decay_loo.begin(), decay_loo.end(), 0.0) / n, ss = 0;
+    int i_max = 0;
+    for (int i = 0; i < n; i++) {
+      ss += sq(decay_loo[i] - mean);
+      if (fabs(decay_loo[i] - decay) > fabs(decay_loo[i_max] - decay)) i_max = i;
+      fprintf(sample_loo_file, "%s\t%s\t%.4f\t%.4f\t%.8f\t%.8f\t%.4f\n", refs.c_str(),
+	      mixed_indiv_ids[i].c_str(), decay_loo[i], decay_loo[i] - decay, amp_exp_loo[i],
+	      amp_exp_loo[i] - amp_exp, (n-1) * (decay - decay_loo[i]));
+    }
+    fflush(sample_loo_file);
+    printf("leave-one-sample-out: decay jackknife std over test indivs %.2f;"
+	   " most influential %s (decay %.2f without it)\n\n", sqrt(ss * (n-1) / n),
+	   mixed_indiv_ids[i_max].c_str(), decay_loo[i_max]);
+  }
+
   vector <ExpFitALD> Alder::fit_results(const vector <AlderResults> &results_jackknife,
 				       double fit_start_dis, double maxdis, int &fit_test_ind) {
 
@@ -662,10 +1720,11 @@ namespace ALD {
     return fits_all_starts;
   }
 
-  void Alder::count_alleles(const char *geno, int stride, int s, double &a, double &b) {
+  void Alder::count_alleles(const char *const *rows, int stride, int s, double &a,
+			    double &b) {
     a = b = 0;
     for (int i = 0; i < stride; i++) {
-      int x = geno[s*stride+i];
+      int x = rows[s][i];
       if (x != 9) {
 	a += x;
 	b += 2-x;
@@ -673,16 +1732,18 @@ namespace ALD {
     }
   }
 
-  vector <double> Alder::compute_f2_jacks(const char *geno1, int stride1,
-					  const char *geno2, int stride2) {
+  vector <double> Alder::compute_f2_jacks(const char *const *rows1, int stride1,
+					  const char *const *rows2, int stride2) {
     // note: only use chromosomes specified at initialization!
     vector <double> f2_N_per_chrom(num_chroms_used), num_f2_per_chrom(num_chroms_used);
-    for (int c = 0; c < num_chroms_used; c++)
+    geno.start_pass();
+    for (int c = 0; c < num_chroms_used; c++) {
+      geno.acquire(c);
       for (int s = chrom_start_inds[c]; s < chrom_start_inds[c+1]; s++) {
 	if (snp_ignore[s]) continue;
 	double a1, b1, a2, b2;
-	count_alleles(geno1, stride1, s, a1, b1);
-	count_alleles(geno2, stride2, s, a2, b2);
+	count_alleles(rows1, stride1, s, a1, b1);
+	count_alleles(rows2, stride2, s, a2, b2);
 	if (a1+b1 <= 1 || a2+b2 <= 1) continue;
 	double p1 = a1/(a1+b1);
 	double N_bias1 = a1*b1/((a1+b1)*(a1+b1)*(a1+b1-1));
@@ -691,6 +1752,9 @@ namespace ALD {
 	f2_N_per_chrom[c] += ((p1-p2)*(p1-p2) - N_bias1 - N_bias2);
 	num_f2_per_chrom[c]++;
       }
+      geno.release(c);
+    }
+    geno.end_pass();
     vector <double> f2_jacks(num_chroms_used+1);
     for (int jc = 0; jc <= num_chroms_used; jc++) {
       double f2_N = 0, num_f2 = 0;
@@ -706,13 +1770,16 @@ namespace ALD {
 
   // public functions
 
-  Alder::Alder(char *_mixed_geno, int _num_mixed_indivs, const string &_mixed_pop_name,
-	     const vector <char *> &_ref_genos, const vector <int> &_num_ref_indivs,
-	     const vector <string> &_ref_pop_names, const vector < pair <int, double> > &snp_locs,
-	     Timer &_timer) :
-    mixed_geno(_mixed_geno), num_mixed_indivs(_num_mixed_indivs), mixed_pop_name(_mixed_pop_name),
-    ref_genos(_ref_genos), num_ref_indivs(_num_ref_indivs), ref_pop_names(_ref_pop_names),
-    timer(_timer) {
+  Alder::Alder(GenoStream &_geno, int _num_mixed_indivs, const string &_mixed_pop_name,
+	     const vector <int> &_num_ref_indivs, const vector <string> &_ref_pop_names,
+	     const vector < pair <int, double> > &snp_locs, Timer &_timer) :
+    geno(_geno), mixed_rows(_geno.mixed_rows), num_mixed_indivs(_num_mixed_indivs),
+    mixed_pop_name(_mixed_pop_name), ref_rows(_geno.ref_rows), num_ref_indivs(_num_ref_indivs),
+    ref_pop_names(_ref_pop_names), timer(_timer), anytime_max_secs(0), anytime_target_se(0),
+    anytime_num_runs(1),
+    polyache_sketches(0), auto_algo(false), chrom_algos_printed(false), fft_float_tol(0),
+    segmented_fft(false),
+    ref_ld_index(NULL), sample_loo_file(NULL), run_store(NULL) {
     
     int S = snp_locs.size();
     snp_chrom_ind_squash = snp_num_missing = snp_sum = snp_sum2 = snp_bin = vector <int> (S);
@@ -721,7 +1788,6 @@ namespace ALD {
 
     // set up snp tables
     // set up chromosome number remap: squash to 0, 1, 2, ...
-    int mixed_geno_ind = 0;
     for (int s = 0; s < S; s++) {
       if (s > 0 && snp_locs[s] < snp_locs[s-1]) fatalx("snps must be sorted (error at %d)\n", s);
       if (s == 0 || snp_locs[s].first != snp_locs[s-1].first) { // new chromosome
@@ -730,15 +1796,6 @@ namespace ALD {
       }	
       snp_chrom_ind_squash[s] = jack_ind_ids.size()-1;
       snp_pos[s] = snp_locs[s].second;
-      for (int i = 0; i < num_mixed_indivs; i++) {
-	int gtype = mixed_geno[mixed_geno_ind++];
-	if (gtype == 9)
-	  snp_num_missing[s]++;
-	else {
-	  snp_sum[s] += gtype;
-	  snp_sum2[s] += gtype*gtype;
-	}
-      }
     }
     chrom_start_inds.push_back(S);
     num_chroms_used = jack_ind_ids.size();
@@ -747,12 +1804,236 @@ namespace ALD {
 
     if (num_chroms_used == 0) fatalx("no chromosomes with data\n");
     use_jackknife = num_chroms_used > 1;
+    chrom_fft_float_err = vector <double> (num_chroms_used, -1);
+    chrom_fft_segment = vector <int> (num_chroms_used);
+
+    // genotype blocks are chroms; in streaming mode, up to one chrom per thread plus one being
+    // prefetched are loaded at a time
+    geno.set_blocks(chrom_start_inds, omp_get_max_threads() + 1);
+
+    // test pop genotype sums and sparse genotype store
+    int n = num_mixed_indivs;
+    snp_sparse_geno = vector <signed char> (S, -1);
+    indiv_sparse_snps = vector < vector <int> > (n);
+    sparse_start.push_back(0);
+    geno.start_pass();
+    for (int c = 0; c < num_chroms_used; c++) {
+      geno.acquire(c);
+      for (int s = chrom_start_inds[c]; s < chrom_start_inds[c+1]; s++) {
+	const char *row = mixed_rows[s];
+	for (int i = 0; i < n; i++) {
+	  int gtype = row[i];
+	  if (gtype == 9)
+	    snp_num_missing[s]++;
+	  else {
+	    snp_sum[s] += gtype;
+	    snp_sum2[s] += gtype*gtype;
+	  }
+	}
+	int num_0 = std::count(row, row+n, 0), num_2 = std::count(row, row+n, 2);
+	int def = num_2 > num_0 ? 2 : 0;
+	if (n - max(num_0, num_2) <= SPARSE_MAX_FRAC * n) {
+	  snp_sparse_geno[s] = def;
+	  for (int i = 0; i < n; i++)
+	    if (row[i] != def) {
+	      sparse_indivs.push_back(i);
+	      indiv_sparse_snps[i].push_back(s);
+	    }
+	}
+	else
+	  dense_snps.push_back(s);
+	sparse_start.push_back(sparse_indivs.size());
+      }
+      geno.release(c);
+    }
+    geno.end_pass();
   }
   
   int Alder::get_num_chroms_used(void) {
     return num_chroms_used;
   }
 
+  void Alder::set_anytime(double max_secs, double target_decay_se) {
+    anytime_max_secs = max_secs;
+    anytime_target_se = target_decay_se;
+  }
+
+  void Alder::set_anytime_num_runs(int num_runs) {
+    anytime_num_runs = max(num_runs, 1);
+  }
+
+  void Alder::set_auto_algo(bool _auto_algo) {
+    auto_algo = _auto_algo;
+  }
+
+  void Alder::set_fft_float(double tol) {
+    fft_float_tol = tol;
+  }
+
+  void Alder::set_segmented_fft(bool _segmented_fft) {
+    segmented_fft = _segmented_fft;
+  }
+
+  void Alder::set_extra_binsizes(const vector <double> &binsizes) {
+    extra_binsizes = binsizes;
+  }
+
+  void Alder::set_sample_loo(const char *filename, const vector <string> &indiv_ids) {
+    sample_loo_file = fopen(filename, "w");
+    if (sample_loo_file == NULL) fatalx("unable to open sample_loo file: %s\n", filename);
+    mixed_indiv_ids = indiv_ids;
+    fprintf(sample_loo_file, "refs\tindiv\tdecay_loo\tdecay_diff\tamp_exp_loo\tamp_exp_diff\t"
+	    "influence\n");
+  }
+
+  void Alder::close_sample_loo(void) {
+    if (sample_loo_file == NULL) return;
+    fclose(sample_loo_file);
+    sample_loo_file = NULL;
+  }
+
+  void Alder::set_polyache_sketches(int num_sketches) {
+    polyache_sketches = num_sketches;
+    sketch_signs = vector < vector <int> > (num_sketches, vector <int> (num_mixed_indivs));
+    unsigned int x = SKETCH_SEED; // fixed seed: same sketches for every chrom and run
+    for (int k = 0; k < num_sketches; k++)
+      for (int i = 0; i < num_mixed_indivs; i++) {
+	x = x * 1103515245U + 12345U;
+	sketch_signs[k][i] = (x >> 30) & 1 ? 1 : -1;
+      }
+  }
+
+  void Alder::build_ref_ld_index(const char *filename) {
+    cout << "Building ref LD index " << filename << " (snp pairs within "
+	 << 100*MAX_LD_CORR_DIST << " cM)" << endl;
+    RefLdIndex index;
+    vector <int> chroms(snp_pos.size());
+    for (int s = 0; s < (int) snp_pos.size(); s++)
+      chroms[s] = atoi(jack_ind_ids[snp_chrom_ind_squash[s]].c_str());
+    index.set_snps(chroms, snp_pos, MAX_LD_CORR_DIST);
+    int R = ref_rows.size();
+    index.refs = vector <RefLdIndex::Ref> (R);
+    for (int r = 0; r < R; r++) {
+      index.refs[r].name = ref_pop_names[r];
+      index.refs[r].num_indivs = num_ref_indivs[r];
+      index.refs[r].snp_sum = index.refs[r].snp_missing = vector <int> (snp_pos.size());
+    }
+    long num_pairs = index.row_start.back();
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL) fatalx("unable to open ref LD index for writing: %s\n", filename);
+    index.write_header(f); // (fixed size; rewritten with the per-snp sums at the end)
+
+    // per-snp sums (for checking the data of later runs) and the blocks, one ref at a time
+    vector <short> block(2 * num_pairs);
+    long num_clipped = 0;
+    for (int r = 0; r < R; r++) {
+      cout << "  " << ref_pop_names[r] << ": chrom";
+      const char *const *rows = &ref_rows[r][0];
+      int stride = num_ref_indivs[r];
+      geno.start_pass();
+#pragma omp parallel for schedule(static,1) reduction(+:num_clipped)
+      for (int c = 0; c < num_chroms_used; c++) {
+#pragma omp critical
+	cout << " " << jack_ind_ids[c] << flush;
+	geno.acquire(c);
+	for (int s1 = chrom_start_inds[c]; s1 < chrom_start_inds[c+1]; s1++) {
+	  for (int i = 0; i < stride; i++) {
+	    if (rows[s1][i] == 9) index.refs[r].snp_missing[s1]++;
+	    else index.refs[r].snp_sum[s1] += rows[s1][i];
+	  }
+	  short *row = &block[2 * index.row_start[s1]];
+	  for (int s2 = s1+1; s2 < s1+1 + index.row_start[s1+1]-index.row_start[s1]; s2++) {
+	    *row++ = RefLdIndex::quantize(compute_ld(s1, s2, rows, stride), RefLdIndex::D_SCALE,
+					  num_clipped);
+	    *row++ = RefLdIndex::quantize(compute_polyache_central_moment11sq(s1, s2, rows,
+									      stride),
+					  RefLdIndex::D2_SCALE, num_clipped);
+	  }
+	}
+	geno.release(c);
+      }
+      geno.end_pass();
+      cout << endl;
+      RefLdIndex::write_block(f, block);
+    }
+    rewind(f);
+    index.write_header(f);
+    if (fclose(f) != 0) fatalx("error writing ref LD index: %s\n", filename);
+    printf("%ld snp pairs per ref; %ld value(s) clipped to the quantization range\n",
+	   num_pairs, num_clipped);
+    cout << endl << "==> Time to build ref LD index: " << timer.update_time() << endl << endl;
+  }
+
+  void Alder::use_ref_ld_index(const RefLdIndex &index) {
+    ref_ld_index = NULL;
+    ref_ld_blocks = vector <const short *> (ref_rows.size(), (const short *) NULL);
+    if (index.max_ld_dist < MAX_LD_CORR_DIST) {
+      cout << "ref LD index covers too short a range; not used" << endl << endl;
+      return;
+    }
+    // map snps to index snps by chrom and position (snps at the same position in order)
+    map < pair <int, double>, int > index_snps;
+    for (int i = 0; i < (int) index.snp_pos.size(); i++)
+      index_snps.insert(make_pair(make_pair(index.snp_chroms[i], index.snp_pos[i]), i));
+    snp_ld_index = vector <int> (snp_pos.size());
+    for (int s = 0; s < (int) snp_pos.size(); s++) {
+      pair <int, double> loc(atoi(jack_ind_ids[snp_chrom_ind_squash[s]].c_str()), snp_pos[s]);
+      map < pair <int, double>, int >::iterator it = index_snps.find(loc);
+      int i = it == index_snps.end() ? -1 : it->second;
+      if (s > 0 && snp_chrom_ind_squash[s] == snp_chrom_ind_squash[s-1] &&
+	  snp_pos[s] == snp_pos[s-1])
+	i = snp_ld_index[s-1]+1;
+      if (i == -1 || i >= (int) index.snp_pos.size() ||
+	  make_pair(index.snp_chroms[i], index.snp_pos[i]) != loc) {
+	cout << "ref LD index lacks snps of this run; not used" << endl << endl;
+	return;
+      }
+      snp_ld_index[s] = i;
+    }
+    // use the index for refs with the same genotype sums at these snps
+    vector <int> index_ref(ref_rows.size());
+    vector <char> same_data(ref_rows.size(), 1);
+    for (int r = 0; r < (int) ref_rows.size(); r++) {
+      index_ref[r] = index.find_ref(ref_pop_names[r]);
+      if (index_ref[r] == -1 || index.refs[index_ref[r]].num_indivs != num_ref_indivs[r])
+	same_data[r] = 0;
+    }
+    geno.start_pass();
+    for (int c = 0; c < num_chroms_used; c++) {
+      geno.acquire(c);
+      for (int r = 0; r < (int) ref_rows.size(); r++) {
+	if (!same_data[r]) continue;
+	const RefLdIndex::Ref &iref = index.refs[index_ref[r]];
+	for (int s = chrom_start_inds[c]; s < chrom_start_inds[c+1] && same_data[r]; s++) {
+	  int sum = 0, missing = 0;
+	  for (int i = 0; i < num_ref_indivs[r]; i++) {
+	    if (ref_rows[r][s][i] == 9) missing++;
+	    else sum += ref_rows[r][s][i];
+	  }
+	  same_data[r] = sum == iref.snp_sum[snp_ld_index[s]] &&
+	    missing == iref.snp_missing[snp_ld_index[s]];
+	}
+      }
+      geno.release(c);
+    }
+    geno.end_pass();
+    ref_ld_index = &index;
+    cout << "ref LD index: used for ref pops";
+    for (int r = 0; r < (int) ref_rows.size(); r++)
+      if (same_data[r]) {
+	ref_ld_blocks[r] = index.ref_block(index_ref[r]);
+	cout << " " << ref_pop_names[r];
+      }
+    cout << endl;
+    if (count(same_data.begin(), same_data.end(), 0)) {
+      cout << "  (computed from genotypes, not in the index or with other data:";
+      for (int r = 0; r < (int) ref_rows.size(); r++)
+	if (!same_data[r]) cout << " " << ref_pop_names[r];
+      cout << ")" << endl;
+    }
+    cout << endl;
+  }
+
   vector <double> Alder::find_ld_corr_stops(double binsize0, bool use_early_exit, double mindis) {
     cout << "     *** Determining extent of correlated LD between test and ref pops ***" << endl;
     cout << endl;
@@ -764,118 +2045,285 @@ namespace ALD {
       return vector <double> (ref_pop_names.size(), mindis);
     }
 
-    if (ref_genos.empty()) {
+    if (ref_rows.empty()) {
       cout << "WARNING: can't check LD corr; need reference genos (not just weights)" << endl;
       cout << "decay curves will be fit starting at the default min distance: "
 	   << 100*AlderParams::DEFAULT_FIT_START << " cM" << endl << endl;
       return vector <double> (1, AlderParams::DEFAULT_FIT_START);
     }
     vector <double> ld_corr_stops(ref_pop_names.size(), INFINITY);
+    vector < vector <string> > level_logs(ref_pop_names.size());
+    for (int r = 0; r < (int) ref_pop_names.size(); r++)
+      ld_corr_stops[r] = find_ld_corr_stop(r, binsize0, use_early_exit, level_logs[r]);
+    for (int level = 0; level < (int) level_logs[0].size(); level++)
+      for (int r = 0; r < (int) ref_pop_names.size(); r++)
+	cout << level_logs[r][level];
+
+    return summarize_ld_corr_stops(ld_corr_stops);
+  }
+
+  double Alder::find_ld_corr_stop(int r, double binsize0, bool use_early_exit,
+				  vector <string> &level_logs) {
+    double ld_corr_stop = INFINITY;
+    // terms of bins computed so far, by level (binsize = binsize0 * 2^level): bins at later
+    // levels are merged from these when possible (only bins over all snp pairs can be merged,
+    // so with use_early_exit this rarely applies)
+    vector < map <int, LdCorrBin> > cache;
 
     double binsize = binsize0;
+    int level = 0;
     const double binsize1 = 0.002;
     do {
       const int min_bin = 1;
-      const double max_ld_dist = 0.02;
-      const int numbins = max_ld_dist / binsize;
-      for (int r = 0; r < (int) ref_pop_names.size(); r++) {
-	cout << "Checking LD correlation of test pop " << mixed_pop_name << " with ref pop "
-	     << ref_pop_names[r] << endl;
-	cout << "  binsize: " << (100*binsize) << " cM" << endl;
-	cout << "  (distances are rounded down to bins; bin starting at 0 is skipped)" << endl
-	     << endl;
-      
-	bool compute_corr_data = true, compute_polyache_data = !use_early_exit;
-	if (!compute_polyache_data)
-	  printf("%6s%20s", "d (cM)", "LD corr (scaled)");
-	else
-	  printf("%6s%20s%12s%12s", "d (cM)", "unbiased LD corr", "RMS(D) test",
-		 "RMS(D) ref");
-	printf("%12s\n", "bin count");
-
-	int num_significance_failures = 0;
-	for (int b = min_bin; b < numbins; b++) {
-	  CorrJack corr_data(num_chroms_used, jack_ind_ids),
-	    test_data(num_chroms_used, jack_ind_ids), ref_data(num_chroms_used, jack_ind_ids);
-	  compute_ld_corr_terms(r, b*binsize, (b+1)*binsize, corr_data, test_data, ref_data,
-				use_early_exit, compute_corr_data, compute_polyache_data);
-	  pair <double, double> corr_mean_std = compute_polyache_data ?
-	    corr_data.jackknife_cos_polyache_denom(test_data, ref_data) :
-	    corr_data.jackknife_corr();
-
-	  // output bin, corr
-	  printf("%6.3f%20s", 100*b*binsize, format_mean_std(corr_mean_std).c_str());
-	  if (compute_polyache_data) {
-	    // output unbiased LD in test, ref
-	    printf("%12.5f%12.5f",
-		   test_data.tot_sum_x2() / test_data.tot_count(),
-		   ref_data.tot_sum_x2() / ref_data.tot_count());
-	  }
-	  // output count (same full count for all), newline
-	  printf("%12d", (int) corr_data.tot_count());
+      const int numbins = MAX_LD_CORR_DIST / binsize;
+      string log;
+      log += str_printf("Checking LD correlation of test pop %s with ref pop %s\n",
+			mixed_pop_name.c_str(), ref_pop_names[r].c_str());
+      log += str_printf("  binsize: %g cM\n", 100*binsize);
+      log += "  (distances are rounded down to bins; bin starting at 0 is skipped)\n\n";
+
+      bool compute_corr_data = true, compute_polyache_data = !use_early_exit;
+      if (!compute_polyache_data)
+	log += str_printf("%6s%20s", "d (cM)", "LD corr (scaled)");
+      else
+	log += str_printf("%6s%20s%12s%12s", "d (cM)", "unbiased LD corr", "RMS(D) test",
+			  "RMS(D) ref");
+      log += str_printf("%12s\n", "bin count");
+
+      int num_significance_failures = 0;
+      cache.push_back(map <int, LdCorrBin> ());
+      for (int b = min_bin; b < numbins; b++) {
+	LdCorrBin bin(num_chroms_used, jack_ind_ids);
+	CorrJack &corr_data = bin.corr_data, &test_data = bin.test_data,
+	  &ref_data = bin.ref_data;
+	if (!aggregate_ld_corr_bin(cache, level, b, compute_corr_data, compute_polyache_data,
+				   bin)) {
+	  bool complete = compute_ld_corr_terms(r, b*binsize, (b+1)*binsize, corr_data,
+						test_data, ref_data, use_early_exit,
+						compute_corr_data, compute_polyache_data);
+	  bin.has_corr = complete && compute_corr_data;
+	  bin.has_polyache = complete && compute_polyache_data;
+	  cache[level].insert(make_pair(b, bin));
+	}
+	pair <double, double> corr_mean_std = compute_polyache_data ?
+	  corr_data.jackknife_cos_polyache_denom(test_data, ref_data) :
+	  corr_data.jackknife_corr();
+
+	// output bin, corr
+	log += str_printf("%6.3f%20s", 100*b*binsize, format_mean_std(corr_mean_std).c_str());
+	if (compute_polyache_data) {
+	  // output unbiased LD in test, ref
+	  log += str_printf("%12.5f%12.5f",
+			    test_data.tot_sum_x2() / test_data.tot_count(),
+			    ref_data.tot_sum_x2() / ref_data.tot_count());
+	}
+	// output count (same full count for all), newline
+	log += str_printf("%12d", (int) corr_data.tot_count());
 	
-	  if (erfc(corr_mean_std.first/corr_mean_std.second/sqrt(2.0)) > LD_COS_SIGNIF_THRESH ||
-	      !(corr_mean_std.first > 0)) { // the latter check takes care of NAN and unknown std
-	    num_significance_failures++;
-	    if (use_early_exit)
-	      cout << "   losing significance (" << num_significance_failures << ")";
-	    if (num_significance_failures == LIM_SIGNIFICANCE_FAILURES) {
-	      if (ld_corr_stops[r] == INFINITY || b*binsize > ld_corr_stops[r])
-		ld_corr_stops[r] = b*binsize; // store as answer
-	      if (use_early_exit) {
-		printf("\n");
-		cout << "lost significance; computing bias-corrected LD corr polyache" << endl;
-		compute_corr_data = false; compute_polyache_data = true;
-		compute_ld_corr_terms(r, b*binsize, (b+1)*binsize, corr_data, test_data, ref_data,
-				      use_early_exit, compute_corr_data, compute_polyache_data);
-		pair <double, double> cos_polyache_mean_std =
-		  corr_data.jackknife_cos_polyache_denom(test_data, ref_data);
-
-		printf("%6.3f%20s", 100*b*binsize, format_mean_std(cos_polyache_mean_std).c_str());
-		printf("   <-- approx bias-corrected LD corr\n");
-		/*
-		  printf("SNP pairs used: %d (LD prod), %d (LD test), %d (LD ref)\n",
-		  corr_data.tot_count(), test_data.tot_count(), ref_data.tot_count());
-		*/
-		break;
-	      }
+	if (erfc(corr_mean_std.first/corr_mean_std.second/sqrt(2.0)) > LD_COS_SIGNIF_THRESH ||
+	    !(corr_mean_std.first > 0)) { // the latter check takes care of NAN and unknown std
+	  num_significance_failures++;
+	  if (use_early_exit)
+	    log += str_printf("   losing significance (%d)", num_significance_failures);
+	  if (num_significance_failures == LIM_SIGNIFICANCE_FAILURES) {
+	    if (ld_corr_stop == INFINITY || b*binsize > ld_corr_stop)
+	      ld_corr_stop = b*binsize; // store as answer
+	    if (use_early_exit) {
+	      log += "\nlost significance; computing bias-corrected LD corr polyache\n";
+	      compute_corr_data = false; compute_polyache_data = true;
+	      compute_ld_corr_terms(r, b*binsize, (b+1)*binsize, corr_data, test_data, ref_data,
+				    use_early_exit, compute_corr_data, compute_polyache_data);
+	      pair <double, double> cos_polyache_mean_std =
+		corr_data.jackknife_cos_polyache_denom(test_data, ref_data);
+
+	      log += str_printf("%6.3f%20s", 100*b*binsize,
+				format_mean_std(cos_polyache_mean_std).c_str());
+	      log += "   <-- approx bias-corrected LD corr\n";
+	      /*
+		printf("SNP pairs used: %d (LD prod), %d (LD test), %d (LD ref)\n",
+		corr_data.tot_count(), test_data.tot_count(), ref_data.tot_count());
+	      */
+	      break;
 	    }
 	  }
-	  printf("\n");
 	}
-	cout << endl;
+	log += "\n";
       }
+      log += "\n";
+      level_logs.push_back(log);
       binsize *= 2;
+      level++;
     } while (binsize < binsize1);
+    return ld_corr_stop;
+  }
+
+  double Alder::ld_corr_fit_start(double ld_corr_stop) {
+    return ld_corr_stop < AlderParams::DEFAULT_FIT_START ? AlderParams::DEFAULT_FIT_START
+      : ld_corr_stop;
+  }
 
+  vector <double> Alder::summarize_ld_corr_stops(const vector <double> &ld_corr_stops) {
+    vector <double> fit_starts(ld_corr_stops.size());
     printhline();
     cout << "                 *** Summary of LD correlation results ***" << endl << endl;
     cout << "Decay curves will be fit starting at the folliowing min distances (cM):" << endl;
     cout << "  (to override, specify the 'mindis' parameter)" << endl << endl;
     for (int r = 0; r < (int) ref_pop_names.size(); r++) {
       printf("%20s%8.3f", ref_pop_names[r].c_str(), 100*ld_corr_stops[r]);
-      if (ld_corr_stops[r] < AlderParams::DEFAULT_FIT_START) {
+      fit_starts[r] = ld_corr_fit_start(ld_corr_stops[r]);
+      if (fit_starts[r] != ld_corr_stops[r])
 	printf(" --> replacing with default min %.3f", 100*AlderParams::DEFAULT_FIT_START);
-	ld_corr_stops[r] = AlderParams::DEFAULT_FIT_START;
-      }
-      if (ld_corr_stops[r] == INFINITY)
+      if (fit_starts[r] == INFINITY)
 	printf(" --> long-range LD corr with %s!", mixed_pop_name.c_str());
       printf("\n");
     }
     cout << endl << "==> Time to calculate LD correlation: " << timer.update_time()
 	 << endl << endl;
-    return ld_corr_stops;
+    return fit_starts;
   }
 
-  // computes weighted LD on each chromosome; returns vector of results from jackknife runs
-  // fit data is stored in fits_all_starts
-  // ref_inds tells which ref pops are being used, just for the purpose of output
-  //   (might be empty in the case of external weights)
-  vector <AlderResults> Alder::run(
-      int num_refs, const vector <int> &ref_inds, const vector <double> &weights, double maxdis,
-      double binsize, int mincount, bool use_naive_algo, double fit_start_dis,
-      vector <ExpFitALD> &fits_all_starts, int &fit_test_ind) {
+  void Alder::prepare_fused_test(const vector <double> &wA, const vector <double> &wB,
+				 double maxdis, double binsize, int mincount, bool use_naive_algo) {
+    fused_runs.clear();
+    if (use_naive_algo || auto_algo || fft_float_tol > 0 || anytime_max_secs > 0 ||
+	anytime_target_se > 0) {
+      cout << "fused admixture test: not available with naive, auto_algo, anytime or fft_float;"
+	   << " computing curves separately" << endl << endl;
+      return;
+    }
+    if (num_mixed_indivs < 4) return; // 1-ref runs not possible
+
+    int numbins = maxdis / binsize;
+    fused_runs = vector <FusedRun> (3);
+    for (int k = 0; k < 3; k++) {
+      FusedRun &fused = fused_runs[k];
+      fused.num_refs = k == 0 ? 2 : 1;
+      fused.binsize = binsize;
+      fused.numbins = numbins;
+      fused.mincount = mincount;
+      fused.has_chrom = vector <char> (num_chroms_used);
+      fused.results_allchrom = vector < vector < pair <double, double> > > (num_chroms_used);
+      fused.affine_data_allchrom = vector <AffineData> (num_chroms_used);
+    }
+    fused_runs[0].weights = vector <double> (wA.size());
+    for (int s = 0; s < (int) wA.size(); s++)
+      fused_runs[0].weights[s] = wA[s] - wB[s];
+    fused_runs[1].weights = wA;
+    fused_runs[2].weights = wB;
+
+    set_snp_tables(1, wA, binsize, mincount);
+    vector <int> chroms;
+    for (int c = 0; c < num_chroms_used; c++)
+      if (chrom_fused_eligible(c, wA, wB, mincount))
+	chroms.push_back(c);
+    if (chroms.empty()) {
+      cout << "fused admixture test: all chroms have missing data at the snps used;"
+	   << " computing curves separately" << endl << endl;
+      fused_runs.clear();
+      return;
+    }
+
+    cout << "fused admixture test: computing 2-ref and 1-ref weighted LD on chrom";
+    geno.start_pass(chroms);
+#pragma omp parallel for schedule(static,1)
+    for (int j = 0; j < (int) chroms.size(); j++) {
+      int c = chroms[j];
+#pragma omp critical
+      cout << " " << jack_ind_ids[c] << flush;
+      vector < vector < pair <double, double> > > chrom_results;
+      vector <AffineData> affine_data;
+      geno.acquire(c);
+      run_chrom_fused(c, wA, wB, binsize, numbins, chrom_results, affine_data);
+      geno.release(c);
+      for (int k = 0; k < 3; k++) {
+	fused_runs[k].results_allchrom[c] = chrom_results[k];
+	fused_runs[k].affine_data_allchrom[c] = affine_data[k];
+	fused_runs[k].has_chrom[c] = 1;
+      }
+    }
+    geno.end_pass();
+    cout << endl;
+    printf("(%d of %d chroms; the others have missing data or snps without weights in one run)\n",
+	   (int) chroms.size(), num_chroms_used);
+    cout << endl << "==> Time to run fused admixture test: " << timer.update_time() << endl
+	 << endl;
+  }
+
+  void Alder::prepare_binned_runs(const vector < vector <double> > &weight_sets,
+				  double binsize, int mincount, bool use_naive_algo) {
+    binned_runs.clear();
+    if (use_naive_algo || auto_algo || fft_float_tol > 0 || anytime_max_secs > 0 ||
+	anytime_target_se > 0) {
+      cout << "bin-aggregated ingestion: not available with naive, auto_algo, anytime or"
+	   << " fft_float; reading genotypes in each run" << endl << endl;
+      return;
+    }
+    for (int w = 0; w < (int) weight_sets.size(); w++) {
+      const vector <double> &weights = weight_sets[w];
+      int k = 0;
+      while (k < (int) binned_runs.size() &&
+	     memcmp(&binned_runs[k].weights[0], &weights[0], sizeof(double)*weights.size()) != 0)
+	k++;
+      if (k == (int) binned_runs.size()) {
+	binned_runs.push_back(BinnedRun());
+	binned_runs[k].weights = weights;
+	binned_runs[k].binsize = binsize;
+	binned_runs[k].mincount = mincount;
+	binned_runs[k].uses = 0;
+	binned_runs[k].fx = binned_runs[k].gy = vector < vector <double> > (num_chroms_used);
+      }
+      binned_runs[k].uses++;
+    }
+
+    // snps are ignored per run where weights are missing (SkipNanWeight), so all runs can
+    // share the weight-independent part of the snp tables
+    set_snp_tables(2, vector <double> (snp_pos.size(), 0.0), binsize, mincount);
+    int n = num_mixed_indivs;
+    cout << "bin-aggregated ingestion: " << binned_runs.size()
+	 << " set(s) of 2-ref weights; scanning chrom";
+    geno.start_pass();
+#pragma omp parallel for schedule(static,1)
+    for (int c = 0; c < num_chroms_used; c++) {
+#pragma omp critical
+      cout << " " << jack_ind_ids[c] << flush;
+      int snp_start = chrom_start_inds[c], snp_end = chrom_start_inds[c+1];
+      int numbins_chrom = (snp_pos[snp_end-1] - snp_pos[snp_start]) / binsize + 1;
+      vector <double> fx_base(numbins_chrom), gy_base(numbins_chrom);
+      geno.acquire(c);
+      for (int k = 0; k < (int) binned_runs.size(); k++) {
+	BinnedRun &binned = binned_runs[k];
+	const double *w = &binned.weights[0];
+	SkipNanWeight <TwoRefFx> fx_term(TwoRefFx(w, &snp_num_missing[0]), w);
+	SkipNanWeight <TwoRefGy> gy_term(TwoRefGy(w, &snp_num_missing[0], &snp_sum[0], n), w);
+	fill(fx_base.begin(), fx_base.end(), 0.0);
+	fill(gy_base.begin(), gy_base.end(), 0.0);
+	scatter_default(c, fx_term, &fx_base[0]);
+	scatter_default(c, gy_term, &gy_base[0]);
+	binned.fx[c] = binned.gy[c] = vector <double> ((long) n * numbins_chrom);
+	for (int i = 0; i < n; i++) {
+	  long off = (long) i * numbins_chrom;
+	  scatter_indiv(c, i, fx_term, &fx_base[0], &binned.fx[c][off], gy_term, &gy_base[0],
+			&binned.gy[c][off], numbins_chrom);
+	}
+      }
+      geno.release(c);
+    }
+    geno.end_pass();
+    cout << endl << endl << "==> Time to ingest bin sums: " << timer.update_time() << endl
+	 << endl;
+  }
 
+  double Alder::binned_run_bytes(double binsize) const {
+    double bins = 0;
+    for (int c = 0; c < num_chroms_used; c++) {
+      int snp_start = chrom_start_inds[c], snp_end = chrom_start_inds[c+1];
+      bins += (int) ((snp_pos[snp_end-1] - snp_pos[snp_start]) / binsize) + 1;
+    }
+    return 2 * sizeof(double) * bins * num_mixed_indivs;
+  }
+
+  void Alder::print_run_header(int num_refs, const vector <int> &ref_inds, int mincount,
+			       bool use_naive_algo) {
     cout << "   *** Computing " << num_refs << "-ref weighted LD with weights";
     if (ref_inds.empty())
       cout << " from file";
@@ -887,6 +2335,18 @@ namespace ALD {
     if (use_naive_algo)
       printf("using naive pairwise algorithm (on all snps with >= %d non-missing values)\n",
 	     mincount);
+  }
+
+  // computes weighted LD on each chromosome; returns vector of results from jackknife runs
+  // fit data is stored in fits_all_starts
+  // ref_inds tells which ref pops are being used, just for the purpose of output
+  //   (might be empty in the case of external weights)
+  vector <AlderResults> Alder::run(
+      int num_refs, const vector <int> &ref_inds, const vector <double> &weights, double maxdis,
+      double binsize, int mincount, bool use_naive_algo, double fit_start_dis,
+      vector <ExpFitALD> &fits_all_starts, int &fit_test_ind) {
+
+    print_run_header(num_refs, ref_inds, mincount, use_naive_algo);
     if (num_refs == 1 && num_mixed_indivs < 4)
       fatalx("need at least 4 indivs in test pop to compute single-ref LD (polyache)\n");
 
@@ -895,39 +2355,727 @@ namespace ALD {
     vector < vector < pair <double, double> > > results_allchrom(num_chroms_used);
     vector <AffineData> affine_data_allchrom(num_chroms_used);
 
-    // set up snp_bin and snp_ignore tables
-    // polyache requires no missing
-    int maxmissing = num_refs == 2 ? num_mixed_indivs - mincount : 0;
-    for (int s = 0; s < (int) snp_pos.size(); s++) {
-      snp_bin[s] = (snp_pos[s] - snp_pos[chrom_start_inds[snp_chrom_ind_squash[s]]]) / binsize;
-      snp_ignore[s] = snp_num_missing[s] > maxmissing || isnan(weights[s]);
+    set_snp_tables(num_refs, weights, binsize, mincount);
+    chrom_use_pairwise = vector <char> (num_chroms_used);
+    chrom_fft_float_err = vector <double> (num_chroms_used, -1);
+    chrom_fft_segment = vector <int> (num_chroms_used);
+    if (auto_algo && !use_naive_algo && !(num_refs == 1 && polyache_sketches))
+      select_chrom_algos(num_refs, weights, numbins, mincount);
+
+    // results computed ahead by prepare_fused_test
+    int fused_ind = -1;
+    for (int k = 0; k < (int) fused_runs.size(); k++) {
+      const FusedRun &fused = fused_runs[k];
+      if (fused.num_refs == num_refs && fused.binsize == binsize && fused.numbins == numbins &&
+	  fused.mincount == mincount && !use_naive_algo && fused.weights.size() == weights.size()
+	  && memcmp(&fused.weights[0], &weights[0], sizeof(double)*weights.size()) == 0)
+	fused_ind = k;
+    }
+    // bin sums ingested ahead by prepare_binned_runs (2-ref)
+    int binned_ind = -1;
+    for (int k = 0; k < (int) binned_runs.size(); k++) {
+      const BinnedRun &binned = binned_runs[k];
+      if (num_refs == 2 && binned.binsize == binsize && binned.mincount == mincount &&
+	  !use_naive_algo && binned.weights.size() == weights.size()
+	  && memcmp(&binned.weights[0], &weights[0], sizeof(double)*weights.size()) == 0)
+	binned_ind = k;
     }
 
-    // run computation on each chromosome
-    cout << "analyzing chrom";
+    // curve stored by an earlier run (see open_run_store)
+    RunBins stored;
+    bool from_store = read_stored_run(num_refs, weights, binsize, numbins, mincount,
+				      use_naive_algo, stored);
+
+    vector <int> chroms;
+    if (from_store) {
+      results_allchrom = stored.results_allchrom;
+      affine_data_allchrom = stored.affine_data_allchrom;
+      chroms = stored.chroms;
+      cout << "(from the run store; no genotype pass)" << endl;
+      if (binned_ind != -1 && --binned_runs[binned_ind].uses == 0)
+	binned_runs.erase(binned_runs.begin() + binned_ind);
+    }
+    else if (anytime_max_secs > 0 || anytime_target_se > 0)
+      chroms = run_chroms_anytime(num_refs, weights, binsize, numbins, mincount, use_naive_algo,
+				  fit_start_dis, maxdis, results_allchrom, affine_data_allchrom);
+    else {
+      // run computation on each chromosome
+      vector <int> pass_chroms;
+      for (int c = 0; c < num_chroms_used; c++)
+	if ((fused_ind == -1 || !fused_runs[fused_ind].has_chrom[c]) && binned_ind == -1)
+	  pass_chroms.push_back(c);
+      geno.start_pass(pass_chroms);
+      cout << "analyzing chrom";
 #pragma omp parallel for schedule(static,1)
-    for (int c = 0; c < num_chroms_used; c++) {
+      for (int c = 0; c < num_chroms_used; c++) {
 #pragma omp critical
-      cout << " " << jack_ind_ids[c] << flush;
-      AffineData affine_data;
-      vector < pair <double, double> > chrom_results = use_naive_algo ?
-	run_chrom_naive(c, num_refs, weights, binsize, numbins, mincount) :
-	run_chrom(c, num_refs, weights, binsize, numbins, mincount, affine_data);
-      affine_data_allchrom[c] = affine_data;
-      results_allchrom[c] = chrom_results;
+	cout << " " << jack_ind_ids[c] << flush;
+	if (fused_ind != -1 && fused_runs[fused_ind].has_chrom[c]) {
+	  affine_data_allchrom[c] = fused_runs[fused_ind].affine_data_allchrom[c];
+	  results_allchrom[c] = fused_runs[fused_ind].results_allchrom[c];
+	  continue;
+	}
+	AffineData affine_data;
+	vector < pair <double, double> > chrom_results = binned_ind != -1 ?
+	  run_chrom(c, num_refs, weights, binsize, numbins, mincount, affine_data, true,
+		    &binned_runs[binned_ind]) :
+	  run_chrom_selected(c, num_refs, weights, binsize, numbins, mincount, use_naive_algo,
+			     affine_data);
+	affine_data_allchrom[c] = affine_data;
+	results_allchrom[c] = chrom_results;
+      }
+      geno.end_pass();
+      cout << endl;
+      for (int c = 0; c < num_chroms_used; c++) chroms.push_back(c);
+      if (fused_ind != -1) {
+	printf("(results of %d chroms from the fused admixture test pass)\n",
+	       (int) count(fused_runs[fused_ind].has_chrom.begin(),
+			   fused_runs[fused_ind].has_chrom.end(), 1));
+	fused_runs.erase(fused_runs.begin() + fused_ind);
+      }
+      if (binned_ind != -1) {
+	cout << "(from bin sums ingested ahead; no genotype pass)" << endl;
+	if (--binned_runs[binned_ind].uses == 0)
+	  binned_runs.erase(binned_runs.begin() + binned_ind);
+      }
+    }
+    if (segmented_fft) {
+      string segmented;
+      for (int i = 0; i < (int) chroms.size(); i++)
+	if (chrom_fft_segment[chroms[i]])
+	  segmented += " " + jack_ind_ids[chroms[i]] + "(" +
+	    to_str(chrom_fft_segment[chroms[i]]) + ")";
+      if (!segmented.empty())
+	printf("segmented FFT (transform length): chrom%s\n", segmented.c_str());
+    }
+    if (fft_float_tol > 0) {
+      double max_err = -1;
+      string recomputed;
+      for (int i = 0; i < (int) chroms.size(); i++) {
+	max_err = max(max_err, chrom_fft_float_err[chroms[i]]);
+	if (chrom_fft_float_err[chroms[i]] > fft_float_tol)
+	  recomputed += " " + jack_ind_ids[chroms[i]];
+      }
+      if (max_err >= 0)
+	printf("single-precision FFT: max relative error estimate %.2g (tol %g)\n", max_err,
+	       fft_float_tol);
+      if (!recomputed.empty())
+	printf("  recomputed in double precision: chrom%s\n", recomputed.c_str());
     }
-    cout << endl;
 
     vector <AlderResults> results_jackknife = make_results(results_allchrom, affine_data_allchrom,
-							   binsize, use_naive_algo, fit_start_dis);
+							   binsize, use_naive_algo, fit_start_dis,
+							   chroms);
+    last_run.binsize = binsize;
+    last_run.use_naive_algo = use_naive_algo;
+    last_run.chroms = chroms;
+    last_run.results_allchrom = results_allchrom;
+    last_run.affine_data_allchrom = affine_data_allchrom;
+    if (!from_store)
+      write_stored_run(num_refs, weights, binsize, numbins, mincount, use_naive_algo,
+		       ref_inds, last_run);
 
     cout << endl << "==> Time to run alder: " << timer.update_time() << endl << endl;
     
     fits_all_starts = fit_results(results_jackknife, fit_start_dis, maxdis, fit_test_ind);
+    if (num_refs == 1 && polyache_sketches && !use_naive_algo && !fits_all_starts.empty())
+      add_sketch_var(results_allchrom, affine_data_allchrom, binsize, fit_start_dis, maxdis,
+		     chroms, fits_all_starts, fit_test_ind);
+    if (!extra_binsizes.empty())
+      fit_extra_binsizes(results_allchrom, affine_data_allchrom, binsize, use_naive_algo,
+			 fit_start_dis, maxdis, chroms);
+    if (num_refs == 2)
+      report_sample_loo(ref_inds, last_run, fit_start_dis, maxdis, fits_all_starts,
+			fit_test_ind);
 
     return results_jackknife;
   }
+
+  // the stages of run() for the pipelined driver: each stage touches only its own copy of the
+  // per-run snp tables (compute_run_bins) or none (fit_run_bins), and only report_run_bins
+  // prints, so runs can proceed concurrently on copies of this object
+  Alder::RunBins Alder::compute_run_bins(int num_refs, const vector <double> &weights,
+					 double maxdis, double binsize, int mincount,
+					 bool use_naive_algo) {
+    if (num_refs == 1 && num_mixed_indivs < 4)
+      fatalx("need at least 4 indivs in test pop to compute single-ref LD (polyache)\n");
+    int numbins = maxdis / binsize;
+    RunBins bins;
+    bins.binsize = binsize;
+    bins.use_naive_algo = use_naive_algo;
+    bins.results_allchrom = vector < vector < pair <double, double> > > (num_chroms_used);
+    bins.affine_data_allchrom = vector <AffineData> (num_chroms_used);
+    set_snp_tables(num_refs, weights, binsize, mincount);
+    chrom_use_pairwise = vector <char> (num_chroms_used);
+    for (int c = 0; c < num_chroms_used; c++) {
+      bins.results_allchrom[c] =
+	run_chrom_selected(c, num_refs, weights, binsize, numbins, mincount, use_naive_algo,
+			   bins.affine_data_allchrom[c]);
+      bins.chroms.push_back(c);
+    }
+    return bins;
+  }
+
+  vector <AlderResults> Alder::fit_run_bins(const RunBins &bins, double fit_start_dis,
+					    double maxdis, vector <ExpFitALD> &fits_all_starts,
+					    int &fit_test_ind) {
+    vector <AlderResults> results_jackknife =
+      make_results(bins.results_allchrom, bins.affine_data_allchrom, bins.binsize,
+		   bins.use_naive_algo, fit_start_dis, bins.chroms, false);
+    if (fit_start_dis != INFINITY) // report_run_bins notes the skipped fit
+      fits_all_starts = fit_results(results_jackknife, fit_start_dis, maxdis, fit_test_ind);
+    return results_jackknife;
+  }
+
+  void Alder::report_run_bins(int num_refs, const vector <int> &ref_inds,
+			      const vector <double> &weights, int mincount, const RunBins &bins,
+			      bool from_store, const vector <AlderResults> &results_jackknife,
+			      double fit_start_dis, double maxdis,
+			      vector <ExpFitALD> &fits_all_starts, int &fit_test_ind) {
+    print_run_header(num_refs, ref_inds, mincount, bins.use_naive_algo);
+    if (from_store)
+      cout << "(from the run store; no genotype pass)" << endl;
+    else {
+      cout << "analyzing chrom";
+      for (int i = 0; i < (int) bins.chroms.size(); i++)
+	cout << " " << jack_ind_ids[bins.chroms[i]];
+      cout << endl << "(computed ahead by the pipeline)" << endl;
+    }
+    inter_chrom_affine_ok(bins.use_naive_algo, bins.chroms.size(), true);
+    last_run = bins;
+    if (!from_store)
+      write_stored_run(num_refs, weights, bins.binsize, (int) (maxdis / bins.binsize), mincount,
+		       bins.use_naive_algo, ref_inds, bins);
+
+    cout << endl << "==> Time to run alder: " << timer.update_time() << endl << endl;
+
+    if (fit_start_dis == INFINITY)
+      fits_all_starts = fit_results(results_jackknife, fit_start_dis, maxdis, fit_test_ind);
+    if (!extra_binsizes.empty())
+      fit_extra_binsizes(bins.results_allchrom, bins.affine_data_allchrom, bins.binsize,
+			 bins.use_naive_algo, fit_start_dis, maxdis, bins.chroms);
+    if (num_refs == 2)
+      report_sample_loo(ref_inds, bins, fit_start_dis, maxdis, fits_all_starts, fit_test_ind);
+  }
+
+  // run store file: a header identifying the data and settings, then one record per run:
+  // key (see run_store_key), label (ref pop names), chroms, and for every chrom its bins and
+  // affine sums; records are only appended, so runs from earlier invocations stay valid
+
+  static const char RUN_STORE_MAGIC[8] = {'M','A','L','D','R','S','2','\n'};
+
+  static unsigned long long fnv1a(const void *data, size_t len, unsigned long long h) {
+    const unsigned char *p = (const unsigned char *) data;
+    for (size_t i = 0; i < len; i++) {
+      h ^= p[i];
+      h *= 1099511628211ULL;
+    }
+    return h;
+  }
+
+  template <class T> static void write_vec(FILE *f, const vector <T> &v) {
+    long len = v.size();
+    if (fwrite(&len, sizeof(len), 1, f) != 1 ||
+	(len > 0 && fwrite(&v[0], sizeof(T), len, f) != (size_t) len))
+      fatalx("error writing run store\n");
+  }
+
+  template <class T> static bool read_vec(FILE *f, vector <T> &v) {
+    long len;
+    if (fread(&len, sizeof(len), 1, f) != 1 || len < 0) return false;
+    v.resize(len);
+    return len == 0 || fread(&v[0], sizeof(T), len, f) == (size_t) len;
+  }
+
+  void Alder::write_affine_data(FILE *f, const AffineData &affine_data) {
+    double scalars[6] = {affine_data.count, affine_data.ws, affine_data.ss, affine_data.s2,
+			 affine_data.s11_m, affine_data.s11_d};
+    if (fwrite(scalars, sizeof(double), 6, f) != 6 ||
+	fwrite(&affine_data.num_refs, sizeof(int), 1, f) != 1)
+      fatalx("error writing run store\n");
+    write_vec(f, affine_data.wg); write_vec(f, affine_data.gg); write_vec(f, affine_data.gs);
+    write_vec(f, affine_data.s11_p); write_vec(f, affine_data.s11_c);
+    write_vec(f, affine_data.sketch_sums);
+    const vector < vector <double> > *nested[2] = {&affine_data.gigj, &affine_data.sketch_ld};
+    for (int k = 0; k < 2; k++) {
+      write_vec(f, vector <int> (1, nested[k]->size()));
+      for (int i = 0; i < (int) nested[k]->size(); i++)
+	write_vec(f, (*nested[k])[i]);
+    }
+  }
+
+  bool Alder::read_affine_data(FILE *f, AffineData &affine_data) {
+    double scalars[6];
+    if (fread(scalars, sizeof(double), 6, f) != 6 ||
+	fread(&affine_data.num_refs, sizeof(int), 1, f) != 1)
+      return false;
+    affine_data.count = scalars[0]; affine_data.ws = scalars[1]; affine_data.ss = scalars[2];
+    affine_data.s2 = scalars[3]; affine_data.s11_m = scalars[4]; affine_data.s11_d = scalars[5];
+    if (!read_vec(f, affine_data.wg) || !read_vec(f, affine_data.gg) ||
+	!read_vec(f, affine_data.gs) || !read_vec(f, affine_data.s11_p) ||
+	!read_vec(f, affine_data.s11_c) || !read_vec(f, affine_data.sketch_sums))
+      return false;
+    vector < vector <double> > *nested[2] = {&affine_data.gigj, &affine_data.sketch_ld};
+    for (int k = 0; k < 2; k++) {
+      vector <int> len;
+      if (!read_vec(f, len) || len.size() != 1 || len[0] < 0) return false;
+      nested[k]->resize(len[0]);
+      for (int i = 0; i < len[0]; i++)
+	if (!read_vec(f, (*nested[k])[i])) return false;
+    }
+    return true;
+  }
+
+  // the weighted LD curve is quadratic in the weights, so 2-ref weights wA - wB and wB - wA
+  // share a key
+  unsigned long long Alder::run_store_key(int num_refs, const vector <double> &weights) {
+    unsigned long long h = fnv1a(&num_refs, sizeof(num_refs), 14695981039346656037ULL);
+    double sign = 1;
+    if (num_refs == 2)
+      for (int s = 0; s < (int) weights.size(); s++)
+	if (!isnan(weights[s]) && weights[s] != 0) {
+	  sign = weights[s] > 0 ? 1 : -1;
+	  break;
+	}
+    for (int s = 0; s < (int) weights.size(); s++) {
+      char missing = isnan(weights[s]);
+      double w = missing || weights[s] == 0 ? 0.0 : sign * weights[s];
+      h = fnv1a(&missing, 1, h);
+      h = fnv1a(&w, sizeof(w), h);
+    }
+    return h;
+  }
+
+  void Alder::open_run_store(const char *filename, double maxdis, double binsize,
+			     int mincount, bool use_naive_algo) {
+    run_store_numbins = maxdis / binsize;
+    run_store_binsize = binsize;
+    run_store_mincount = mincount;
+    run_store_naive = use_naive_algo;
+    // the data: snps, test pop and its per-snp genotype sums
+    unsigned long long data_hash = 14695981039346656037ULL;
+    data_hash = fnv1a(&num_mixed_indivs, sizeof(int), data_hash);
+    data_hash = fnv1a(&snp_pos[0], sizeof(double) * snp_pos.size(), data_hash);
+    data_hash = fnv1a(&chrom_start_inds[0], sizeof(int) * chrom_start_inds.size(), data_hash);
+    data_hash = fnv1a(&snp_num_missing[0], sizeof(int) * snp_num_missing.size(), data_hash);
+    data_hash = fnv1a(&snp_sum[0], sizeof(int) * snp_sum.size(), data_hash);
+    data_hash = fnv1a(&snp_sum2[0], sizeof(int) * snp_sum2.size(), data_hash);
+    data_hash = fnv1a(mixed_pop_name.c_str(), mixed_pop_name.size(), data_hash);
+    // approximate modes (single-precision FFTs, polyache sketches) give slightly different bin
+    // sums, so they are part of the settings
+    int settings[5] = {run_store_numbins, mincount, use_naive_algo, num_chroms_used,
+		       polyache_sketches};
+
+    run_store_index.clear();
+    run_store = fopen(filename, "r+b");
+    long end = 0;
+    if (run_store != NULL) {
+      char magic[8]; unsigned long long hash; double bs, tol; int sets[5];
+      if (fread(magic, 1, 8, run_store) == 8 && memcmp(magic, RUN_STORE_MAGIC, 8) == 0 &&
+	  fread(&hash, sizeof(hash), 1, run_store) == 1 && hash == data_hash &&
+	  fread(&bs, sizeof(bs), 1, run_store) == 1 && bs == binsize &&
+	  fread(&tol, sizeof(tol), 1, run_store) == 1 && tol == fft_float_tol &&
+	  fread(sets, sizeof(int), 5, run_store) == 5 && memcmp(sets, settings, sizeof(sets)) == 0) {
+	end = ftell(run_store);
+	unsigned long long key;
+	RunBins bins;
+	while (fread(&key, sizeof(key), 1, run_store) == 1 && read_run_record(bins)) {
+	  run_store_index[key] = end;
+	  end = ftell(run_store);
+	}
+	// drops a partial record left by an interrupted run
+	if (ftruncate(fileno(run_store), end) != 0)
+	  fatalx("unable to truncate run store: %s\n", filename);
+      }
+      else {
+	cout << "run store " << filename << " is for other data or settings; starting over"
+	     << endl;
+	fclose(run_store);
+	run_store = NULL;
+      }
+    }
+    if (run_store == NULL) {
+      run_store = fopen(filename, "w+b");
+      if (run_store == NULL) fatalx("unable to open run store: %s\n", filename);
+      if (fwrite(RUN_STORE_MAGIC, 1, 8, run_store) != 8 ||
+	  fwrite(&data_hash, sizeof(data_hash), 1, run_store) != 1 ||
+	  fwrite(&binsize, sizeof(binsize), 1, run_store) != 1 ||
+	  fwrite(&fft_float_tol, sizeof(fft_float_tol), 1, run_store) != 1 ||
+	  fwrite(settings, sizeof(int), 5, run_store) != 5)
+	fatalx("error writing run store: %s\n", filename);
+      end = ftell(run_store);
+    }
+    fseek(run_store, end, SEEK_SET);
+    run_store_end = end;
+    cout << "run store " << filename << ": " << run_store_index.size() << " stored run(s)"
+	 << endl << endl;
+  }
+
+  void Alder::close_run_store(void) {
+    if (run_store != NULL) fclose(run_store);
+    run_store = NULL;
+  }
+
+  bool Alder::read_run_record(RunBins &bins) {
+    vector <char> label;
+    if (!read_vec(run_store, label) || !read_vec(run_store, bins.chroms)) return false;
+    bins.binsize = run_store_binsize;
+    bins.use_naive_algo = run_store_naive;
+    bins.results_allchrom = vector < vector < pair <double, double> > > (num_chroms_used);
+    bins.affine_data_allchrom = vector <AffineData> (num_chroms_used);
+    for (int c = 0; c < num_chroms_used; c++)
+      if (!read_vec(run_store, bins.results_allchrom[c]) ||
+	  !read_affine_data(run_store, bins.affine_data_allchrom[c]))
+	return false;
+    return true;
+  }
+
+  bool Alder::read_stored_run(int num_refs, const vector <double> &weights, double binsize,
+			      int numbins, int mincount, bool use_naive_algo, RunBins &bins) {
+    if (run_store == NULL || binsize != run_store_binsize || numbins != run_store_numbins ||
+	mincount != run_store_mincount || use_naive_algo != run_store_naive)
+      return false;
+    map <unsigned long long, long>::iterator it =
+      run_store_index.find(run_store_key(num_refs, weights));
+    if (it == run_store_index.end()) return false;
+    fseek(run_store, it->second + sizeof(unsigned long long), SEEK_SET);
+    bool ok = read_run_record(bins);
+    fseek(run_store, run_store_end, SEEK_SET);
+    if (!ok) fatalx("error reading run store\n");
+    return true;
+  }
+
+  void Alder::write_stored_run(int num_refs, const vector <double> &weights, double binsize,
+			       int numbins, int mincount, bool use_naive_algo,
+			       const vector <int> &ref_inds, const RunBins &bins) {
+    if (run_store == NULL || binsize != run_store_binsize || numbins != run_store_numbins ||
+	mincount != run_store_mincount || use_naive_algo != run_store_naive)
+      return;
+    if ((int) bins.chroms.size() != num_chroms_used) return; // partial (anytime) runs
+    unsigned long long key = run_store_key(num_refs, weights);
+    if (run_store_index.count(key)) return;
+    string label;
+    for (int i = 0; i < (int) ref_inds.size(); i++)
+      label += (i ? ";" : "") + ref_pop_names[ref_inds[i]];
+    fseek(run_store, run_store_end, SEEK_SET);
+    if (fwrite(&key, sizeof(key), 1, run_store) != 1)
+      fatalx("error writing run store\n");
+    write_vec(run_store, vector <char> (label.begin(), label.end()));
+    write_vec(run_store, bins.chroms);
+    for (int c = 0; c < num_chroms_used; c++) {
+      write_vec(run_store, bins.results_allchrom[c]);
+      write_affine_data(run_store, bins.affine_data_allchrom[c]);
+    }
+    fflush(run_store);
+    run_store_index[key] = run_store_end;
+    run_store_end = ftell(run_store);
+  }
+
+  // bin b of the result at binsize k*binsize sums fine bins k*b, ..., k*b+k-1 (distances are
+  // binned after subtracting fine bin indices, so results can differ slightly from a run at the
+  // coarse binsize)
+  static vector < pair <double, double> > coarsen_bins(
+      const vector < pair <double, double> > &fine, int k, int numbins) {
+    vector < pair <double, double> > coarse(numbins);
+    for (int b = 0; b < numbins; b++)
+      for (int b2 = k*b; b2 < k*(b+1) && b2 < (int) fine.size(); b2++) {
+	coarse[b].first += fine[b2].first;
+	coarse[b].second += fine[b2].second;
+      }
+    return coarse;
+  }
+
+  // fits the weighted LD curve at each coarser binsize in extra_binsizes (see coarsen_bins)
+  void Alder::fit_extra_binsizes(
+      const vector < vector < pair <double, double> > > &results_allchrom,
+      const vector <AffineData> &affine_data_allchrom, double binsize, bool use_naive_algo,
+      double fit_start_dis, double maxdis, const vector <int> &chroms) {
+
+    for (int i = 0; i < (int) extra_binsizes.size(); i++) {
+      int k = (int) (extra_binsizes[i] / binsize + 0.5);
+      if (k < 2 || fabs(k*binsize - extra_binsizes[i]) > 1e-6 * binsize)
+	fatalx("extra binsize %g cM is not an integer multiple (>= 2x) of binsize %g cM\n",
+	       100*extra_binsizes[i], 100*binsize);
+      vector < vector < pair <double, double> > > results_coarse(num_chroms_used);
+      for (int j = 0; j < (int) chroms.size(); j++) {
+	int c = chroms[j];
+	results_coarse[c] = coarsen_bins(results_allchrom[c], k, results_allchrom[c].size() / k);
+      }
+      vector <AlderResults> results_jackknife =
+	make_results(results_coarse, affine_data_allchrom, k*binsize, use_naive_algo,
+		     fit_start_dis, chroms, false);
+      printf("---- binsize %g cM (aggregated from %g cM bins) ----\n", 100*k*binsize,
+	     100*binsize);
+      if (fit_start_dis == INFINITY) {
+	cout << "fit start = inf because of long-range LD correlation; not doing fitting" << endl;
+	continue;
+      }
+      exp_fit_jackknife(results_jackknife, fit_start_dis, maxdis).print_fit(false);
+    }
+  }
+
+  vector <AlderResults> Alder::refit_last_run(double binsize, double maxdis,
+					      const set <int> &chrom_set,
+					      const set <int> &nochrom_set, double fit_start_dis,
+					      vector <ExpFitALD> &fits_all_starts,
+					      int &fit_test_ind) {
+    int k = (int) (binsize / last_run.binsize + 0.5);
+    if (k < 1 || fabs(k*last_run.binsize - binsize) > 1e-6 * last_run.binsize)
+      fatalx("binsize %g is not a multiple of the run binsize %g\n", binsize,
+	     last_run.binsize);
+    int numbins = maxdis / binsize;
+    vector <int> chroms;
+    vector < vector < pair <double, double> > > results_coarse(num_chroms_used);
+    for (int j = 0; j < (int) last_run.chroms.size(); j++) {
+      int c = last_run.chroms[j], label = atoi(jack_ind_ids[c].c_str());
+      if ((!chrom_set.empty() && !chrom_set.count(label)) || nochrom_set.count(label))
+	continue;
+      chroms.push_back(c);
+      const vector < pair <double, double> > &fine = last_run.results_allchrom[c];
+      if (k*numbins > (int) fine.size())
+	fatalx("maxdis %g exceeds the maxdis of the run\n", maxdis);
+      results_coarse[c] = coarsen_bins(fine, k, numbins);
+    }
+    if (chroms.empty()) fatalx("no chromosomes of the run in the requested subset\n");
+    printf("(from the per-chrom bin sums of the %g cM run: binsize %g cM, maxdis %g cM, %d of"
+	   " %d chroms)\n\n", 100*last_run.binsize, 100*binsize, 100*maxdis, (int) chroms.size(),
+	   (int) last_run.chroms.size());
+    vector <AlderResults> results_jackknife =
+      make_results(results_coarse, last_run.affine_data_allchrom, binsize,
+		   last_run.use_naive_algo, fit_start_dis, chroms);
+    fits_all_starts = fit_results(results_jackknife, fit_start_dis, maxdis, fit_test_ind);
+    return results_jackknife;
+  }
+
+  // polyache sketch mode: estimates the variance of the fit parameters due to sketching
+  // (delete-one jackknife over sketches) and adds it to the jackknife variance of each fit
+  void Alder::add_sketch_var(const vector < vector < pair <double, double> > > &results_allchrom,
+			     const vector <AffineData> &affine_data_allchrom, double binsize,
+			     double fit_start_dis, double maxdis, const vector <int> &chroms,
+			     vector <ExpFitALD> &fits_all_starts, int fit_test_ind) {
+
+    const int num_vars = 4;
+    const char *varnames[num_vars] = {"decay", "amp_tot", "amp_exp", "amp_aff"};
+    int K = polyache_sketches, num_starts = fits_all_starts.size();
+    // sketch_ests[f][v][k]: full-data estimate of var v at fit start f leaving out sketch k
+    vector < vector < vector <double> > > sketch_ests(num_starts, vector < vector <double> >
+						      (num_vars, vector <double> (K)));
+    for (int k = 0; k < K; k++) {
+      vector < vector < pair <double, double> > > results_allchrom_k = results_allchrom;
+      vector <AffineData> affine_data_allchrom_k = affine_data_allchrom;
+      for (int j = 0; j < (int) chroms.size(); j++) {
+	int c = chroms[j];
+	const vector < vector <double> > &sketch_ld = affine_data_allchrom[c].sketch_ld;
+	for (int b = 0; b < (int) results_allchrom_k[c].size(); b++) {
+	  double mean = 0;
+	  for (int k2 = 0; k2 < K; k2++) mean += sketch_ld[k2][b] / K;
+	  results_allchrom_k[c][b].first += (mean - sketch_ld[k][b]) / (K-1);
+	}
+	vector <double> &sketch_sums = affine_data_allchrom_k[c].sketch_sums;
+	sketch_sums.erase(sketch_sums.begin() + k);
+      }
+      vector <AlderResults> results_k = make_results(results_allchrom_k, affine_data_allchrom_k,
+						     binsize, false, fit_start_dis, chroms, false);
+      int fit_test_ind_k;
+      vector <ExpFitALD> fits_k = fit_results(results_k, fit_start_dis, maxdis, fit_test_ind_k);
+      for (int f = 0; f < num_starts; f++)
+	for (int v = 0; v < num_vars; v++)
+	  sketch_ests[f][v][k] = fits_k[f].get_var(varnames[v]).back();
+    }
+
+    for (int f = 0; f < num_starts; f++)
+      for (int v = 0; v < num_vars; v++) {
+	double sketch_var = sq(Jackknife::stddev(sketch_ests[f][v], K));
+	fits_all_starts[f].add_jackknife_var(varnames[v], sketch_var);
+	if (f == fit_test_ind && (v == 0 || v == 2))
+	  printf("sketch std error of %s (%d sketches): %g%s\n", varnames[v], K,
+		 sqrt(sketch_var), use_jackknife ? " (added to jackknife std error)" : "");
+      }
+    cout << endl;
+  }
   
+  // anytime mode: analyzes chroms in an interleaved order (so that any prefix is spread over
+  // the genome) one at a time on all threads, refitting whenever the done prefix grows; stops
+  // once the time limit has passed or the decay rate standard error is below the target
+  // returns the (sorted) indices of the chroms analyzed
+  vector <int> Alder::run_chroms_anytime(
+      int num_refs, const vector <double> &weights, double binsize, int numbins, int mincount,
+      bool use_naive_algo, double fit_start_dis, double maxdis,
+      vector < vector < pair <double, double> > > &results_allchrom,
+      vector <AffineData> &affine_data_allchrom) {
+
+    vector <int> order;
+    bool chroms_fixed = !anytime_chroms.empty();
+    if (chroms_fixed) {
+      cout << "anytime mode: using the " << anytime_chroms.size()
+	   << " chroms analyzed in the first run" << endl;
+      order = anytime_chroms;
+    }
+    else { // bit-reversal permutation of 0..num_chroms_used-1
+      int pow2 = 1, bits = 0;
+      while (pow2 < num_chroms_used) { pow2 *= 2; bits++; }
+      for (int k = 0; k < pow2; k++) {
+	int c = 0;
+	for (int b = 0; b < bits; b++)
+	  if (k & (1<<b)) c |= 1<<(bits-1-b);
+	if (c < num_chroms_used) order.push_back(c);
+      }
+    }
+
+    int snps_tot = 0;
+    for (int s = 0; s < chrom_start_inds[num_chroms_used]; s++)
+      snps_tot += !snp_ignore[s];
+
+    const int min_chroms = std::min(3, num_chroms_used); // for inter-chrom affine + jackknife
+    double start_time = omp_get_wtime();
+    string stop_reason = "all chroms analyzed";
+    vector <int> chroms;
+    int snps_used = 0;
+    // chroms are claimed one at a time in order by all threads; whenever the prefix of order
+    // that is done grows, the estimate is updated and the limits checked on that prefix (so
+    // the stopping point for target_decay_se does not depend on thread timing); on stopping,
+    // chroms past the prefix are not started (or, if already running, not used)
+    int next = 0, num_done = 0, num_used = order.size();
+    bool stop = false;
+    vector <char> done(order.size());
+    // the first run's share of the time budget (later runs reuse its chroms)
+    double max_secs = anytime_max_secs / anytime_num_runs;
+    if (!chroms_fixed) {
+      cout << "anytime mode: analyzing chroms one at a time in order" << endl;
+      if (anytime_max_secs > 0 && anytime_num_runs > 1)
+	printf("anytime mode: time limit %.1f sec (%g sec budget over %d runs)\n", max_secs,
+	       anytime_max_secs, anytime_num_runs);
+    }
+    geno.start_pass(order);
+#pragma omp parallel
+    while (true) {
+      int k;
+#pragma omp critical(anytime_next)
+      k = stop ? (int) order.size() : next++;
+      if (k >= (int) order.size()) break;
+      int c = order[k];
+      AffineData affine_data;
+      vector < pair <double, double> > chrom_results =
+	run_chrom_selected(c, num_refs, weights, binsize, numbins, mincount, use_naive_algo,
+			   affine_data);
+      affine_data_allchrom[c] = affine_data;
+      results_allchrom[c] = chrom_results;
+
+      // the thread that extends the done prefix refits on it, outside the critical section
+      // (the results of the prefix chroms are final)
+      int fit_prefix = 0, fit_snps = 0;
+      vector <int> fit_chroms;
+#pragma omp critical(anytime_check)
+      {
+	done[k] = true;
+	int num_done_prev = num_done;
+	while (num_done < (int) order.size() && done[num_done]) {
+	  int cd = order[num_done++];
+	  chroms.push_back(cd);
+	  for (int s = chrom_start_inds[cd]; s < chrom_start_inds[cd+1]; s++)
+	    snps_used += !snp_ignore[s];
+	}
+	if (!stop && !chroms_fixed && num_done > num_done_prev && num_done >= min_chroms
+	    && num_done < (int) order.size()) {
+	  fit_prefix = num_done;
+	  fit_chroms = chroms;
+	  fit_snps = snps_used;
+	}
+      }
+      if (fit_prefix) {
+	std::sort(fit_chroms.begin(), fit_chroms.end());
+	double elapsed = omp_get_wtime() - start_time;
+	string line = str_printf("anytime: %d of %d chroms (%.1f%% of snps), %.1f sec",
+				 fit_prefix, num_chroms_used, 100.0*fit_snps/snps_tot, elapsed);
+	bool se_reached = false;
+	if (fit_start_dis != INFINITY) {
+	  vector <AlderResults> results_jackknife = make_results(results_allchrom,
+								 affine_data_allchrom, binsize,
+								 use_naive_algo, fit_start_dis,
+								 fit_chroms, false);
+	  ExpFitALD fit = exp_fit_jackknife(results_jackknife, fit_start_dis, maxdis);
+	  pair <double, double> decay = Jackknife::mean_std(fit.get_var("decay"));
+	  line += str_printf(": decay = %.2f +/- %.2f", decay.first, decay.second);
+	  se_reached = anytime_target_se > 0 && decay.second < anytime_target_se;
+	}
+	printf("%s\n", line.c_str());
+	fflush(stdout);
+	bool time_up = max_secs > 0 && elapsed >= max_secs;
+	// fits of several prefixes may finish in any order: stop at the shortest one that met
+	// a limit
+#pragma omp critical(anytime_check)
+	if ((se_reached || time_up) && (!stop || fit_prefix < num_used)) {
+	  num_used = fit_prefix;
+	  stop_reason = se_reached ? "decay rate std error below target" : "time limit reached";
+#pragma omp critical(anytime_next)
+	  stop = true;
+	}
+      }
+    }
+    if (stop) { // chroms done past the prefix at the stopping point are not used
+      chroms.assign(order.begin(), order.begin() + num_used);
+      std::sort(chroms.begin(), chroms.end());
+      snps_used = 0;
+      for (int k = 0; k < num_used; k++)
+	for (int s = chrom_start_inds[order[k]]; s < chrom_start_inds[order[k]+1]; s++)
+	  snps_used += !snp_ignore[s];
+    }
+    geno.end_pass();
+    if (!chroms_fixed) {
+      printf("NOTE: anytime mode used %d of %d chroms (%d of %d snps = %.1f%%): %s\n",
+	     (int) chroms.size(), num_chroms_used, snps_used, snps_tot, 100.0*snps_used/snps_tot,
+	     stop_reason.c_str());
+      anytime_chroms = chroms;
+    }
+    return chroms;
+  }
+
+  // cheap approximation of the z-score used by the admixture test (min of decay, amp_exp z):
+  // computes weighted LD on every chrom_stride-th chromosome at the given (coarse) binsize,
+  // fits at fit_start_dis only, and scales the z-score up to the full set of snps
+  // (z-scores grow as the square root of the amount of data)
+  double Alder::screen_admixture_zscore(int num_refs, const vector <double> &weights,
+					double maxdis, double binsize, int mincount,
+					double fit_start_dis, int chrom_stride) {
+
+    if (fit_start_dis == INFINITY) return NAN;
+
+    vector <int> chroms;
+    for (int c = 0; c < num_chroms_used; c += chrom_stride) chroms.push_back(c);
+    if (chroms.size() < 3) { // need >= 3 chroms to jackknife with inter-chrom affine terms
+      chroms.clear();
+      for (int c = 0; c < num_chroms_used; c++) chroms.push_back(c);
+    }
+
+    int numbins = maxdis / binsize;
+    set_snp_tables(num_refs, weights, binsize, mincount);
+
+    vector < vector < pair <double, double> > > results_allchrom(num_chroms_used);
+    vector <AffineData> affine_data_allchrom(num_chroms_used);
+    geno.start_pass(chroms);
+#pragma omp parallel for schedule(static,1)
+    for (int j = 0; j < (int) chroms.size(); j++) {
+      int c = chroms[j];
+      geno.acquire(c);
+      results_allchrom[c] = run_chrom(c, num_refs, weights, binsize, numbins, mincount,
+				      affine_data_allchrom[c]);
+      geno.release(c);
+    }
+    geno.end_pass();
+    vector <AlderResults> results_jackknife = make_results(results_allchrom, affine_data_allchrom,
+							   binsize, false, fit_start_dis, chroms);
+    ExpFitALD fit = exp_fit_jackknife(results_jackknife, fit_start_dis, maxdis);
+
+    double snps_used = 0, snps_tot = 0;
+    for (int s = 0; s < (int) snp_pos.size(); s++)
+      if (!snp_ignore[s]) {
+	snps_tot++;
+	if (chroms.size() == (size_t) num_chroms_used || snp_chrom_ind_squash[s] % chrom_stride == 0)
+	  snps_used++;
+      }
+    return min(fit.zscore("decay"), fit.zscore("amp_exp")) * sqrt(snps_tot / snps_used);
+  }
+
   double Alder::compute_mult_hyp_corr(const vector <bool> &use_ref) {
     char jobu = 'N', jobvt = 'N';
     int m = 0, n = 0;
@@ -940,25 +3088,31 @@ namespace ALD {
     int info;
     
     // create allele freq array
-    for (int s = 0; s < (int) snp_pos.size(); s++) {
-      int arr_pos = n*m;
-      bool snp_good = true;
-      for (int r = 0; r < (int) use_ref.size(); r++)
-	if (use_ref[r]) {
-	  double geno_mean = compute_geno_mean(s, ref_genos[r], num_ref_indivs[r]);
-	  if (isnan(geno_mean))
-	    snp_good = false;
-	  else
-	    A[arr_pos++] = geno_mean;
+    geno.start_pass();
+    for (int c = 0; c < num_chroms_used; c++) {
+      geno.acquire(c);
+      for (int s = chrom_start_inds[c]; s < chrom_start_inds[c+1]; s++) {
+	int arr_pos = n*m;
+	bool snp_good = true;
+	for (int r = 0; r < (int) use_ref.size(); r++)
+	  if (use_ref[r]) {
+	    double geno_mean = compute_geno_mean(s, &ref_rows[r][0], num_ref_indivs[r]);
+	    if (isnan(geno_mean))
+	      snp_good = false;
+	    else
+	      A[arr_pos++] = geno_mean;
+	  }
+	if (snp_good) {
+	  // mean-center the data for this snp
+	  double geno_mean_sum = 0.0;;
+	  for (int i = 0; i < m; i++) geno_mean_sum += A[n*m+i];
+	  for (int i = 0; i < m; i++) A[n*m+i] -= geno_mean_sum / m;
+	  n++;
 	}
-      if (snp_good) {
-	// mean-center the data for this snp
-	double geno_mean_sum = 0.0;;
-	for (int i = 0; i < m; i++) geno_mean_sum += A[n*m+i];
-	for (int i = 0; i < m; i++) A[n*m+i] -= geno_mean_sum / m;
-	n++;
       }
+      geno.release(c);
     }
+    geno.end_pass();
     cout << "Calculating number of effective populations using data from "
 	 << n << " snps..." << endl;
     if (n < m) fatalx("need at least as many snps as ref pops\n");
@@ -985,8 +3139,88 @@ namespace ALD {
     return mult_hyp_corr;
   }
 
+  // greedy column subset selection on the mean-centered ref allele freq matrix (= QR with
+  // column pivoting, done as pivoted Cholesky on the num_refs x num_refs Gram matrix so that the
+  // snps x refs matrix is never stored): repeatedly picks the ref whose freqs are least explained
+  // by the refs already picked until the picked refs span var_frac of the total variance
+  vector <int> Alder::select_representative_refs(double var_frac) {
+    int m = ref_rows.size();
+    vector <double> G(m*m, 0.0);
+    int n = 0;
+    geno.start_pass();
+    for (int c = 0; c < num_chroms_used; c++) {
+      geno.acquire(c);
+      vector <double> x(m);
+      for (int s = chrom_start_inds[c]; s < chrom_start_inds[c+1]; s++) {
+	bool snp_good = true;
+	double geno_mean_sum = 0.0;
+	for (int r = 0; r < m && snp_good; r++) {
+	  x[r] = compute_geno_mean(s, &ref_rows[r][0], num_ref_indivs[r]);
+	  if (isnan(x[r])) snp_good = false;
+	  else geno_mean_sum += x[r];
+	}
+	if (!snp_good) continue;
+	for (int r = 0; r < m; r++) x[r] -= geno_mean_sum / m;
+	for (int r1 = 0; r1 < m; r1++)
+	  for (int r2 = r1; r2 < m; r2++)
+	    G[r1*m+r2] += x[r1] * x[r2];
+	n++;
+      }
+      geno.release(c);
+    }
+    geno.end_pass();
+    for (int r1 = 0; r1 < m; r1++)
+      for (int r2 = 0; r2 < r1; r2++)
+	G[r1*m+r2] = G[r2*m+r1];
+
+    cout << "Selecting representative ref pops (accounting for >" << 100*var_frac
+	 << "% of variance) using data from " << n << " snps..." << endl;
+    vector <double> resid(m); // residual variance of each ref after projecting out picked refs
+    double tot_variance = 0.0;
+    for (int r = 0; r < m; r++) tot_variance += (resid[r] = G[r*m+r]);
+    vector <int> picked;
+    vector < vector <double> > L; // Cholesky columns of the picked refs
+    double cum_variance = 0.0;
+    while ((int) picked.size() < m && cum_variance < var_frac * tot_variance) {
+      int p = 0;
+      for (int r = 1; r < m; r++)
+	if (resid[r] > resid[p]) p = r;
+      if (!(resid[p] > 1e-12 * tot_variance)) break; // remaining refs are in the span
+      double piv = sqrt(resid[p]);
+      vector <double> l(m);
+      for (int r = 0; r < m; r++) {
+	double dot = G[r*m+p];
+	for (int k = 0; k < (int) L.size(); k++) dot -= L[k][r] * L[k][p];
+	l[r] = dot / piv;
+      }
+      for (int r = 0; r < m; r++) resid[r] -= sq(l[r]);
+      resid[p] = 0;
+      L.push_back(l);
+      picked.push_back(p);
+      cum_variance = 0.0;
+      for (int r = 0; r < m; r++) cum_variance += resid[r];
+      cum_variance = tot_variance - cum_variance;
+      printf("\t%d:\t%20s\tcumulative variance: %.2f%%\n", (int) picked.size(),
+	     ref_pop_names[p].c_str(), 100 * cum_variance / tot_variance);
+    }
+    if (picked.size() == 1 && m >= 2) { // need a pair: add the ref farthest from the first
+      int p = picked[0], q = -1;
+      double max_dist = -1;
+      for (int r = 0; r < m; r++)
+	if (r != p && G[r*m+r] - 2*G[r*m+p] + G[p*m+p] > max_dist) {
+	  max_dist = G[r*m+r] - 2*G[r*m+p] + G[p*m+p];
+	  q = r;
+	}
+      picked.push_back(q);
+      printf("\t%d:\t%20s\t(added to form a pair)\n", (int) picked.size(),
+	     ref_pop_names[q].c_str());
+    }
+    cout << endl;
+    return picked;
+  }
+
   vector <double> Alder::compute_one_ref_f2_jacks(int ref_ind) {
-    return compute_f2_jacks(mixed_geno, num_mixed_indivs,
-			    ref_genos[ref_ind], num_ref_indivs[ref_ind]);
+    return compute_f2_jacks(&mixed_rows[0], num_mixed_indivs,
+			    &ref_rows[ref_ind][0], num_ref_indivs[ref_ind]);
   }
 }
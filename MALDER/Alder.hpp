@@ -3,14 +3,19 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <set>
 #include <utility>
 #include <cmath>
+#include <cstdio>
 
 #include <fftw3.h>
 
 #include "Timer.hpp"
 #include "CorrJack.hpp"
 #include "ExpFitALD.hpp"
+#include "GenoStream.hpp"
+#include "RefLdIndex.hpp"
 
 namespace ALD {
 
@@ -21,6 +26,8 @@ namespace ALD {
   using std::string;
   using std::vector;
   using std::pair;
+  using std::map;
+  using std::set;
   inline bool isnan(double x)
   {
    return (x != x);
@@ -37,9 +44,112 @@ namespace ALD {
       double count;
       double ws, ss, s2;
       vector <double> wg, gg, gs;
-      vector < vector <double> > gigj;
+      vector < vector <double> > gigj; // polyache only (not allocated in sketch mode)
+      // polyache sketch mode: totals of the exactly computed parts of S11^2 (see run_chrom);
+      // per-sketch totals and binned terms for the sketched part
+      double s11_m, s11_d;
+      vector <double> s11_p, s11_c;
+      vector <double> sketch_sums;
+      vector < vector <double> > sketch_ld;
+      // 2-ref with per-sample contributions (see set_sample_loo): by indiv, the change of the
+      // chrom's bin sums from leaving the indiv out (see run_chrom)
+      vector < vector <double> > loo_delta;
       int num_refs;
-      AffineData(int n, int _num_refs);
+      AffineData(int n, int _num_refs, int num_sketches);
+    };
+
+  public:
+    // per-chrom bin sums of a weighted LD run
+    struct RunBins {
+      double binsize;
+      bool use_naive_algo;
+      vector <int> chroms;
+      vector < vector < pair <double, double> > > results_allchrom;
+      vector <AffineData> affine_data_allchrom;
+    };
+
+  private:
+    // LD correlation terms of one distance bin (see find_ld_corr_stops); has_corr and
+    // has_polyache mark terms computed over all snp pairs (not stopped early)
+    struct LdCorrBin {
+      CorrJack corr_data, test_data, ref_data;
+      bool has_corr, has_polyache;
+      LdCorrBin(int C, const vector <string> &ids);
+      void add(const LdCorrBin &other);
+    };
+
+    // buffers and plan for the forward transforms of run_chrom: pairs of real arrays are
+    // transformed together as the real and imaginary parts of one complex array and separated
+    // using Hermitian symmetry (fx and gy for cross terms; consecutive self terms)
+    // segmented mode (len > 0): the inputs have length len, and each term is accumulated
+    // over blocks of N - 2*lag bins (overlap-save), giving the same lags 0..lag with
+    // transforms of length N (no self term pairing; spectra not available)
+    struct ConvFFT {
+      int N, Nby2;
+      int len, lag, block; // length of fx, gy; segmented mode: max lag, block length (else 0)
+      double *fx, *gy; // real inputs
+      fftw_complex *z, *fft_z;
+      fftw_plan plan;
+      // self term waiting for a partner (none if pending_accum is NULL)
+      double *pending;
+      double pending_scale;
+      fftw_complex *pending_accum;
+      ConvFFT(int _N, int _len=0, int _lag=0);
+      ~ConvFFT();
+      // transform length for segmented accumulation of signals with data in the bins marked
+      // in bin_used at lags 0..lag, or 0 if transforms of length N over the whole signal are
+      // cheaper
+      static int segmented_length(const vector <char> &bin_used, int lag, int N);
+      void cross_accum(fftw_complex *z_accum, double scale);
+      void self_accum(fftw_complex *z_accum, double scale, bool defer);
+      void flush(void); // must be called before reading accumulators
+      // X, Y = transforms of fx, gy (or of fx alone if Y is NULL) at b = 0..N/2
+      void spectra(fftw_complex *X, fftw_complex *Y);
+    private:
+      void transform(const double *re, const double *im);
+      void segmented_accum(const double *x, const double *y, fftw_complex *z_accum,
+			   double scale);
+      ConvFFT(const ConvFFT &);
+      ConvFFT &operator=(const ConvFFT &);
+    };
+
+    // per-sample contributions of a 2-ref run_chrom (see run_chrom): the transforms F, G of
+    // the sums of the indivs' signals, the running sum of their cross spectra, and an inverse
+    // transform buffer
+    struct LooSpectra {
+      int N, Nby2;
+      fftw_complex *F, *G, *sum_cross, *z;
+      double *r;
+      fftw_plan plan;
+      LooSpectra(int _N);
+      ~LooSpectra();
+      void add_indiv(const fftw_complex *fft_z, int n);
+      void totals(double *A, double *T, int numbins);
+    private:
+      LooSpectra(const LooSpectra &);
+      LooSpectra &operator=(const LooSpectra &);
+    };
+
+    // single-precision plans for the per-indiv transforms of run_chrom: the float inputs are
+    // converted from the scatter arrays straight into the complex scratch buffer z of a
+    // ConvFFT (not otherwise in use between its transforms), so no buffers are added
+    struct FloatFFT {
+      int N;
+      fftwf_complex *fft_fx, *fft_gy; // transforms at b = 0..N/2, computed in place
+      fftwf_plan plans[2];
+      // accuracy check: the next term is computed in both precisions and the difference
+      // accumulated in diff; check_indiv is the indiv checked in each term group; num_terms
+      // counts the terms computed in single precision, num_checks those checked
+      bool check;
+      int check_indiv;
+      fftw_complex *diff;
+      int num_terms, num_checks;
+      FloatFFT(ConvFFT &cf, int _check_indiv);
+      ~FloatFFT();
+      void execute(const double *fx, const double *gy);
+    private:
+      FloatFFT(const FloatFFT &);
+      FloatFFT &operator=(const FloatFFT &);
     };
 
     // constants for determining LD correlation extent
@@ -48,11 +158,18 @@ namespace ALD {
     static const double PCA_VARIANCE_THRESH;
 
     static const bool SUBTRACT_THEN_BIN = false; // only for naive pairwise algorithm
+    static const unsigned int SKETCH_SEED = 20130413;
+    static const double SPARSE_MAX_FRAC; // max fraction of non-default genos in sparse snps
+    static const double FFT_COST_FACTOR; // cost of an FFT per N log2(N) (see select_chrom_algos)
+    static const unsigned int FFT_FLOAT_CHECK_SEED = 1013904223;
 
-    const char *mixed_geno;
+    // genotype rows by snp (see GenoStream: in streaming mode, only the rows of chroms
+    // between geno.acquire and geno.release are available)
+    GenoStream &geno;
+    const vector <const char *> &mixed_rows;
     const int num_mixed_indivs;
     const string &mixed_pop_name;
-    const vector <char *> &ref_genos;
+    const vector < vector <const char *> > &ref_rows;
     const vector <int> &num_ref_indivs;
     const vector <string> &ref_pop_names;
     bool use_jackknife;
@@ -63,59 +180,289 @@ namespace ALD {
     vector <double> snp_pos;
     vector <int> snp_chrom_ind_squash;
 
+    // sparse store for test pop genotypes: snps at which all but a few indivs have the same
+    // genotype (0 or 2) also keep lists of the indivs with other genotypes (incl. missing)
+    vector <signed char> snp_sparse_geno; // default genotype of sparse snps; -1 for dense snps
+    vector <int> sparse_start, sparse_indivs; // indivs with non-default genos, indexed by snp
+    vector < vector <int> > indiv_sparse_snps; // sparse snps at which indiv is non-default
+    vector <int> dense_snps;
+
     int num_chroms_used;
     vector <string> jack_ind_ids;
     vector <int> chrom_start_inds;
 
+    // anytime mode (off if both limits are 0); anytime_chroms is fixed by the first run, and
+    // later runs analyze all of them, so the first run gets 1/anytime_num_runs of the time
+    // budget anytime_max_secs (later runs then take about as long each)
+    double anytime_max_secs, anytime_target_se;
+    int anytime_num_runs;
+    vector <int> anytime_chroms;
+
+    // polyache sketch mode (off if 0): Rademacher vectors for estimating the S11^2 terms
+    int polyache_sketches;
+    vector < vector <int> > sketch_signs;
+
+    // per-chrom algorithm selection: chroms to run with the pairwise algorithm in this run;
+    // the per-chrom costs are printed for the first run only
+    bool auto_algo, chrom_algos_printed;
+    vector <char> chrom_use_pairwise;
+
+    // mixed-precision FFT mode (off if 0): max relative error estimate of the binned curve;
+    // error estimates of the last run by chrom (-1 if not computed)
+    double fft_float_tol;
+    vector <double> chrom_fft_float_err;
+
+    // segmented convolution mode (see ConvFFT); transform length used by chrom in the last
+    // run (0: whole chrom)
+    bool segmented_fft;
+    vector <int> chrom_fft_segment;
+
+    // coarser binsizes (multiples of the run binsize) at which to also fit each weighted LD
+    // curve, aggregating the per-chrom sums of the run
+    vector <double> extra_binsizes;
+
+    // fused admixture test (see prepare_fused_test): chrom results of a run computed ahead of
+    // time, used by run() when called with the same arguments
+    struct FusedRun {
+      int num_refs;
+      vector <double> weights;
+      double binsize;
+      int numbins, mincount;
+      vector <char> has_chrom; // chroms not computed by the fused pass are run as usual
+      vector < vector < pair <double, double> > > results_allchrom;
+      vector <AffineData> affine_data_allchrom;
+    };
+    vector <FusedRun> fused_runs;
+
+    // bin-aggregated 2-ref ingestion (see prepare_binned_runs): the per-indiv bin sums of
+    // run_chrom's 2-ref signals, which run() then uses in place of the genotypes
+    struct BinnedRun {
+      vector <double> weights;
+      double binsize;
+      int mincount;
+      int uses; // run() calls left before the sums are freed
+      vector < vector <double> > fx, gy; // by chrom: num_mixed_indivs x numbins_chrom
+    };
+    vector <BinnedRun> binned_runs;
+
+    // per-chrom bin sums of the last run() (see refit_last_run)
+    RunBins last_run;
+
+    // ref LD index (see use_ref_ld_index): index snp of each snp, and the index block of each
+    // ref pop (NULL: compute ref LD from the genotypes)
+    const RefLdIndex *ref_ld_index;
+    vector <int> snp_ld_index;
+    vector <const short *> ref_ld_blocks;
+
+    // per-sample contributions (see set_sample_loo): output file and test indiv ids
+    FILE *sample_loo_file;
+    vector <string> mixed_indiv_ids;
+
+    // run store (see open_run_store): file, settings, and record offsets by run_store_key
+    FILE *run_store;
+    double run_store_binsize;
+    int run_store_numbins, run_store_mincount;
+    bool run_store_naive;
+    long run_store_end;
+    map <unsigned long long, long> run_store_index;
+
     string format_mean_std(pair <double, double> mean_std);
-    double compute_geno_mean(int s, const char *geno, int stride);
-    double compute_ld(int s1, int s2, const char *geno, int stride);
+    double compute_geno_mean(int s, const char *const *rows, int stride);
+    double compute_ld(int s1, int s2, const char *const *rows, int stride);
     double compute_ld(int s1, int s2);
-    double compute_polyache_central_moment11sq(int s1, int s2, const char *geno, int stride);
+    double compute_polyache_central_moment11sq(int s1, int s2, const char *const *rows,
+					       int stride);
     double compute_polyache_central_moment11sq(int s1, int s2);
+    bool pair_is_sparse(int s1, int s2);
+    int sparse_pair_moments(int s1, int s2, double S[3][3]);
+    int dense_pair_moments(int s1, int s2, const char *const *rows, int stride,
+			   double S[3][3]);
+    template <class F> void scatter_default(int chrom, const F &f, double *fx_base);
+    template <class F> void scatter_indiv(int chrom, int i, const F &f, const double *fx_base,
+					  double *fx, int len);
+    template <class F, class G> void scatter_indiv(int chrom, int i, const F &f,
+						   const double *fx_base, double *fx,
+						   const G &g, const double *gy_base, double *gy,
+						   int len);
     bool x2_suff_accurate(pair <double, double> x2_mean_std);
 
     // stores polyache data in:
     // - test_data.count, test_data.sum_x2 and test_data.sum_y2 (same)
     // - ref_data.count, ref_data.sum_x2 and ref_data.sum_y2 (same)
-    void compute_ld_corr_terms(int ref_ind, double bin_min, double bin_max,
+    // returns true if the requested terms were computed over all snp pairs (no early exit)
+    bool compute_ld_corr_terms(int ref_ind, double bin_min, double bin_max,
 			       CorrJack &corr_data, CorrJack &test_data, CorrJack &ref_data,
 			       bool use_early_exit, bool compute_corr_data,
 			       bool compute_polyache_data);
+    void add_ld_corr_layers(int c, int ref_ind, double bin_min, double bin_max, int stride,
+			    int layer_begin, int layer_end, Corr *corr, Corr *test, Corr *ref);
+    // adds the terms of bin b at binsize binsize0 * 2^level to bin by merging complete terms
+    // in cache (indexed by level, then bin); returns false (adding nothing) if unavailable
+    bool aggregate_ld_corr_bin(const vector < map <int, LdCorrBin> > &cache, int level, int b,
+			       bool need_corr, bool need_polyache, LdCorrBin &bin);
     double compute_polyache(int s1, int s2, double pAx, double pAy);
-    void convolve_accum(fftw_plan *plans, int Nby2, fftw_complex *z_accum,
-			fftw_complex *z1, fftw_complex *z2, double scale=1.0);
-    void self_convolve_accum(fftw_plan *plan, int Nby2, fftw_complex *z_accum,
-			     fftw_complex *z1, double scale=1.0);
+    void set_snp_tables(int num_refs, const vector <double> &weights, double binsize,
+			int mincount);
+    // z_accum += scale * (transform of cross-correlation of cf.fx, cf.gy), or of the
+    // autocorrelation of cf.fx; if ff is non-NULL, the transforms are done in single precision
+    // (see FloatFFT); self terms may be deferred until cf.flush()
+    void convolve_accum(ConvFFT &cf, fftw_complex *z_accum, double scale=1.0,
+			FloatFFT *ff=NULL);
+    void self_convolve_accum(ConvFFT &cf, fftw_complex *z_accum, double scale=1.0,
+			     FloatFFT *ff=NULL);
+    // polyache terms of run_chrom that do not involve the weights (see Alder.cpp)
+    void polyache_sketch_terms(int chrom, ConvFFT &cf, fftw_complex *rev_c_arr,
+			       fftw_plan rev_plan, double *rev_r_arr, int numbins,
+			       int numbins_chrom, AffineData &affine_data);
+    void polyache_geno_terms(int chrom, ConvFFT &cf, fftw_complex *rev_c_arr, FloatFFT *ff,
+			     int numbins_chrom, AffineData &affine_data);
     // returns binned pairs: (weighted LD, count of pairs in bin)
     // also, affine_data contains info for computing affine term
+    // allow_float: use single-precision per-indiv transforms if fft_float_tol is set; falls
+    //   back to double if the estimated error exceeds fft_float_tol
+    // binned: (2-ref) take the per-indiv signals from these bin sums instead of the genotypes
     vector < pair <double, double> > run_chrom(int chrom, int num_refs,
 					       const vector <double> &weights, double binsize,
-					       int numbins, int mincount, AffineData &affine_data);
+					       int numbins, int mincount, AffineData &affine_data,
+					       bool allow_float=true,
+					       const BinnedRun *binned=NULL);
+    // computes the 2-ref curve with weights wA - wB and the 1-ref curves with weights wA and
+    // wB (in that order in ans and affine_data) from one scatter and transform pass over the
+    // test pop; requires snp tables set for 1-ref weights wA and chrom_fused_eligible
+    void run_chrom_fused(int chrom, const vector <double> &wA, const vector <double> &wB,
+			 double binsize, int numbins,
+			 vector < vector < pair <double, double> > > &ans,
+			 vector <AffineData> &affine_data);
+    // true if the three runs above use the same snps on the chrom
+    bool chrom_fused_eligible(int chrom, const vector <double> &wA, const vector <double> &wB,
+			      int mincount);
     vector < pair <double, double> > run_chrom_naive(int chrom, int num_refs,
 						     const vector <double> &weights,
 						     double binsize, int numbins, int mincount);
-    pair <double, double> compute_inter_chrom_affine(const vector <AffineData> &affdats);
+    bool chrom_pairwise_eligible(int chrom, const vector <double> &weights, int mincount);
+    void select_chrom_algos(int num_refs, const vector <double> &weights, int numbins,
+			    int mincount);
+    void compute_affine_data(int chrom, int num_refs, const vector <double> &weights,
+			     AffineData &affine_data);
+    vector < pair <double, double> > run_chrom_selected(int chrom, int num_refs,
+							const vector <double> &weights,
+							double binsize, int numbins, int mincount,
+							bool use_naive_algo,
+							AffineData &affine_data);
+    // (skip_indiv: 2-ref, leave out this test indiv)
+    pair <double, double> compute_inter_chrom_affine(const vector <AffineData> &affdats,
+						     int skip_indiv=-1);
     void check_affine_amp(int num_refs, const vector <double> &weights);
+    void write_affine_data(FILE *f, const AffineData &affine_data);
+    bool read_affine_data(FILE *f, AffineData &affine_data);
+    unsigned long long run_store_key(int num_refs, const vector <double> &weights);
+    bool read_run_record(RunBins &bins);
+    // stored run with these weights and settings, if any
+    bool read_stored_run(int num_refs, const vector <double> &weights, double binsize,
+			 int numbins, int mincount, bool use_naive_algo, RunBins &bins);
+    // appends the run unless already stored or the settings differ from the store's
+    void write_stored_run(int num_refs, const vector <double> &weights, double binsize,
+			  int numbins, int mincount, bool use_naive_algo,
+			  const vector <int> &ref_inds, const RunBins &bins);
+    // false if the affine term can't be computed from inter-chrom data (warns if verbose)
+    bool inter_chrom_affine_ok(bool use_naive_algo, int num_chroms, bool verbose);
+    void print_run_header(int num_refs, const vector <int> &ref_inds, int mincount,
+			  bool use_naive_algo);
     ExpFitALD exp_fit_jackknife(const vector <AlderResults> &results_jackknife,
 				double mindis, double maxdis);
     vector <AlderResults> make_results(
         const vector < vector < pair <double, double> > > &results_allchrom,
         const vector <AffineData> &affine_data_allchrom, double binsize, bool use_naive_algo,
-	double fit_start_dis);
+	double fit_start_dis, const vector <int> &chroms, bool verbose=true);
+    vector <int> run_chroms_anytime(int num_refs, const vector <double> &weights, double binsize,
+				    int numbins, int mincount, bool use_naive_algo,
+				    double fit_start_dis, double maxdis,
+				    vector < vector < pair <double, double> > > &results_allchrom,
+				    vector <AffineData> &affine_data_allchrom);
+    void add_sketch_var(const vector < vector < pair <double, double> > > &results_allchrom,
+			const vector <AffineData> &affine_data_allchrom, double binsize,
+			double fit_start_dis, double maxdis, const vector <int> &chroms,
+			vector <ExpFitALD> &fits_all_starts, int fit_test_ind);
     vector <ExpFitALD> fit_results(const vector <AlderResults> &results_jackknife,
 				   double fit_start_dis, double maxdis, int &fit_test_ind);
-    void count_alleles(const char *geno, int stride, int s, double &a, double &b);
-    vector <double> compute_f2_jacks(const char *geno1, int stride1,
-				     const char *geno2, int stride2);
+    void fit_extra_binsizes(const vector < vector < pair <double, double> > > &results_allchrom,
+			    const vector <AffineData> &affine_data_allchrom, double binsize,
+			    bool use_naive_algo, double fit_start_dis, double maxdis,
+			    const vector <int> &chroms);
+    AlderResults make_loo_results(const RunBins &bins, double fit_start_dis, int skip_indiv);
+    void report_sample_loo(const vector <int> &ref_inds, const RunBins &bins,
+			   double fit_start_dis, double maxdis,
+			   const vector <ExpFitALD> &fits_all_starts, int fit_test_ind);
+    void count_alleles(const char *const *rows, int stride, int s, double &a, double &b);
+    vector <double> compute_f2_jacks(const char *const *rows1, int stride1,
+				     const char *const *rows2, int stride2);
 
   public:
-    Alder(char *_mixed_geno, int _num_mixed_indivs, const string &_mixed_pop_name,
-	 const vector <char *> &_ref_genos, const vector <int> &_num_ref_indivs,
-	 const vector <string> &_ref_pop_names, const vector < pair <int, double> > &snp_locs,
-	 Timer &_timer);  
+    static const double MAX_LD_CORR_DIST; // farthest snp pairs used for LD correlation
+
+    Alder(GenoStream &_geno, int _num_mixed_indivs, const string &_mixed_pop_name,
+	  const vector <int> &_num_ref_indivs, const vector <string> &_ref_pop_names,
+	  const vector < pair <int, double> > &snp_locs, Timer &_timer);
     int get_num_chroms_used(void);
+    // anytime mode: stop analyzing chroms after max_secs seconds or once the decay rate
+    // standard error falls below target_decay_se (0 = no limit); later runs reuse the
+    // chroms analyzed by the first run so that jackknife reps stay comparable
+    void set_anytime(double max_secs, double target_decay_se);
+    // number of weighted LD runs sharing the anytime time budget (default 1)
+    void set_anytime_num_runs(int num_runs);
+    // approximate the polyache terms quadratic in the number of test indivs using
+    // num_sketches random projections (0 = exact); sketch noise is added to jackknife stds
+    void set_polyache_sketches(int num_sketches);
+    // choose between the FFT and pairwise algorithms per chrom using a cost model (only for
+    // chroms without missing data, where the two give the same results)
+    void set_auto_algo(bool _auto_algo);
+    // compute the per-indiv FFTs in single precision (accumulating in double), checking one
+    // term per chrom in both precisions; chroms whose estimated relative error exceeds tol
+    // are recomputed in double precision (tol = 0: always double)
+    void set_fft_float(double tol);
+    // 2-ref: on chroms where it is cheaper, accumulate the convolutions over blocks of a few
+    // times maxdis/binsize bins (overlap-save) rather than transforming whole chroms, so that
+    // transform length and memory depend on maxdis/binsize, not chrom length (results agree
+    // up to rounding; not with the single-precision FFT or sample_loo options)
+    void set_segmented_fft(bool _segmented_fft);
+    // after each run, also fit the curve at these coarser binsizes (in Morgans, each an integer
+    // multiple of the run binsize), summing the fine-bin data of the run rather than
+    // recomputing
+    void set_extra_binsizes(const vector <double> &binsizes);
+    // 2-ref runs: keep each test indiv's contribution to the bin sums (one more forward and
+    // inverse transform per indiv), and after each run write the fit of the curve leaving out
+    // each indiv to the file (not for fused, anytime, auto_algo, naive or single-precision
+    // FFT runs, or runs from the run store)
+    void set_sample_loo(const char *filename, const vector <string> &indiv_ids);
+    void close_sample_loo(void);
+    // admixture test: computes the chrom results of the 2-ref run with weights wA - wB and of
+    // the 1-ref runs with weights wA and wB in one pass (see run_chrom_fused); the following
+    // run() calls with these weights and settings use them instead of recomputing
+    // (not available with the naive, auto_algo, anytime or single-precision FFT options)
+    void prepare_fused_test(const vector <double> &wA, const vector <double> &wB,
+			    double maxdis, double binsize, int mincount, bool use_naive_algo);
+    // 2-ref: streams the genotypes once, summing each indiv's weighted signals of run_chrom
+    // into bins for each of the weight sets (repeats allowed); the following run() calls
+    // with these weights and settings need no genotype pass (same results; not available
+    // with the naive, auto_algo, anytime or single-precision FFT options)
+    void prepare_binned_runs(const vector < vector <double> > &weight_sets, double binsize,
+			     int mincount, bool use_naive_algo);
+    // memory taken by the bin sums of one weight set of prepare_binned_runs
+    double binned_run_bytes(double binsize) const;
+    // writes an index of the ref pops' LD at all snp pairs within the LD correlation range
+    // (see RefLdIndex)
+    void build_ref_ld_index(const char *filename);
+    // LD correlation: take ref LD from the index for the ref pops it has with the same data
+    // (values are quantized; see RefLdIndex) instead of computing it
+    void use_ref_ld_index(const RefLdIndex &index);
     vector <double> find_ld_corr_stops(double binsize, bool use_early_exit, double mindis);
+    // LD correlation extent of ref pop r; its output at each binsize level goes to level_logs
+    // (find_ld_corr_stops prints these for all refs, then the summary)
+    double find_ld_corr_stop(int r, double binsize0, bool use_early_exit,
+			     vector <string> &level_logs);
+    // prints the summary of find_ld_corr_stop results; returns the fit starts by ref
+    vector <double> summarize_ld_corr_stops(const vector <double> &ld_corr_stops);
+    static double ld_corr_fit_start(double ld_corr_stop);
     // computes weighted LD on each chromosome; returns vector of results from jackknife runs
     // fit data is stored in fits_all_starts
     // ref_inds tells which ref pops are being used, just for the purpose of output
@@ -124,7 +471,49 @@ namespace ALD {
 	int num_refs, const vector <int> &ref_inds, const vector <double> &weights, double maxdis,
 	double binsize, int mincount, bool use_naive_algo, double fit_start_dis,
 	vector <ExpFitALD> &fits_all_starts, int &fit_test_ind);
+    // persistent store of the per-chrom bin sums of runs (keyed by their weights, with the
+    // data and these settings recorded in the file): run() reuses a stored run with the same
+    // weights instead of computing it, and appends the runs it computes, so that extending a
+    // ref panel only computes the pairs with new refs (reopening with other data or settings
+    // starts the file over)
+    void open_run_store(const char *filename, double maxdis, double binsize, int mincount,
+			bool use_naive_algo);
+    void close_run_store(void);
+    bool find_stored_run(int num_refs, const vector <double> &weights, double maxdis,
+			 double binsize, int mincount, bool use_naive_algo, RunBins &bins) {
+      return read_stored_run(num_refs, weights, binsize, (int) (maxdis / binsize), mincount,
+			     use_naive_algo, bins);
+    }
+    // run() in three stages for pipelining runs (no fused, binned, anytime, auto_algo or
+    // single-precision FFT options): compute_run_bins (the chrom pass) and fit_run_bins are
+    // silent and may run concurrently on separate copies of this object; report_run_bins
+    // then prints what run() would and finishes the fits on the original
+    RunBins compute_run_bins(int num_refs, const vector <double> &weights, double maxdis,
+			     double binsize, int mincount, bool use_naive_algo);
+    vector <AlderResults> fit_run_bins(const RunBins &bins, double fit_start_dis,
+				       double maxdis, vector <ExpFitALD> &fits_all_starts,
+				       int &fit_test_ind);
+    // (from_store: bins found by find_stored_run; others are added to the run store, if open)
+    void report_run_bins(int num_refs, const vector <int> &ref_inds,
+			 const vector <double> &weights, int mincount, const RunBins &bins,
+			 bool from_store, const vector <AlderResults> &results_jackknife,
+			 double fit_start_dis, double maxdis, vector <ExpFitALD> &fits_all_starts,
+			 int &fit_test_ind);
+    // parameter sweep: results and fits of the last run() at a multiple of its binsize, a
+    // maxdis up to its maxdis and/or a subset of its chroms (by label; empty sets: all),
+    // aggregated from its per-chrom bin sums instead of recomputing
+    vector <AlderResults> refit_last_run(double binsize, double maxdis,
+					 const set <int> &chrom_set,
+					 const set <int> &nochrom_set, double fit_start_dis,
+					 vector <ExpFitALD> &fits_all_starts, int &fit_test_ind);
+    // approximate admixture test z-score from a cheap pass (coarse bins, sampled chroms)
+    double screen_admixture_zscore(int num_refs, const vector <double> &weights, double maxdis,
+				   double binsize, int mincount, double fit_start_dis,
+				   int chrom_stride);
     double compute_mult_hyp_corr(const vector <bool> &refs_to_use);
+    // refs (in order picked) whose allele freqs span var_frac of the variance of all refs' freqs
+    // (at least 2 if there are 2 refs, so that there is a pair to run)
+    vector <int> select_representative_refs(double var_frac);
     vector <double> compute_one_ref_f2_jacks(int ref_ind);
   };  
 }
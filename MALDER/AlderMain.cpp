@@ -54,6 +54,7 @@
 #include "AlderParams.hpp"
 #include "Alder.hpp"
 #include "ProcessInput.hpp"
+#include "CpuKernels.hpp"
 
 using namespace std;
 using namespace ALD;
@@ -107,34 +108,48 @@ int main(int argc, char *argv[]) {
   pars.readcommands(argc, argv, VERSION);
   omp_set_num_threads(pars.num_threads);
   verbose = pars.verbose;
+  if (!select_cpu_kernels(pars.cpu_isa))
+    fatalx("cpu_isa %s is not supported on this machine (detected: %s)\n", pars.cpu_isa,
+	   detect_cpu_isa());
+  cout << "CPU kernels: " << cpu_kernels.isa << " (detected: " << detect_cpu_isa() << ")" << endl;
 
   // ----------------------------------- process input ------------------------------------ //
 
   cout << "                        *** Processing data ***" << endl << endl;
 
-  Indiv **indivmarkers;
-  SNP **snpmarkers ;
+  // the indiv file is read on its own thread while the snp file is read
+  ProcessInput::IndivTable indivs;
+  ProcessInput::IndivLoader indiv_loader(pars.indivname, indivs);
+  ProcessInput::SnpTable snps;
+  vector < pair <int, double> > snp_locs =
+    ProcessInput::process_snps(pars.snpname, pars.badsnpname, pars.fast_snp_read, snps,
+			       pars.checkmap, pars.chrom_set, pars.nochrom_set);
+  indiv_loader.wait();
+
   int num_mixed_indivs; string mixed_pop_name;
   vector <int> num_ref_indivs; vector <string> ref_pop_names;
   vector <int> indiv_pop_inds =
-    ProcessInput::process_indivs(pars.indivname, &indivmarkers, pars.admixlist, pars.admixpop,
+    ProcessInput::process_indivs(indivs, pars.admixlist, pars.admixpop,
 				 pars.refpops, pars.poplistname, num_mixed_indivs, mixed_pop_name,
 				 num_ref_indivs, ref_pop_names);
   if (pars.mincount > num_mixed_indivs) fatalx("mincount must be <= num mixed indivs\n");
 
-  int orig_numsnps;
-  vector < pair <int, double> > snp_locs =
-    ProcessInput::process_snps(pars.snpname, pars.badsnpname, pars.fast_snp_read, &snpmarkers,
-			       pars.checkmap, orig_numsnps, pars.chrom_set, pars.nochrom_set);
-
-  char *mixed_geno = new char[snp_locs.size() * num_mixed_indivs];
-  vector <char *> ref_genos(num_ref_indivs.size());
-  for (int r = 0; r < (int) num_ref_indivs.size(); r++)
-    ref_genos[r] = new char[snp_locs.size() * num_ref_indivs[r]];
-
-  vector < vector <double> > ref_freqs =
-    ProcessInput::process_geno(pars.genotypename, indiv_pop_inds, mixed_geno, ref_genos,
-			       snpmarkers, orig_numsnps);
+  GenoStream geno;
+  char *mixed_geno = NULL;
+  vector <char *> ref_genos(num_ref_indivs.size(), (char *) NULL);
+  vector < vector <double> > ref_freqs;
+  if (pars.stream_geno)
+    ref_freqs = ProcessInput::process_geno(pars.genotypename, indiv_pop_inds, snps,
+					   pars.stream_cache == NULL ? "" : pars.stream_cache,
+					   geno);
+  else {
+    mixed_geno = new char[snp_locs.size() * num_mixed_indivs];
+    for (int r = 0; r < (int) num_ref_indivs.size(); r++)
+      ref_genos[r] = new char[snp_locs.size() * num_ref_indivs[r]];
+    ref_freqs = ProcessInput::process_geno(pars.genotypename, indiv_pop_inds, mixed_geno,
+					   ref_genos, snps);
+    geno.set_memory(mixed_geno, num_mixed_indivs, ref_genos, num_ref_indivs, snp_locs.size());
+  }
   
   // ----------------------- determine number of refs; set weights ------------------------ //
 
@@ -143,7 +158,7 @@ int main(int argc, char *argv[]) {
   int num_ref_freqs = ref_freqs.size(); // num_ref_freqs is the number of ref pops with geno data
   vector <int> ref_inds;
   if (pars.weightname != NULL) { // load external weights
-    weights = ProcessInput::process_weights(pars.weightname, snpmarkers, orig_numsnps);
+    weights = ProcessInput::process_weights(pars.weightname, snps);
     num_alder_refs = 2;
   }
   else {
@@ -174,8 +189,12 @@ int main(int argc, char *argv[]) {
     cout << "number of reference populations: " << num_ref_freqs << endl;
   }
 
-  Alder alder(mixed_geno, num_mixed_indivs, mixed_pop_name, ref_genos, num_ref_indivs,
-	     ref_pop_names, snp_locs, timer);
+  Alder alder(geno, num_mixed_indivs, mixed_pop_name, num_ref_indivs, ref_pop_names, snp_locs,
+	      timer);
+  alder.set_polyache_sketches(pars.polyache_sketches);
+  alder.set_auto_algo(pars.auto_algo);
+  alder.set_fft_float(pars.fft_float ? pars.fft_float_tol : 0);
+  alder.set_extra_binsizes(pars.extra_binsize_list);
   if (alder.get_num_chroms_used() < 2 && pars.print_raw_jackknife)
     cout << "WARNING: jackknife = YES, but need data from >= 2 chroms to jackknife" << endl;
 
@@ -206,6 +225,13 @@ int main(int argc, char *argv[]) {
     // ------------ compute weighted LD curve (1-ref or 2-ref as appropriate) ------------- //
 
     printhline();
+    if (pars.fused_test && num_alder_refs == 2 && !ref_inds.empty() &&
+	alder.get_num_chroms_used() >= 2) // all three curves of the admixture test in one pass
+      alder.prepare_fused_test(ref_freqs[0], ref_freqs[1], pars.maxdis, pars.binsize,
+			       pars.mincount, pars.use_naive_algo);
+    if (pars.bin_ingest && num_alder_refs == 2)
+      alder.prepare_binned_runs(vector < vector <double> > (1, weights), pars.binsize,
+				pars.mincount, pars.use_naive_algo);
     vector <ExpFitALD> fits_all_starts; int fit_test_ind = 0;
     vector <AlderResults> results_jackknife =
       alder.run(num_alder_refs, ref_inds, weights, pars.maxdis, pars.binsize, pars.mincount,
@@ -1,5 +1,9 @@
 #include <set>
+#include <vector>
 #include <fstream>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 
 #include "MiscUtils.hpp" // these have to be included before Nick's... some compiler error o/w
 #include "AlderParams.hpp"
@@ -46,6 +50,7 @@ namespace ALD {
     check_file_readable_if_specified(admixlist);
     check_file_readable_if_specified(poplistname);
     check_file_readable_if_specified(weightname);
+    check_file_readable_if_specified(sweepname);
     if (raw_outname != NULL) check_file_writable(raw_outname);
 
     if ((weightname != NULL) + (poplistname != NULL) + (refpops != NULL) > 1)
@@ -66,14 +71,69 @@ namespace ALD {
     if (mincount < 2)
       fatalx("mincount param must be at least 2 to compute LD\n") ;
 
-    if (fast_snp_read && badsnpname != NULL)
-      fatalx("cannot do fast_snp_read if badsnpname specified\n") ;
-    
     if (chrom != NULL && nochrom != NULL)
       fatalx("cannot specify both chrom list and nochrom list\n");
+
+    if (max_chrom < 1)
+      fatalx("max_chrom must be at least 1\n");
+
+    if (rep_refs_var < 0 || rep_refs_var > 1)
+      fatalx("rep_refs_var must be between 0 and 1\n");
+    if (rep_refs_pin != NULL && !(rep_refs_var > 0))
+      fatalx("rep_refs_pin requires rep_refs_var\n");
+    if (pack_contigs < 0)
+      fatalx("pack_contigs must be non-negative\n");
+    if (speculative_mixfit < 1)
+      fatalx("speculative_mixfit must be at least 1\n");
+    if (prescreen) {
+      if (!(prescreen_binsize > 0))
+	fatalx("prescreen_binsize must be positive\n");
+      if (prescreen_chrom_stride < 1)
+	fatalx("prescreen_chrom_stride must be at least 1\n");
+      if (prescreen_margin < 0)
+	fatalx("prescreen_margin must be non-negative\n");
+    }
+
+    if (max_run_time < 0 || target_decay_se < 0)
+      fatalx("max_run_time and target_decay_se must be non-negative\n");
+
+    if (polyache_sketches < 0 || polyache_sketches == 1)
+      fatalx("polyache_sketches must be 0 (exact) or at least 2\n");
+
+    if (fft_float && fft_float_tol <= 0)
+      fatalx("fft_float_tol must be positive\n");
+
+    if (bin_ingest && bin_ingest_mb <= 0)
+      fatalx("bin_ingest_mb must be positive\n");
+
+    if (stream_cache != NULL && !stream_geno)
+      fatalx("stream_cache requires stream_geno: YES\n");
+
+    if (ref_ld_index_build && ref_ld_index == NULL)
+      fatalx("ref_ld_index_build requires ref_ld_index\n");
+
+    if (strcmp(cpu_isa, "auto") != 0 && strcmp(cpu_isa, "generic") != 0
+	&& strcmp(cpu_isa, "avx2") != 0 && strcmp(cpu_isa, "avx512") != 0)
+      fatalx("cpu_isa must be auto, generic, avx2, or avx512\n");
+
+    if (extra_binsizes != NULL) {
+      extra_binsize_list = parse_to_dbl_list(extra_binsizes);
+      check_extra_binsizes(binsize);
+    }
+  }
+
+  // extra_binsizes are binsizes (in Morgans), each an integer multiple (>= 2x) of the binsize
+  // of the runs they are derived from
+  void AlderParams::check_extra_binsizes(double run_binsize) {
+    for (int i = 0; i < (int) extra_binsize_list.size(); i++) {
+      double k = extra_binsize_list[i] / run_binsize;
+      if (k < 1.5 || fabs(k - floor(k+0.5)) > 1e-6)
+	fatalx("extra_binsizes: %g is not an integer multiple (>= 2x) of binsize %g\n",
+	       extra_binsize_list[i], run_binsize);
+    }
   }
 
-  std::set <int> AlderParams::parse_to_set(char *str) {
+  std::set <int> AlderParams::parse_to_set(char *str, bool print) {
     for (int i = 0; i < (int) strlen(str); i++)
       if (!(str[i] == ';' || isdigit(str[i])))
 	fatalx("chrom and nochrom strings must be semicolon-delimited int lists\n");
@@ -83,12 +143,71 @@ namespace ALD {
 	int c; sscanf(str+i, "%d", &c);
 	ret.insert(c);
       }
-    for (std::set <int>::iterator it = ret.begin(); it != ret.end(); it++)
-      printf("%d ", *it);
-    printf("\n");
+    if (print) {
+      for (std::set <int>::iterator it = ret.begin(); it != ret.end(); it++)
+	printf("%d ", *it);
+      printf("\n");
+    }
+    return ret;
+  }
+
+  std::vector <double> AlderParams::parse_to_dbl_list(char *str) {
+    std::vector <double> ret;
+    char *end = str;
+    while (*end != '\0') {
+      char *start = end;
+      ret.push_back(strtod(start, &end));
+      if (end == start || !(*end == ';' || *end == '\0'))
+	fatalx("extra_binsizes string must be a semicolon-delimited list of numbers\n");
+      if (*end == ';') end++;
+    }
     return ret;
   }
 
+  // one configuration per line: whitespace-separated overrides key=value of binsize, maxdis,
+  // mincount, chrom or nochrom (unspecified: the main settings); '#' starts a comment
+  void AlderParams::parse_sweep_file(void) {
+    std::ifstream fin(sweepname);
+    std::string line;
+    while (getline(fin, line)) {
+      if (line.find('#') != std::string::npos) line = line.substr(0, line.find('#'));
+      std::vector <std::string> toks;
+      char buf[line.size()+1];
+      strcpy(buf, line.c_str());
+      for (char *tok = strtok(buf, " \t\r"); tok != NULL; tok = strtok(NULL, " \t\r"))
+	toks.push_back(tok);
+      if (toks.empty()) continue;
+      SweepConfig config;
+      config.binsize = binsize; config.maxdis = maxdis; config.mincount = mincount;
+      for (int t = 0; t < (int) toks.size(); t++) {
+	size_t eq = toks[t].find('=');
+	if (eq == std::string::npos)
+	  fatalx("sweep file: expected key=value, got %s\n", toks[t].c_str());
+	std::string key = toks[t].substr(0, eq);
+	char val[toks[t].size()];
+	strcpy(val, toks[t].c_str() + eq + 1);
+	if (key == "binsize") config.binsize = atof(val);
+	else if (key == "maxdis") config.maxdis = atof(val);
+	else if (key == "mincount") config.mincount = atoi(val);
+	else if (key == "chrom") config.chrom_set = parse_to_set(val, false);
+	else if (key == "nochrom") config.nochrom_set = parse_to_set(val, false);
+	else
+	  fatalx("sweep file: unknown key %s (expected binsize, maxdis, mincount, chrom or"
+		 " nochrom)\n", key.c_str());
+	config.desc += (t ? " " : "") + toks[t];
+      }
+      if (config.binsize <= 0 || config.maxdis <= config.binsize)
+	fatalx("sweep file: need 0 < binsize < maxdis (%s)\n", config.desc.c_str());
+      if (config.mincount < 2)
+	fatalx("sweep file: mincount must be at least 2 (%s)\n", config.desc.c_str());
+      if (!config.chrom_set.empty() && !config.nochrom_set.empty())
+	fatalx("sweep file: cannot specify both chrom and nochrom (%s)\n", config.desc.c_str());
+      check_extra_binsizes(config.binsize); // (then also multiples of the shared run binsize)
+      sweep_configs.push_back(config);
+    }
+    if (sweep_configs.empty()) fatalx("sweep file has no configurations: %s\n", sweepname);
+  }
+
   void AlderParams::print_param_settings(void) {
     printf("---------- parameter settings used (with defaults for unspecified) ----------\n");
     printf("\nInput data files:\n");
@@ -113,12 +232,16 @@ namespace ALD {
     printf("%20s: %d\n", "mincount", mincount);
     if (chrom != NULL) printf("%20s: %s\n", "chrom", chrom);
     if (nochrom != NULL) printf("%20s: %s\n", "nochrom", nochrom);
+    if (max_chrom != 22) printf("%20s: %d\n", "max_chrom", max_chrom);
   
     printf("\nCurve fitting:\n");
     printf("%20s: %f\n", "binsize", binsize);
+    if (extra_binsizes != NULL) printf("%20s: %s\n", "extra_binsizes", extra_binsizes);
     printf("%20s: %f\n", "mindis", mindis);
     printf("%20s: %f\n", "maxdis", maxdis);
     printf("%20s: %s\n", "bootstrap", bootstrap ? "YES": "NO");
+    if (sweepname != NULL) printf("%20s: %s\n", "sweepname", sweepname);
+    if (pack_contigs > 0) printf("%20s: %f\n", "pack_contigs", pack_contigs);
   
     printf("\nInput checks:\n");
     printf("%20s: %s\n", "fast_snp_read", fast_snp_read ? "YES" : "NO");
@@ -128,6 +251,48 @@ namespace ALD {
     printf("%20s: %d\n", "num_threads", num_threads);
     printf("%20s: %s\n", "approx_ld_corr", approx_ld_corr ? "YES" : "NO");
     printf("%20s: %s\n", "use_naive_algo", use_naive_algo ? "YES" : "NO");
+    printf("%20s: %s\n", "auto_algo", auto_algo ? "YES" : "NO");
+    printf("%20s: %s\n", "prescreen", prescreen ? "YES" : "NO");
+    if (prescreen) {
+      printf("%20s: %f\n", "prescreen_binsize", prescreen_binsize);
+      printf("%20s: %d\n", "prescreen_chrom_stride", prescreen_chrom_stride);
+      printf("%20s: %f\n", "prescreen_margin", prescreen_margin);
+    }
+    if (rep_refs_var > 0) {
+      printf("%20s: %f\n", "rep_refs_var", rep_refs_var);
+      if (rep_refs_pin != NULL)
+	printf("%20s: %s\n", "rep_refs_pin", rep_refs_pin);
+    }
+    if (polyache_sketches)
+      printf("%20s: %d\n", "polyache_sketches", polyache_sketches);
+    printf("%20s: %s\n", "fft_float", fft_float ? "YES" : "NO");
+    printf("%20s: %s\n", "segmented_fft", segmented_fft ? "YES" : "NO");
+    if (fft_float)
+      printf("%20s: %g\n", "fft_float_tol", fft_float_tol);
+    printf("%20s: %s\n", "fused_test", fused_test ? "YES" : "NO");
+    printf("%20s: %s\n", "stream_geno", stream_geno ? "YES" : "NO");
+    if (stream_cache != NULL)
+      printf("%20s: %s\n", "stream_cache", stream_cache);
+    printf("%20s: %s\n", "bin_ingest", bin_ingest ? "YES" : "NO");
+    if (bin_ingest)
+      printf("%20s: %g\n", "bin_ingest_mb", bin_ingest_mb);
+    printf("%20s: %s\n", "pipeline", pipeline ? "YES" : "NO");
+    printf("%20s: %s\n", "online_mixfit", online_mixfit ? "YES" : "NO");
+    if (speculative_mixfit > 1)
+      printf("%20s: %d\n", "speculative_mixfit", speculative_mixfit);
+    if (run_store != NULL)
+      printf("%20s: %s\n", "run_store", run_store);
+    if (sample_loo != NULL)
+      printf("%20s: %s\n", "sample_loo", sample_loo);
+    if (ref_ld_index != NULL) {
+      printf("%20s: %s\n", "ref_ld_index", ref_ld_index);
+      printf("%20s: %s\n", "ref_ld_index_build", ref_ld_index_build ? "YES" : "NO");
+    }
+    printf("%20s: %s\n", "cpu_isa", cpu_isa);
+    if (max_run_time > 0 || target_decay_se > 0) {
+      printf("%20s: %f\n", "max_run_time", max_run_time);
+      printf("%20s: %f\n", "target_decay_se", target_decay_se);
+    }
     
     printf("\n");
   }
@@ -153,12 +318,42 @@ namespace ALD {
     verbose = NO ;
     num_threads = 1 ;
     use_naive_algo = false ;
+    auto_algo = false ;
     fast_snp_read = false ;
     approx_ld_corr = true ;
     chrom = NULL ;
     nochrom = NULL ;
+    max_chrom = 22 ;
+    extra_binsizes = NULL ;
+    cpu_isa = (char *) "auto" ;
     print_jackknife_fits = false ;
     bootstrap = false;
+    prescreen = false ;
+    prescreen_binsize = 0.002 ;
+    prescreen_chrom_stride = 2 ;
+    prescreen_margin = 2.0 ;
+    rep_refs_var = 0 ;
+    rep_refs_pin = NULL ;
+    max_run_time = 0 ;
+    target_decay_se = 0 ;
+    polyache_sketches = 0 ;
+    fft_float = false ;
+    segmented_fft = false ;
+    online_mixfit = false ;
+    speculative_mixfit = 1 ;
+    fft_float_tol = 1e-3 ;
+    fused_test = false ;
+    stream_geno = false ;
+    stream_cache = NULL ;
+    pipeline = false ;
+    run_store = NULL ;
+    ref_ld_index = NULL ;
+    sample_loo = NULL ;
+    ref_ld_index_build = false ;
+    bin_ingest = false ;
+    bin_ingest_mb = 1024 ;
+    sweepname = NULL ;
+    pack_contigs = 0 ;
   }
 
   void AlderParams::readcommands(int argc, char **argv, const char *VERSION) {
@@ -208,13 +403,53 @@ namespace ALD {
     getint(ph, "num_threads:", &num_threads) ;
     int use_naive_algo_int = NO, fast_snp_read_int = NO, approx_ld_corr_int = YES, bootstrap_int = NO;
     getint(ph, "use_naive_algo:", &use_naive_algo_int) ; use_naive_algo = use_naive_algo_int==YES;
+    int auto_algo_int = NO;
+    getint(ph, "auto_algo:", &auto_algo_int) ; auto_algo = auto_algo_int==YES;
     getint(ph, "fast_snp_read:", &fast_snp_read_int) ; fast_snp_read = fast_snp_read_int==YES;
     getint(ph, "approx_ld_corr:", &approx_ld_corr_int) ; approx_ld_corr = approx_ld_corr_int==YES;
     getint(ph, "bootstrap:", &bootstrap_int) ; bootstrap = bootstrap_int==YES;
     getstring(ph, "chrom:", &chrom) ;
     getstring(ph, "nochrom:", &nochrom) ;
+    getint(ph, "max_chrom:", &max_chrom) ;
+    getstring(ph, "extra_binsizes:", &extra_binsizes) ;
+    getstring(ph, "cpu_isa:", &cpu_isa) ;
     int print_jackknife_fits_int = NO;
     getint(ph, "print_jackknife_fits:", &print_jackknife_fits_int) ; print_jackknife_fits = print_jackknife_fits_int==YES;
+    int prescreen_int = NO;
+    getint(ph, "prescreen:", &prescreen_int) ; prescreen = prescreen_int==YES;
+    getdbl(ph, "prescreen_binsize:", &prescreen_binsize) ;
+    getint(ph, "prescreen_chrom_stride:", &prescreen_chrom_stride) ;
+    getdbl(ph, "prescreen_margin:", &prescreen_margin) ;
+    getdbl(ph, "rep_refs_var:", &rep_refs_var) ;
+    getstring(ph, "rep_refs_pin:", &rep_refs_pin) ;
+    getdbl(ph, "max_run_time:", &max_run_time) ;
+    getdbl(ph, "target_decay_se:", &target_decay_se) ;
+    getint(ph, "polyache_sketches:", &polyache_sketches) ;
+    int fft_float_int = NO;
+    getint(ph, "fft_float:", &fft_float_int) ; fft_float = fft_float_int==YES;
+    int segmented_fft_int = NO;
+    getint(ph, "segmented_fft:", &segmented_fft_int) ; segmented_fft = segmented_fft_int==YES;
+    getdbl(ph, "fft_float_tol:", &fft_float_tol) ;
+    int fused_test_int = NO;
+    getint(ph, "fused_test:", &fused_test_int) ; fused_test = fused_test_int==YES;
+    int stream_geno_int = NO;
+    getint(ph, "stream_geno:", &stream_geno_int) ; stream_geno = stream_geno_int==YES;
+    getstring(ph, "stream_cache:", &stream_cache) ;
+    int bin_ingest_int = NO;
+    getint(ph, "bin_ingest:", &bin_ingest_int) ; bin_ingest = bin_ingest_int==YES;
+    getdbl(ph, "bin_ingest_mb:", &bin_ingest_mb) ;
+    int pipeline_int = NO;
+    getint(ph, "pipeline:", &pipeline_int) ; pipeline = pipeline_int==YES;
+    int online_mixfit_int = NO;
+    getint(ph, "online_mixfit:", &online_mixfit_int) ; online_mixfit = online_mixfit_int==YES;
+    getint(ph, "speculative_mixfit:", &speculative_mixfit) ;
+    getstring(ph, "run_store:", &run_store) ;
+    getstring(ph, "sample_loo:", &sample_loo) ;
+    getstring(ph, "ref_ld_index:", &ref_ld_index) ;
+    int ref_ld_index_build_int = NO;
+    getint(ph, "ref_ld_index_build:", &ref_ld_index_build_int) ; ref_ld_index_build = ref_ld_index_build_int==YES;
+    getstring(ph, "sweepname:", &sweepname) ;
+    getdbl(ph, "pack_contigs:", &pack_contigs) ;
     
 
     check_pars();
@@ -233,6 +468,17 @@ namespace ALD {
       printf("parsing chromosomes to ignore:");
       nochrom_set = parse_to_set(nochrom);
     }
+    if (rep_refs_pin != NULL) {
+      std::string pins(rep_refs_pin);
+      for (size_t start = 0; start <= pins.size(); ) {
+	size_t end = pins.find(';', start);
+	if (end == std::string::npos) end = pins.size();
+	if (end > start) rep_refs_pin_list.push_back(pins.substr(start, end-start));
+	start = end+1;
+      }
+    }
+    if (sweepname != NULL)
+      parse_sweep_file();
     printhline();
   }
 }
@@ -2,16 +2,29 @@
 #define ALDERPARAMS_HPP
 
 #include <set>
+#include <vector>
+#include <string>
 
 namespace ALD {
 
+  // one configuration of a parameter sweep (see sweepname)
+  struct SweepConfig {
+    double binsize, maxdis;
+    int mincount;
+    std::set <int> chrom_set, nochrom_set; // subset of the chroms loaded (empty: all)
+    std::string desc;
+  };
+
   class AlderParams {
 
     void check_file_readable(const char *filename);
     void check_file_readable_if_specified(const char *filename);
     void check_file_writable(const char *filename);
     void check_pars(void);
-    std::set <int> parse_to_set(char *str);
+    void check_extra_binsizes(double run_binsize);
+    std::set <int> parse_to_set(char *str, bool print=true);
+    std::vector <double> parse_to_dbl_list(char *str);
+    void parse_sweep_file(void);
     void print_param_settings(void);
 
   public:
@@ -22,13 +35,41 @@ namespace ALD {
     static const int DEFAULT_MINCOUNT;
 
     char *genotypename, *snpname, *indivname, *badsnpname, *poplistname, *refpops, *admixpop,
-      *admixlist, *raw_outname, *weightname, *chrom, *nochrom;
+      *admixlist, *raw_outname, *weightname, *chrom, *nochrom, *extra_binsizes, *cpu_isa;
     int mincount;
     double mindis, maxdis, binsize; 
     int checkmap, verbose, num_threads;
-    bool print_raw_jackknife, use_naive_algo, fast_snp_read, approx_ld_corr, bootstrap;
+    bool print_raw_jackknife, use_naive_algo, auto_algo, fast_snp_read, approx_ld_corr, bootstrap;
     std::set <int> chrom_set, nochrom_set;
+    int max_chrom;
     bool print_jackknife_fits;
+    bool prescreen;
+    double prescreen_binsize, prescreen_margin;
+    int prescreen_chrom_stride;
+    double max_run_time, target_decay_se;
+    int polyache_sketches;
+    bool fft_float;
+    double fft_float_tol;
+    bool fused_test;
+    bool stream_geno;
+    bool bin_ingest;
+    double bin_ingest_mb;
+    bool pipeline;
+    bool segmented_fft;
+    bool online_mixfit;
+    int speculative_mixfit;
+    char *run_store;
+    char *ref_ld_index;
+    char *sample_loo;
+    bool ref_ld_index_build;
+    char *sweepname;
+    double pack_contigs;
+    std::vector <SweepConfig> sweep_configs;
+    char *stream_cache;
+    double rep_refs_var;
+    char *rep_refs_pin;
+    std::vector <std::string> rep_refs_pin_list;
+    std::vector <double> extra_binsize_list;
 
     AlderParams(void);
     void readcommands(int argc, char **argv, const char *VERSION);
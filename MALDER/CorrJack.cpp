@@ -24,6 +24,11 @@ namespace ALD {
     count += 1.0; sum_x2 += sq_term; sum_y2 += sq_term;
   }
 
+  void Corr::add(const Corr &other) {
+    count += other.count; sum_x += other.sum_x; sum_y += other.sum_y;
+    sum_xy += other.sum_xy; sum_x2 += other.sum_x2; sum_y2 += other.sum_y2;
+  }
+
 
   // central = true for usual corr, false for non-zeroed
   pair <double, double> CorrJack::jackknife_corr(bool central) {
@@ -100,4 +105,9 @@ namespace ALD {
     return ans;
   }
 
+  void CorrJack::add(const CorrJack &other) {
+    for (int c = 0; c < C; c++)
+      data[c].add(other.data[c]);
+  }
+
 }
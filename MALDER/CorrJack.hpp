@@ -11,6 +11,7 @@ namespace ALD {
     double count, sum_x, sum_y, sum_xy, sum_x2, sum_y2;
     void add_term(double x, double y);
     void add_unbiased_sq_term(double sq_term); // augments both x2 and y2
+    void add(const Corr &other);
   };
 
   class CorrJack {
@@ -32,6 +33,7 @@ namespace ALD {
     std::pair <double, double> jackknife_x2_avg(void);
     double tot_count(void);
     double tot_sum_x2(void);
+    void add(const CorrJack &other); // adds sums chrom by chrom (e.g., to merge bins)
   };
 
 }
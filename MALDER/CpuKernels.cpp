@@ -0,0 +1,84 @@
+#include <cmath>
+#include <cstring>
+
+#include <fftw3.h>
+
+#include "CpuKernels.hpp"
+
+// each variant is compiled from the same source (CpuKernelsImpl.hpp) with a different target
+// instruction set; the Makefile builds this file with -O3 (for vectorization) and
+// -ffp-contract=off (so that all variants round identically)
+#if defined(__GNUC__) && !defined(__clang__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_KERNELS_X86
+#endif
+
+namespace ALD {
+
+  namespace generic_isa {
+#include "CpuKernelsImpl.hpp"
+  }
+
+#ifdef CPU_KERNELS_X86
+#pragma GCC push_options
+#pragma GCC target("avx2")
+  namespace avx2_isa {
+#include "CpuKernelsImpl.hpp"
+  }
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw,avx512vl")
+  namespace avx512_isa {
+#include "CpuKernelsImpl.hpp"
+  }
+#pragma GCC pop_options
+#endif
+
+#define CPU_KERNELS_TABLE(isa_name, ns)						\
+  { isa_name, ns::packed_cross_accum, ns::packed_self_pair_accum, ns::sq_mod_accum,	\
+      ns::conj_prod_accum_f, ns::sq_mod_accum_f, ns::ld_moments, ns::polyache_moments }
+
+  static const CpuKernels generic_kernels = CPU_KERNELS_TABLE("generic", generic_isa);
+#ifdef CPU_KERNELS_X86
+  static const CpuKernels avx2_kernels = CPU_KERNELS_TABLE("avx2", avx2_isa);
+  static const CpuKernels avx512_kernels = CPU_KERNELS_TABLE("avx512", avx512_isa);
+#endif
+
+  CpuKernels cpu_kernels = generic_kernels;
+
+  const char *detect_cpu_isa(void) {
+#ifdef CPU_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+	&& __builtin_cpu_supports("avx512vl"))
+      return "avx512";
+    if (__builtin_cpu_supports("avx2"))
+      return "avx2";
+#endif
+    return "generic";
+  }
+
+  bool select_cpu_kernels(const char *isa) {
+    const char *detected = detect_cpu_isa();
+    if (strcmp(isa, "auto") == 0)
+      isa = detected;
+    if (strcmp(isa, "generic") == 0) {
+      cpu_kernels = generic_kernels;
+      return true;
+    }
+#ifdef CPU_KERNELS_X86
+    bool has_avx512 = strcmp(detected, "avx512") == 0;
+    bool has_avx2 = has_avx512 || strcmp(detected, "avx2") == 0;
+    if (strcmp(isa, "avx2") == 0 && has_avx2) {
+      cpu_kernels = avx2_kernels;
+      return true;
+    }
+    if (strcmp(isa, "avx512") == 0 && has_avx512) {
+      cpu_kernels = avx512_kernels;
+      return true;
+    }
+#endif
+    return false;
+  }
+
+}
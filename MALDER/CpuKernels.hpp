@@ -0,0 +1,42 @@
+#ifndef CPUKERNELS_HPP
+#define CPUKERNELS_HPP
+
+#include <fftw3.h>
+
+namespace ALD {
+
+  // hot inner loops, compiled for several instruction sets (see CpuKernels.cpp); the variant
+  // in use is chosen at startup by select_cpu_kernels
+  // all variants give identical results (no fused multiply-adds or reassociation)
+  struct CpuKernels {
+    const char *isa;
+    // weighted LD spectra: z_accum[b] += ... for b = 0..N/2, with fft_z the transform of
+    // x + i*y for real x, y (see Alder::ConvFFT)
+    void (*packed_cross_accum)(const fftw_complex *fft_z, int N, fftw_complex *z_accum,
+			       double scale); // conj(X) * Y * scale
+    void (*packed_self_pair_accum)(const fftw_complex *fft_z, int N, fftw_complex *z_accum,
+				   double scale_x, double scale_y); // |X|^2, |Y|^2
+    void (*sq_mod_accum)(const fftw_complex *z, int Nby2, fftw_complex *z_accum,
+			 double scale); // |z|^2 * scale
+    // single-precision spectra (see Alder::FloatFFT), accumulated in double
+    void (*conj_prod_accum_f)(const fftwf_complex *z1, const fftwf_complex *z2, int Nby2,
+			      fftw_complex *z_accum, double scale);
+    void (*sq_mod_accum_f)(const fftwf_complex *z, int Nby2, fftw_complex *z_accum,
+			   double scale);
+    // genotype pair moments over indivs with both genotypes non-missing (9 = missing);
+    // return the number of such indivs
+    int (*ld_moments)(const char *x, const char *y, int n, int sums[3]); // x, y, xy
+    int (*polyache_moments)(const char *x, const char *y, int n, int S[3][3]); // x^a y^b
+  };
+
+  extern CpuKernels cpu_kernels;
+
+  // best instruction set supported by this cpu: "avx512", "avx2" or "generic"
+  const char *detect_cpu_isa(void);
+  // isa: "auto" (detect) or one of the above; returns false if not supported by this cpu or
+  // this build
+  bool select_cpu_kernels(const char *isa);
+
+}
+
+#endif
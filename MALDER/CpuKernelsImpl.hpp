@@ -0,0 +1,72 @@
+// kernel bodies for CpuKernels: included once per instruction set by CpuKernels.cpp, inside a
+// separate namespace and target region (so deliberately no include guard)
+
+static inline double sqd(double x) { return x*x; }
+
+// with Z = FFT(x + i*y): X[b] = (Z[b] + conj(Z[N-b])) / 2, Y[b] = (Z[b] - conj(Z[N-b])) / 2i
+static void packed_cross_accum(const fftw_complex *fft_z, int N, fftw_complex *z_accum,
+			       double scale) {
+  for (int b = 0; b <= N>>1; b++) { // Xbar * Y
+    const double *Zb = fft_z[b], *Zm = fft_z[(N-b)&(N-1)];
+    double xr = (Zb[0] + Zm[0]) / 2, xi = (Zb[1] - Zm[1]) / 2;
+    double yr = (Zb[1] + Zm[1]) / 2, yi = (Zm[0] - Zb[0]) / 2;
+    z_accum[b][0] += (xr * yr + xi * yi) * scale;
+    z_accum[b][1] += (xr * yi - xi * yr) * scale;
+  }
+}
+
+static void packed_self_pair_accum(const fftw_complex *fft_z, int N, fftw_complex *z_accum,
+				   double scale_x, double scale_y) {
+  for (int b = 0; b <= N>>1; b++) {
+    const double *Zb = fft_z[b], *Zm = fft_z[(N-b)&(N-1)];
+    z_accum[b][0] += (sqd(Zb[0] + Zm[0]) + sqd(Zb[1] - Zm[1])) / 4 * scale_x
+      + (sqd(Zb[1] + Zm[1]) + sqd(Zm[0] - Zb[0])) / 4 * scale_y;
+  }
+}
+
+static void sq_mod_accum(const fftw_complex *z, int Nby2, fftw_complex *z_accum,
+			 double scale) {
+  for (int b = 0; b <= Nby2; b++)
+    z_accum[b][0] += (sqd(z[b][0]) + sqd(z[b][1])) * scale;
+}
+
+static void conj_prod_accum_f(const fftwf_complex *z1, const fftwf_complex *z2, int Nby2,
+			      fftw_complex *z_accum, double scale) {
+  for (int b = 0; b <= Nby2; b++) {
+    z_accum[b][0] += ((double) z1[b][0] * z2[b][0] + (double) z1[b][1] * z2[b][1]) * scale;
+    z_accum[b][1] += ((double) z1[b][0] * z2[b][1] - (double) z1[b][1] * z2[b][0]) * scale;
+  }
+}
+
+static void sq_mod_accum_f(const fftwf_complex *z, int Nby2, fftw_complex *z_accum,
+			   double scale) {
+  for (int b = 0; b <= Nby2; b++)
+    z_accum[b][0] += (sqd(z[b][0]) + sqd(z[b][1])) * scale;
+}
+
+// branch-free (missing genotypes are masked to 0) so that the loops vectorize
+static int ld_moments(const char *x, const char *y, int n, int sums[3]) {
+  int cnt = 0, sx = 0, sy = 0, sxy = 0;
+  for (int i = 0; i < n; i++) {
+    int m = (x[i] != 9) & (y[i] != 9);
+    int xi = x[i] * m, yi = y[i] * m;
+    cnt += m; sx += xi; sy += yi; sxy += xi * yi;
+  }
+  sums[0] = sx; sums[1] = sy; sums[2] = sxy;
+  return cnt;
+}
+
+static int polyache_moments(const char *x, const char *y, int n, int S[3][3]) {
+  int cnt = 0, s10 = 0, s01 = 0, s20 = 0, s11 = 0, s02 = 0, s21 = 0, s12 = 0, s22 = 0;
+  for (int i = 0; i < n; i++) {
+    int m = (x[i] != 9) & (y[i] != 9);
+    int xi = x[i] * m, yi = y[i] * m;
+    int x2 = xi * xi, y2 = yi * yi;
+    cnt += m;
+    s10 += xi; s01 += yi; s20 += x2; s11 += xi * yi; s02 += y2;
+    s21 += x2 * yi; s12 += xi * y2; s22 += x2 * y2;
+  }
+  S[0][0] = cnt; S[1][0] = s10; S[0][1] = s01; S[2][0] = s20; S[1][1] = s11; S[0][2] = s02;
+  S[2][1] = s21; S[1][2] = s12; S[2][2] = s22;
+  return cnt;
+}
@@ -23,6 +23,17 @@ namespace ALD {
   using std::max;
   using std::min;
 
+  vector <double> &ExpFitALD::var_ref(const char *varname) {
+    if (strcmp(varname, "decay") == 0) return gen;
+    else if (strcmp(varname, "amp_tot") == 0) return amp_tot;
+    else if (strcmp(varname, "amp_exp") == 0) return amp_exp;
+    else if (strcmp(varname, "amp_aff") == 0) return amp_aff;
+    else {
+      fprintf(stderr, "internal error: unknown fit varname %s\n", varname);
+      exit(1);
+    }
+  }
+
   string ExpFitALD::mean_std_str(const char *varname) const {
     pair <double, double> mean_std = Jackknife::mean_std(get_var(varname));
     int digits = strcmp(varname, "decay") == 0 ? 2 : 8;
@@ -118,14 +129,21 @@ namespace ALD {
   }
 
   vector <double> ExpFitALD::get_var(const char *varname) const {
-    if (strcmp(varname, "decay") == 0) return gen;
-    else if (strcmp(varname, "amp_tot") == 0) return amp_tot;
-    else if (strcmp(varname, "amp_exp") == 0) return amp_exp;
-    else if (strcmp(varname, "amp_aff") == 0) return amp_aff;
-    else {
-      fprintf(stderr, "internal error: unknown fit varname %s\n", varname);
-      exit(1);
-    }
+    return const_cast <ExpFitALD *> (this)->var_ref(varname);
+  }
+
+  // spreads out the jackknife reps of varname about their mean so that the jackknife variance
+  // increases by extra_var (e.g., variance from a randomized approximation)
+  void ExpFitALD::add_jackknife_var(const char *varname, double extra_var) {
+    vector <double> &x = var_ref(varname);
+    int n = x.size()-1; // number of jackknife reps
+    if (!use_jackknife || n < 2 || !(extra_var > 0)) return;
+    double sd = Jackknife::stddev(x, n);
+    if (!(sd > 0) || std::isinf(sd)) return;
+    double mean = 0;
+    for (int i = 0; i < n; i++) mean += x[i] / n;
+    double scale = sqrt(1 + extra_var / (sd*sd));
+    for (int i = 0; i < n; i++) x[i] = mean + (x[i]-mean) * scale;
   }
   
   void ExpFitALD::print_fit_diff(const ExpFitALD &ref_fit, const char *varname, int digits,
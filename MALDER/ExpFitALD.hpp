@@ -24,6 +24,7 @@ namespace ALD {
     bool use_inter_chrom_affine;
     int num_fit_failures;
 
+    vector <double> &var_ref(const char *varname);
     string mean_std_str(const char *varname) const;
     string make_fit_line(const char *descrip, int digits, pair <double, double> mean_std,
 			 bool print_zscore) const;
@@ -42,6 +43,7 @@ namespace ALD {
     void do_fit(int jc, const double *x, const double *y, int bins);
     void print_fit_header(void) const;
     vector <double> get_var(const char *varname) const;
+    void add_jackknife_var(const char *varname, double extra_var);
     void print_fit_diff(const ExpFitALD &ref_fit, const char *varname, int digits,
 			const string &pop_name, const string &ref_name) const;
     bool print_test_fit_diff(const ExpFitALD &ref_fit, const char *varname,
@@ -0,0 +1,232 @@
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "nicklib.h"
+
+#include "GenoStream.hpp"
+
+namespace ALD {
+
+  using std::string;
+  using std::vector;
+
+  GenoStream::GenoStream(void) : streaming(false), from_cache(false), fd(-1), line_len(0),
+				 W(0), num_mixed(0), max_loaded(1), num_loaded(0),
+				 next_prefetch(0), thread_started(false), shutdown(false) {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+  }
+
+  GenoStream::~GenoStream(void) {
+    if (thread_started) {
+      pthread_mutex_lock(&mutex);
+      shutdown = true;
+      pthread_cond_broadcast(&cond);
+      pthread_mutex_unlock(&mutex);
+      pthread_join(prefetch_thread, NULL);
+    }
+    for (int b = 0; b < (int) block_bufs.size(); b++)
+      delete[] block_bufs[b];
+    if (fd != -1) close(fd);
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+  }
+
+  void GenoStream::set_memory(const char *mixed_geno, int _num_mixed,
+			      const vector <char *> &ref_genos, const vector <int> &_num_ref,
+			      int num_snps) {
+    streaming = false;
+    num_mixed = _num_mixed;
+    num_ref = _num_ref;
+    mixed_rows = vector <const char *> (num_snps);
+    for (int s = 0; s < num_snps; s++)
+      mixed_rows[s] = mixed_geno + (long) s * num_mixed;
+    ref_rows = vector < vector <const char *> > (ref_genos.size(),
+						 vector <const char *> (num_snps));
+    for (int r = 0; r < (int) ref_genos.size(); r++)
+      for (int s = 0; s < num_snps; s++)
+	ref_rows[r][s] = ref_genos[r] + (long) s * num_ref[r];
+  }
+
+  void GenoStream::set_stream(const char *genotypename, long _line_len, const vector <int> &_cols,
+			      int _num_mixed, const vector <int> &_num_ref,
+			      const vector <long> &_file_rows, const string &cache_name) {
+    streaming = true;
+    line_len = _line_len;
+    cols = _cols;
+    num_mixed = _num_mixed;
+    num_ref = _num_ref;
+    file_rows = _file_rows;
+    W = num_mixed;
+    ref_offsets.clear();
+    for (int r = 0; r < (int) num_ref.size(); r++) {
+      ref_offsets.push_back(W);
+      W += num_ref[r];
+    }
+    from_cache = !cache_name.empty();
+    const char *name = from_cache ? cache_name.c_str() : genotypename;
+    fd = open(name, O_RDONLY);
+    if (fd == -1) fatalx("unable to open genotype stream: %s\n", name);
+    int num_snps = file_rows.size();
+    mixed_rows = vector <const char *> (num_snps, (const char *) NULL);
+    ref_rows = vector < vector <const char *> > (num_ref.size(),
+						 vector <const char *> (num_snps,
+									(const char *) NULL));
+  }
+
+  void GenoStream::set_blocks(const vector <int> &_block_starts, int _max_loaded) {
+    if (!streaming) return;
+    block_starts = _block_starts;
+    max_loaded = _max_loaded < 1 ? 1 : _max_loaded;
+    int B = block_starts.size() - 1;
+    block_bufs = vector <char *> (B, (char *) NULL);
+    block_state = vector <int> (B, UNLOADED);
+    block_refs = vector <int> (B, 0);
+    block_done = vector <char> (B, 0);
+  }
+
+  void GenoStream::start_pass(void) {
+    if (!streaming) return;
+    vector <int> order(block_starts.size() - 1);
+    for (int b = 0; b < (int) order.size(); b++) order[b] = b;
+    start_pass(order);
+  }
+
+  void GenoStream::start_pass(const vector <int> &block_order) {
+    if (!streaming) return;
+    pthread_mutex_lock(&mutex);
+    pass_order = block_order;
+    next_prefetch = 0;
+    block_done = vector <char> (block_done.size(), 0);
+    if (!thread_started) {
+      if (pthread_create(&prefetch_thread, NULL, prefetch_main, this) != 0)
+	fatalx("unable to start genotype prefetch thread\n");
+      thread_started = true;
+    }
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  void GenoStream::end_pass(void) {
+    if (!streaming) return;
+    pthread_mutex_lock(&mutex);
+    pass_order.clear();
+    next_prefetch = 0;
+    for (int b = 0; b < (int) block_state.size(); b++) {
+      while (block_state[b] == LOADING)
+	pthread_cond_wait(&cond, &mutex);
+      if (block_state[b] == LOADED && block_refs[b] == 0) // prefetched but never used
+	free_block_locked(b);
+    }
+    pthread_mutex_unlock(&mutex);
+  }
+
+  void GenoStream::acquire(int b) {
+    if (!streaming) return;
+    pthread_mutex_lock(&mutex);
+    while (block_state[b] == LOADING)
+      pthread_cond_wait(&cond, &mutex);
+    if (block_state[b] == UNLOADED) // not prefetched (yet): read it here
+      load_block_locked(b);
+    block_refs[b]++;
+    pthread_mutex_unlock(&mutex);
+  }
+
+  void GenoStream::release(int b) {
+    if (!streaming) return;
+    pthread_mutex_lock(&mutex);
+    if (--block_refs[b] == 0) {
+      free_block_locked(b);
+      block_done[b] = 1;
+      pthread_cond_broadcast(&cond);
+    }
+    pthread_mutex_unlock(&mutex);
+  }
+
+  void *GenoStream::prefetch_main(void *arg) {
+    ((GenoStream *) arg)->prefetch_loop();
+    return NULL;
+  }
+
+  void GenoStream::prefetch_loop(void) {
+    pthread_mutex_lock(&mutex);
+    while (!shutdown) {
+      while (next_prefetch < (int) pass_order.size()
+	     && (block_done[pass_order[next_prefetch]]
+		 || block_state[pass_order[next_prefetch]] != UNLOADED))
+	next_prefetch++;
+      if (next_prefetch == (int) pass_order.size() || num_loaded >= max_loaded) {
+	pthread_cond_wait(&cond, &mutex);
+	continue;
+      }
+      load_block_locked(pass_order[next_prefetch]);
+    }
+    pthread_mutex_unlock(&mutex);
+  }
+
+  // marks the block as loading so that other threads wait for it, then reads it unlocked
+  void GenoStream::load_block_locked(int b) {
+    block_state[b] = LOADING;
+    num_loaded++;
+    pthread_mutex_unlock(&mutex);
+    char *buf = new char[(long) (block_starts[b+1] - block_starts[b]) * W];
+    read_block(b, buf);
+    pthread_mutex_lock(&mutex);
+    block_bufs[b] = buf;
+    set_block_rows(b, buf);
+    block_state[b] = LOADED;
+    pthread_cond_broadcast(&cond);
+  }
+
+  void GenoStream::free_block_locked(int b) {
+    delete[] block_bufs[b];
+    block_bufs[b] = NULL;
+    set_block_rows(b, NULL);
+    block_state[b] = UNLOADED;
+    num_loaded--;
+  }
+
+  void GenoStream::set_block_rows(int b, const char *buf) {
+    for (int s = block_starts[b]; s < block_starts[b+1]; s++) {
+      const char *row = buf == NULL ? NULL : buf + (long) (s - block_starts[b]) * W;
+      mixed_rows[s] = row;
+      for (int r = 0; r < (int) ref_rows.size(); r++)
+	ref_rows[r][s] = row == NULL ? NULL : row + ref_offsets[r];
+    }
+  }
+
+  static void pread_fully(int fd, char *buf, long len, long offset) {
+    while (len > 0) {
+      ssize_t got = pread(fd, buf, len, offset);
+      if (got == -1 && errno == EINTR) continue;
+      if (got <= 0) fatalx("error reading genotype stream (offset %ld)\n", offset);
+      buf += got; len -= got; offset += got;
+    }
+  }
+
+  void GenoStream::read_block(int b, char *buf) {
+    int s_start = block_starts[b], s_end = block_starts[b+1];
+    if (s_start == s_end) return;
+    if (from_cache) {
+      pread_fully(fd, buf, (long) (s_end - s_start) * W, (long) s_start * W);
+      return;
+    }
+    // one read spanning the block's lines (snps of a chrom are contiguous in the geno file)
+    long row_start = file_rows[s_start], num_lines = file_rows[s_end-1] - row_start + 1;
+    vector <char> lines(num_lines * line_len);
+    pread_fully(fd, &lines[0], num_lines * line_len, row_start * line_len);
+    for (int s = s_start; s < s_end; s++) {
+      const char *line = &lines[(file_rows[s] - row_start) * line_len];
+      char *row = buf + (long) (s - s_start) * W;
+      for (int j = 0; j < W; j++)
+	row[j] = line[cols[j]] - '0';
+    }
+  }
+
+}
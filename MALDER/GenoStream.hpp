@@ -0,0 +1,83 @@
+#ifndef GENOSTREAM_HPP
+#define GENOSTREAM_HPP
+
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+namespace ALD {
+
+  using std::string;
+  using std::vector;
+
+  // genotype rows (0129 per indiv) of the used snps, either held in memory or streamed from disk
+  // one block (= range of snps; Alder uses chroms) at a time
+  //
+  // streaming mode: a block's rows are only valid between acquire(b) and release(b); a prefetch
+  // thread loads the blocks of the current pass in order (up to max_loaded blocks at a time) so
+  // that reading overlaps computation.  blocks are read either from the source eigenstrat geno
+  // file (fixed-length lines) or from a binary cache of the used snps written while validating
+  // the input (one row of W = num_mixed + sum(num_ref) genotypes per snp, refs after mixed)
+  //
+  // memory mode: rows point into the caller's arrays; all pass/block calls are no-ops
+  class GenoStream {
+
+  public:
+    vector <const char *> mixed_rows; // by snp
+    vector < vector <const char *> > ref_rows; // by ref, snp
+
+    GenoStream(void);
+    ~GenoStream(void);
+
+    void set_memory(const char *mixed_geno, int num_mixed, const vector <char *> &ref_genos,
+		    const vector <int> &num_ref, int num_snps);
+    // file_rows: line of each used snp in the geno file (ignored when reading from a cache)
+    // cols: source columns of the W genotypes of a row (mixed indivs, then each ref's indivs)
+    void set_stream(const char *genotypename, long line_len, const vector <int> &cols,
+		    int num_mixed, const vector <int> &num_ref, const vector <long> &file_rows,
+		    const string &cache_name);
+    void set_blocks(const vector <int> &block_starts, int max_loaded);
+    bool is_streaming(void) const { return streaming; }
+
+    void start_pass(void); // all blocks, in order
+    void start_pass(const vector <int> &block_order);
+    void end_pass(void);
+    void acquire(int b);
+    void release(int b);
+
+  private:
+    enum { UNLOADED, LOADING, LOADED };
+
+    bool streaming, from_cache;
+    int fd;
+    long line_len;
+    int W, num_mixed;
+    vector <int> ref_offsets, num_ref;
+    vector <int> cols;
+    vector <long> file_rows;
+
+    vector <int> block_starts;
+    int max_loaded, num_loaded;
+    vector <char *> block_bufs;
+    vector <int> block_state, block_refs;
+    vector <char> block_done;
+    vector <int> pass_order;
+    int next_prefetch;
+
+    bool thread_started, shutdown;
+    pthread_t prefetch_thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    static void *prefetch_main(void *arg);
+    void prefetch_loop(void);
+    void read_block(int b, char *buf);
+    void load_block_locked(int b); // called (and returns) with mutex held
+    void set_block_rows(int b, const char *buf);
+    void free_block_locked(int b);
+  };
+
+}
+
+#endif
@@ -26,12 +26,16 @@
 #include "Alder.hpp"
 #include "ProcessInput.hpp"
 #include "MultFitALD.hpp"
+#include "CpuKernels.hpp"
 
 using namespace std;
 using namespace ALD;
 
 const char VERSION[] = "1.0";
 
+// z-score a 2-ref curve needs to pass the admixture test (p < 0.05, no multiple-hyp correction)
+const double ADMIXTURE_TEST_Z_THRESH = 1.96;
+
 // required to link mcio.o
 int numchrom = 22 ;
 char *trashdir = "/var/tmp" ;
@@ -68,6 +72,43 @@ vector <double> subtract_freqs(const vector < vector <double> > &ref_freqs, int
   return weights;
 }
 
+// prints a pair's curve and fits and runs its admixture test; returns true if it passes
+bool report_pair_test(const vector <AlderResults> &results_jackknife, double fit_start_dis,
+		      const vector <ExpFitALD> &fits_all_starts, int fit_test_ind,
+		      const ExpFitALD &oneref_1, const ExpFitALD &oneref_2,
+		      const string &mixed_pop_name, const string &ref_name_1,
+		      const string &ref_name_2, bool print_jackknife_fits, Timer &timer) {
+  plot_ascii_curve(results_jackknife.back(), fit_start_dis);
+
+  for (int f = 0; f < (int) fits_all_starts.size(); f++)
+    fits_all_starts[f].print_fit(print_jackknife_fits);
+
+  cout << "==> Time to run fits: " << timer.update_time() << endl << endl;
+
+  return ExpFitALD::run_admixture_test(fits_all_starts[fit_test_ind], oneref_1, oneref_2,
+				       mixed_pop_name, ref_name_1, ref_name_2, false, 1);
+}
+
+// online mixture fit: refits the 1-mixture model on the pair curves so far, warm-started from
+// its previous optimum, and prints the interim date; to keep the total refit work linear in
+// the number of pairs, refits only when the number of curves reaches a power of 2, and (final)
+// once more after the last curve if it came in past the last refit
+void update_online_fit(MultFitALD *&online_fit, map<string, vector<AlderResults> > &curves,
+		       bool final=false) {
+  int num_curves = curves.size();
+  if (num_curves < 2) return;
+  if (final ? online_fit != NULL && (int) online_fit->expamps.size() == num_curves
+      : (num_curves & (num_curves-1)) != 0)
+    return;
+  if (online_fit == NULL) online_fit = new MultFitALD(1, &curves);
+  else
+    for (map<string, vector<AlderResults> >::iterator it = curves.begin(); it != curves.end();
+	 it++)
+      online_fit->add_curve(it->first);
+  online_fit->GSL_optim();
+  printf("interim mixture fit (%d curves): time %.2f\n\n", num_curves, online_fit->times[0]);
+}
+
 int main(int argc, char *argv[]) {
 
   Timer timer;
@@ -87,34 +128,61 @@ int main(int argc, char *argv[]) {
   pars.readcommands(argc, argv, VERSION);
   omp_set_num_threads(pars.num_threads);
   verbose = pars.verbose;
+  if (!select_cpu_kernels(pars.cpu_isa))
+    fatalx("cpu_isa %s is not supported on this machine (detected: %s)\n", pars.cpu_isa,
+	   detect_cpu_isa());
+  cout << "CPU kernels: " << cpu_kernels.isa << " (detected: " << detect_cpu_isa() << ")" << endl;
 
   // ----------------------------------- process input ------------------------------------ //
 
   cout << "                        *** Processing data ***" << endl << endl;
 
-  Indiv **indivmarkers;
-  SNP **snpmarkers ;
+  // the indiv file is read on its own thread while the snp file is read
+  ProcessInput::IndivTable indivs;
+  ProcessInput::IndivLoader indiv_loader(pars.indivname, indivs);
+  ProcessInput::SnpTable snps;
+  vector < pair <int, double> > snp_locs =
+    ProcessInput::process_snps(pars.snpname, pars.badsnpname, pars.fast_snp_read, snps,
+			       pars.checkmap, pars.chrom_set, pars.nochrom_set, pars.max_chrom);
+  indiv_loader.wait();
+
   int num_mixed_indivs; string mixed_pop_name;
   vector <int> num_ref_indivs; vector <string> ref_pop_names;
   vector <int> indiv_pop_inds =
-    ProcessInput::process_indivs(pars.indivname, &indivmarkers, pars.admixlist, pars.admixpop,
+    ProcessInput::process_indivs(indivs, pars.admixlist, pars.admixpop,
 				 pars.refpops, pars.poplistname, num_mixed_indivs, mixed_pop_name,
 				 num_ref_indivs, ref_pop_names);
   if (pars.mincount > num_mixed_indivs) fatalx("mincount must be <= num mixed indivs\n");
+  if (pars.pack_contigs > 0) {
+    // guard gap: past the longest maxdis by two of the largest bins, so that no pair across
+    // contigs reaches a bin of any curve
+    double maxdis = pars.maxdis, binsize = pars.binsize;
+    for (int b = 0; b < (int) pars.extra_binsize_list.size(); b++)
+      binsize = max(binsize, pars.extra_binsize_list[b]);
+    for (int k = 0; k < (int) pars.sweep_configs.size(); k++) {
+      maxdis = max(maxdis, pars.sweep_configs[k].maxdis);
+      binsize = max(binsize, pars.sweep_configs[k].binsize);
+    }
+    ProcessInput::pack_contigs(snp_locs, pars.pack_contigs,
+			       max(maxdis, Alder::MAX_LD_CORR_DIST) + 2*binsize);
+  }
 
-  int orig_numsnps;
-  vector < pair <int, double> > snp_locs =
-    ProcessInput::process_snps(pars.snpname, pars.badsnpname, pars.fast_snp_read, &snpmarkers,
-			       pars.checkmap, orig_numsnps, pars.chrom_set, pars.nochrom_set);
-
-  char *mixed_geno = new char[snp_locs.size() * num_mixed_indivs];
-  vector <char *> ref_genos(num_ref_indivs.size());
-  for (int r = 0; r < (int) num_ref_indivs.size(); r++)
-    ref_genos[r] = new char[snp_locs.size() * num_ref_indivs[r]];
-
-  vector < vector <double> > ref_freqs =
-    ProcessInput::process_geno(pars.genotypename, indiv_pop_inds, mixed_geno, ref_genos,
-			       snpmarkers, orig_numsnps);
+  GenoStream geno;
+  char *mixed_geno = NULL;
+  vector <char *> ref_genos(num_ref_indivs.size(), (char *) NULL);
+  vector < vector <double> > ref_freqs;
+  if (pars.stream_geno)
+    ref_freqs = ProcessInput::process_geno(pars.genotypename, indiv_pop_inds, snps,
+					   pars.stream_cache == NULL ? "" : pars.stream_cache,
+					   geno);
+  else {
+    mixed_geno = new char[snp_locs.size() * num_mixed_indivs];
+    for (int r = 0; r < (int) num_ref_indivs.size(); r++)
+      ref_genos[r] = new char[snp_locs.size() * num_ref_indivs[r]];
+    ref_freqs = ProcessInput::process_geno(pars.genotypename, indiv_pop_inds, mixed_geno,
+					   ref_genos, snps);
+    geno.set_memory(mixed_geno, num_mixed_indivs, ref_genos, num_ref_indivs, snp_locs.size());
+  }
 
   // ----------------------- determine number of refs; set weights ------------------------ //
 
@@ -123,7 +191,7 @@ int main(int argc, char *argv[]) {
   int num_ref_freqs = ref_freqs.size(); // num_ref_freqs is the number of ref pops with geno data
   vector <int> ref_inds;
   if (pars.weightname != NULL) { // load external weights
-    weights = ProcessInput::process_weights(pars.weightname, snpmarkers, orig_numsnps);
+    weights = ProcessInput::process_weights(pars.weightname, snps);
     num_alder_refs = 2;
   }
   else {
@@ -154,8 +222,26 @@ int main(int argc, char *argv[]) {
     cout << "number of reference populations: " << num_ref_freqs << endl;
   }
 
-  Alder alder(mixed_geno, num_mixed_indivs, mixed_pop_name, ref_genos, num_ref_indivs,
-	     ref_pop_names, snp_locs, timer);
+  Alder alder(geno, num_mixed_indivs, mixed_pop_name, num_ref_indivs, ref_pop_names, snp_locs,
+	      timer);
+  alder.set_anytime(pars.max_run_time, pars.target_decay_se);
+  alder.set_polyache_sketches(pars.polyache_sketches);
+  alder.set_auto_algo(pars.auto_algo);
+  alder.set_fft_float(pars.fft_float ? pars.fft_float_tol : 0);
+  // packs are mostly guard gaps: segmented transforms skip the blocks without data
+  alder.set_segmented_fft(pars.segmented_fft || pars.pack_contigs > 0);
+  alder.set_extra_binsizes(pars.extra_binsize_list);
+  if (pars.sample_loo != NULL) {
+    if (pars.use_naive_algo || pars.auto_algo || pars.fft_float)
+      cout << "sample_loo: not available with use_naive_algo, auto_algo or fft_float" << endl;
+    else {
+      vector <string> mixed_indiv_ids;
+      for (int i = 0; i < (int) indiv_pop_inds.size(); i++)
+	if (indiv_pop_inds[i] == ProcessInput::ADMIXED_POP_IND)
+	  mixed_indiv_ids.push_back(indivs.ids[i]);
+      alder.set_sample_loo(pars.sample_loo, mixed_indiv_ids);
+    }
+  }
   if (alder.get_num_chroms_used() < 2 && pars.print_raw_jackknife)
     cout << "WARNING: jackknife = YES, but need data from >= 2 chroms to jackknife" << endl;
 
@@ -171,11 +257,43 @@ int main(int argc, char *argv[]) {
 
   cout << endl << "==> Time to process data: " << timer.update_time() << endl << endl;
 
+  // pipelined 3+ ref runs: see the pair loop below
+  bool pipeline = pars.pipeline && num_ref_freqs > 2;
+  if (pipeline && (pars.stream_geno || pars.auto_algo || pars.fft_float || pars.bin_ingest ||
+		   pars.max_run_time > 0 || pars.target_decay_se > 0 ||
+		   !pars.sweep_configs.empty())) {
+    cout << "pipeline: not available with stream_geno, auto_algo, fft_float, bin_ingest,"
+	 << " anytime or sweep options; running pairs in sequence" << endl << endl;
+    pipeline = false;
+  }
+  // with the pipeline, the LD correlation extent of each ref is a task of the pair loop (unless
+  // the pre-screen needs the fit starts first)
+  bool ld_corr_tasks = pipeline && !pars.prescreen && pars.mindis == AlderParams::MINDIS_NOT_SET;
+
+  // optional ref LD index: built from this data if absent (or if asked), then used for the ref
+  // LD half of the LD correlation computation
+  RefLdIndex ref_ld_index;
+  if (pars.ref_ld_index != NULL) {
+    printhline();
+    if (pars.ref_ld_index_build || !ref_ld_index.open(pars.ref_ld_index)) {
+      alder.build_ref_ld_index(pars.ref_ld_index);
+      if (pars.ref_ld_index_build) return 0;
+      if (!ref_ld_index.open(pars.ref_ld_index))
+	fatalx("unable to read ref LD index: %s\n", pars.ref_ld_index);
+    }
+    if (pars.mindis == AlderParams::MINDIS_NOT_SET)
+      alder.use_ref_ld_index(ref_ld_index);
+    else
+      cout << "ref LD index: not used (mindis is set)" << endl << endl;
+  }
+
   // --------------------------- find extent of LD correlation ---------------------------- //
 
-  printhline();
-  vector <double> fit_starts = alder.find_ld_corr_stops(pars.binsize, pars.approx_ld_corr,
-							pars.mindis);
+  vector <double> fit_starts(num_ref_freqs, NAN);
+  if (!ld_corr_tasks) {
+    printhline();
+    fit_starts = alder.find_ld_corr_stops(pars.binsize, pars.approx_ld_corr, pars.mindis);
+  }
 
   // --------------- perform weighted LD computation: 1-ref and 2-ref cases --------------- //
 
@@ -324,7 +442,6 @@ int main(int argc, char *argv[]) {
 
 
 
-    map<string, vector<AlderResults> > all_curves;  //store all pairwise curves --Joe
 
 
     vector<pair<int, int> > allpairs;
@@ -334,18 +451,282 @@ int main(int argc, char *argv[]) {
     		allpairs.push_back(make_pair(r1, r2));
     	}
     }
+    // optional: only pairs within a representative subset of the refs (plus pairs with pinned refs)
+    if (pars.rep_refs_var > 0){
+    	printhline();
+    	cout << "                 *** Selecting representative ref pops ***" << endl << endl;
+    	vector <int> rep_refs = alder.select_representative_refs(pars.rep_refs_var);
+    	vector <bool> is_rep(num_ref_freqs, false), is_pinned(num_ref_freqs, false);
+    	for (int i = 0; i < (int) rep_refs.size(); i++) is_rep[rep_refs[i]] = true;
+    	for (int i = 0; i < (int) pars.rep_refs_pin_list.size(); i++){
+    		int r = find(ref_pop_names.begin(), ref_pop_names.end(), pars.rep_refs_pin_list[i])
+    				- ref_pop_names.begin();
+    		if (r == num_ref_freqs)
+    			fatalx("rep_refs_pin: %s is not a ref pop\n", pars.rep_refs_pin_list[i].c_str());
+    		is_pinned[r] = true;
+    	}
+    	vector<pair<int, int> > rep_pairs;
+    	for (int i = 0; i < (int) allpairs.size(); i++){
+    		int r1 = allpairs[i].first;
+    		int r2 = allpairs[i].second;
+    		if ((is_rep[r1] && is_rep[r2]) || is_pinned[r1] || is_pinned[r2])
+    			rep_pairs.push_back(allpairs[i]);
+    	}
+    	cout << rep_refs.size() << " representative";
+    	if (!pars.rep_refs_pin_list.empty())
+    		cout << " and " << pars.rep_refs_pin_list.size() << " pinned";
+    	cout << " ref pops: running " << rep_pairs.size() << " of " << allpairs.size()
+    			<< " pairs" << endl << endl;
+    	allpairs = rep_pairs;
+    }
     // if bootstrapping, take random pairs
     if (pars.bootstrap){
-    	for (int i = 0; i < allpairs.size(); i++) {
+    	for (int i = 0; i < (int) allpairs.size(); i++) {
     		int ranint = gsl_rng_uniform_int(rr, allpairs.size());
     		pairs2use.push_back(allpairs[ranint]);
     	}
     }
     else{
-       	for (int i = 0; i < allpairs.size(); i++) pairs2use.push_back(allpairs[i]);
+       	for (int i = 0; i < (int) allpairs.size(); i++) pairs2use.push_back(allpairs[i]);
 
     }
-    for (int i = 0; i < pairs2use.size(); i++){
+
+    // parameter sweep: each configuration gets its own curves, admixture tests and mixture
+    // fit; configurations with the same mincount whose binsizes are multiples of a finer one
+    // share one weighted LD run per pair (at the finer binsize and their longest maxdis),
+    // aggregating its per-chrom bin sums
+    vector<SweepConfig> configs = pars.sweep_configs;
+    bool sweep = !configs.empty();
+    if (!sweep){
+    	SweepConfig config;
+    	config.binsize = pars.binsize; config.maxdis = pars.maxdis; config.mincount = pars.mincount;
+    	configs.push_back(config);
+    }
+    vector<SweepConfig> group_runs;
+    vector<int> config_group(configs.size());
+    vector<pair<double, int> > by_binsize;
+    for (int k = 0; k < (int) configs.size(); k++) by_binsize.push_back(make_pair(configs[k].binsize, k));
+    sort(by_binsize.begin(), by_binsize.end());
+    for (int j = 0; j < (int) by_binsize.size(); j++){
+    	int k = by_binsize[j].second;
+    	int g = 0;
+    	for (; g < (int) group_runs.size(); g++){
+    		double ratio = configs[k].binsize / group_runs[g].binsize;
+    		if (group_runs[g].mincount == configs[k].mincount
+    				&& fabs(ratio - floor(ratio + 0.5)) < 1e-6) break;
+    	}
+    	if (g == (int) group_runs.size()) group_runs.push_back(configs[k]);
+    	group_runs[g].maxdis = max(group_runs[g].maxdis, configs[k].maxdis);
+    	config_group[k] = g;
+    }
+    // LD correlation extent (hence fit starts) at each binsize of the sweep, as it is found on
+    // bins of that size (unless mindis is set)
+    map<double, vector<double> > fit_starts_by_binsize;
+    fit_starts_by_binsize[pars.binsize] = fit_starts;
+    for (int k = 0; k < (int) configs.size(); k++){
+    	if (fit_starts_by_binsize.count(configs[k].binsize)) continue;
+    	if (pars.mindis != AlderParams::MINDIS_NOT_SET){
+    		fit_starts_by_binsize[configs[k].binsize] = fit_starts;
+    		continue;
+    	}
+    	printhline();
+    	printf("sweep configuration %d (%s): binsize %g cM\n\n", k+1, configs[k].desc.c_str(),
+    			100*configs[k].binsize);
+    	fit_starts_by_binsize[configs[k].binsize] = alder.find_ld_corr_stops(configs[k].binsize,
+    			pars.approx_ld_corr, pars.mindis);
+    }
+    // the pre-screen is run once, with the main mincount and fit starts
+    if (pars.prescreen)
+    	for (int k = 0; k < (int) configs.size(); k++)
+    		if (configs[k].mincount != pars.mincount
+    				|| fit_starts_by_binsize[configs[k].binsize] != fit_starts)
+    			fatalx("prescreen: sweep configuration %d (%s) changes the mincount or the LD"
+    					" correlation extent used by the pre-screen\n", k+1,
+    					configs[k].desc.c_str());
+
+    // optional pre-screen: approximate test z-score for each pair from a cheap pass (coarse bins,
+    // subset of chroms); only pairs that could plausibly pass the test get the full computation
+    map<pair<int, int>, double> screen_zs;
+    vector<pair<int, int> > screened_out;
+    if (pars.prescreen){
+    	printhline();
+    	cout << "                 *** Pre-screening pairs of ref pops ***" << endl << endl;
+    	printf("binsize %.3f cM on every %d-th chrom; keeping pairs with z + %.2f >= %.2f\n\n",
+    			100*pars.prescreen_binsize, pars.prescreen_chrom_stride, pars.prescreen_margin,
+    			ADMIXTURE_TEST_Z_THRESH);
+    	for (int i = 0; i < (int) allpairs.size(); i++){
+    		int r1 = allpairs[i].first;
+    		int r2 = allpairs[i].second;
+    		double fit_start_dis = max(fit_starts[r1], fit_starts[r2]);
+    		double z = alder.screen_admixture_zscore(2, subtract_freqs(ref_freqs, r1, r2),
+    				pars.maxdis, pars.prescreen_binsize, pars.mincount, fit_start_dis,
+    				pars.prescreen_chrom_stride);
+    		screen_zs[allpairs[i]] = z;
+    		bool keep = std::isnan(z) || z + pars.prescreen_margin >= ADMIXTURE_TEST_Z_THRESH;
+    		if (!keep) screened_out.push_back(allpairs[i]);
+    		printf("%20s %20s   screening z = %6.2f   %s\n", ref_pop_names[r1].c_str(),
+    				ref_pop_names[r2].c_str(), z, keep ? "keep" : "skip");
+    	}
+    	vector<pair<int, int> > pairs_kept;
+    	for (int i = 0; i < (int) pairs2use.size(); i++){
+    		double z = screen_zs[pairs2use[i]];
+    		if (std::isnan(z) || z + pars.prescreen_margin >= ADMIXTURE_TEST_Z_THRESH)
+    			pairs_kept.push_back(pairs2use[i]);
+    	}
+    	cout << endl << "pre-screen keeps " << allpairs.size() - screened_out.size() << " of "
+    			<< allpairs.size() << " pairs for full computation" << endl;
+    	pairs2use = pairs_kept;
+    	cout << endl << "==> Time to pre-screen pairs: " << timer.update_time() << endl << endl;
+    }
+    if (sweep){
+    	printhline();
+    	cout << "                       *** Parameter sweep ***" << endl << endl;
+    	printf("%d configurations from %d weighted LD run(s) per pair of ref pops:\n\n",
+    			(int) configs.size(), (int) group_runs.size());
+    	for (int k = 0; k < (int) configs.size(); k++){
+    		const SweepConfig &run = group_runs[config_group[k]];
+    		printf("%4d: %-40s run %d (binsize %g cM, maxdis %g cM, mincount %d)\n", k+1,
+    				configs[k].desc.c_str(), config_group[k]+1, 100*run.binsize, 100*run.maxdis,
+    				run.mincount);
+    	}
+    	cout << endl;
+    }
+
+    if (pars.run_store != NULL){
+    	printhline();
+    	alder.open_run_store(pars.run_store, pars.maxdis, pars.binsize, pars.mincount,
+    			pars.use_naive_algo);
+    }
+
+    // optional bin-aggregated ingestion: the bin sums of the pairs' runs (with a sweep, of the
+    // first run of each pair), in batches of pairs whose sums fit in bin_ingest_mb, one
+    // genotype pass per batch (ingested in the pair loop)
+    int bin_batch = 0;
+    if (pars.bin_ingest){
+    	double pair_mb = alder.binned_run_bytes(group_runs[0].binsize) / (1<<20);
+    	bin_batch = max(1, (int) min((double) pairs2use.size(), pars.bin_ingest_mb / pair_mb));
+    	if (bin_batch < (int) pairs2use.size())
+    		printf("bin-aggregated ingestion: %.1f MB of bin sums per pair; %d pair(s) per"
+    				" genotype pass\n\n", pair_mb, bin_batch);
+    }
+    // anytime mode: the time budget is shared by the weighted LD runs of all pairs
+    if (!pipeline) alder.set_anytime_num_runs((int) (pairs2use.size() * group_runs.size()));
+    vector<map<string, vector<AlderResults> > > all_curves(configs.size());  //store all pairwise curves --Joe
+    // online_mixfit: 1-mixture fits updated as curves arrive (by config)
+    vector<MultFitALD *> online_fits(configs.size(), (MultFitALD *) NULL);
+    if (pipeline){
+    	// task graph on the OpenMP thread pool: the LD correlation extent of each ref and the
+    	// weighted LD chrom pass of each pair need nothing else; the fits of a pair wait for its
+    	// chrom pass and its refs' fit starts; the reports (all output) follow in pair order.
+    	// tasks run single-threaded, each on its thread's copy of the Alder object
+    	int num_pairs = pairs2use.size();
+    	vector<Alder *> workers(omp_get_max_threads());
+    	for (int t = 0; t < (int) workers.size(); t++) workers[t] = new Alder(alder);
+    	vector<vector<string> > ld_logs(num_ref_freqs);
+    	vector<double> ld_stops(num_ref_freqs);
+    	vector<Alder::RunBins> pair_bins(num_pairs);
+    	vector<char> from_store(num_pairs);
+    	vector<vector<AlderResults> > pair_results(num_pairs);
+    	vector<vector<ExpFitALD> > pair_fits(num_pairs);
+    	vector<int> pair_fit_test_ind(num_pairs, 0);
+    	// dependency tokens (each task also sets its out tokens, marking its step done)
+    	vector<char> deps(num_ref_freqs + 2*num_pairs + 1);
+    	char *ld_done = &deps[0], *curve_done = ld_done + num_ref_freqs,
+    			*fit_done = curve_done + num_pairs, *report_chain = fit_done + num_pairs;
+#pragma omp parallel
+#pragma omp single
+    	{
+    		if (ld_corr_tasks){
+    			for (int r = 0; r < num_ref_freqs; r++){
+#pragma omp task firstprivate(r) depend(out: ld_done[r])
+    				{
+    					ld_stops[r] = workers[omp_get_thread_num()]->find_ld_corr_stop(r,
+    							pars.binsize, pars.approx_ld_corr, ld_logs[r]);
+    					fit_starts[r] = Alder::ld_corr_fit_start(ld_stops[r]);
+    					ld_done[r] = 1;
+    				}
+    			}
+    		}
+    		for (int i = 0; i < num_pairs; i++){
+    			from_store[i] = alder.find_stored_run(2, subtract_freqs(ref_freqs,
+    					pairs2use[i].first, pairs2use[i].second), pars.maxdis, pars.binsize,
+    					pars.mincount, pars.use_naive_algo, pair_bins[i]);
+    			if (from_store[i]) continue;
+#pragma omp task firstprivate(i) depend(out: curve_done[i])
+    			{
+    				pair_bins[i] = workers[omp_get_thread_num()]->compute_run_bins(2,
+    						subtract_freqs(ref_freqs, pairs2use[i].first, pairs2use[i].second),
+    						pars.maxdis, pars.binsize, pars.mincount, pars.use_naive_algo);
+    				curve_done[i] = 1;
+    			}
+    		}
+    		for (int i = 0; i < num_pairs; i++){
+    			int r1 = pairs2use[i].first;
+    			int r2 = pairs2use[i].second;
+#pragma omp task firstprivate(i, r1, r2) depend(in: ld_done[r1], ld_done[r2], curve_done[i]) \
+	depend(out: fit_done[i])
+    			{
+    				pair_results[i] = workers[omp_get_thread_num()]->fit_run_bins(pair_bins[i],
+    						max(fit_starts[r1], fit_starts[r2]), pars.maxdis, pair_fits[i],
+    						pair_fit_test_ind[i]);
+    				fit_done[i] = 1;
+    			}
+    		}
+    		if (ld_corr_tasks){
+    			for (int r = 0; r < num_ref_freqs; r++){
+#pragma omp task firstprivate(r) depend(in: ld_done[r]) depend(inout: report_chain[0])
+    				{} // report only after all refs
+    			}
+#pragma omp task depend(inout: report_chain[0])
+    			{
+    				printhline();
+    				cout << "     *** Determining extent of correlated LD between test and ref pops ***"
+    						<< endl << endl;
+    				for (int level = 0; level < (int) ld_logs[0].size(); level++)
+    					for (int r = 0; r < num_ref_freqs; r++)
+    						cout << ld_logs[r][level];
+    				alder.summarize_ld_corr_stops(ld_stops);
+    			}
+    		}
+    		for (int i = 0; i < num_pairs; i++){
+#pragma omp task firstprivate(i) depend(in: fit_done[i]) depend(inout: report_chain[0])
+    			{
+    				int r1 = pairs2use[i].first;
+    				int r2 = pairs2use[i].second;
+    				string pops = ref_pop_names[r1]+";"+ref_pop_names[r2];
+    				if (pars.bootstrap) pops = pops+"_" + to_str(i);
+    				double fit_start_dis = max(fit_starts[r1], fit_starts[r2]);
+    				vector<int> pair_ref_inds(1, r1); pair_ref_inds.push_back(r2);
+    				printhline();
+    				alder.report_run_bins(2, pair_ref_inds, subtract_freqs(ref_freqs, r1, r2),
+    						pars.mincount, pair_bins[i], from_store[i], pair_results[i],
+    						fit_start_dis, pars.maxdis, pair_fits[i], pair_fit_test_ind[i]);
+    				pair_bins[i] = Alder::RunBins();
+    				if (report_pair_test(pair_results[i], fit_start_dis, pair_fits[i],
+    						pair_fit_test_ind[i], fits_all_starts_refs[r1][fit_test_ind_refs[r1]],
+    						fits_all_starts_refs[r2][fit_test_ind_refs[r2]], mixed_pop_name,
+    						ref_pop_names[r1], ref_pop_names[r2], pars.print_jackknife_fits, timer))
+    				{
+    					all_curves[0].insert(make_pair(pops, pair_results[i]));
+    					if (pars.online_mixfit) update_online_fit(online_fits[0], all_curves[0]);
+    				}
+    				pair_results[i].clear(); pair_fits[i].clear();
+    				report_chain[0]++;
+    			}
+    		}
+    	}
+    	for (int t = 0; t < (int) workers.size(); t++) delete workers[t];
+    }
+    for (int i = 0; i < (int) pairs2use.size() && !pipeline; i++){
+    	if (bin_batch && i % bin_batch == 0){
+    		printhline();
+    		vector<vector<double> > pair_weights;
+    		for (int j = i; j < min(i + bin_batch, (int) pairs2use.size()); j++)
+    			pair_weights.push_back(subtract_freqs(ref_freqs, pairs2use[j].first,
+    					pairs2use[j].second));
+    		alder.prepare_binned_runs(pair_weights, group_runs[0].binsize, group_runs[0].mincount,
+    				pars.use_naive_algo);
+    	}
     	pair<int, int> pp = pairs2use[i];
     	stringstream tmpss;
     	tmpss << i;
@@ -355,29 +736,54 @@ int main(int argc, char *argv[]) {
     	string pops = ref_pop_names[r1]+";"+ref_pop_names[r2];
     	if (pars.bootstrap) pops = pops+"_" + stri;
     	//	cout << pops << "\n";
-    	printhline();
-    	double fit_start_dis = max(fit_starts[r1], fit_starts[r2]);
-    	vector <ExpFitALD> fits_all_starts; int fit_test_ind = 0;
     	weights = subtract_freqs(ref_freqs, r1, r2);
     	ref_inds.resize(2); ref_inds[0] = r1; ref_inds[1] = r2;
-    	vector <AlderResults> results_jackknife =
-    			alder.run(2, ref_inds, weights, pars.maxdis, pars.binsize, pars.mincount,
-    					pars.use_naive_algo, fit_start_dis, fits_all_starts, fit_test_ind);
-    	plot_ascii_curve(results_jackknife.back(), fit_start_dis);
-
-    	for (int f = 0; f < (int) fits_all_starts.size(); f++)
-    		fits_all_starts[f].print_fit(pars.print_jackknife_fits);
-
-    	cout << "==> Time to run fits: " << timer.update_time() << endl << endl;
-
-    	bool success = ExpFitALD::run_admixture_test(fits_all_starts[fit_test_ind],
-    			fits_all_starts_refs[r1][fit_test_ind_refs[r1]],
-    			fits_all_starts_refs[r2][fit_test_ind_refs[r2]],
-    			mixed_pop_name, ref_pop_names[r1], ref_pop_names[r2],
-    			false, 1);
-
-    	if (success) all_curves.insert(make_pair(pops, results_jackknife));
+    	for (int g = 0; g < (int) group_runs.size(); g++){
+    		printhline();
+    		const SweepConfig &run = group_runs[g];
+    		const vector<double> &run_starts = fit_starts_by_binsize[run.binsize];
+    		double run_fit_start = max(run_starts[r1], run_starts[r2]);
+    		vector <ExpFitALD> run_fits; int run_fit_test_ind = 0;
+    		vector <AlderResults> run_results =
+    				alder.run(2, ref_inds, weights, run.maxdis, run.binsize, run.mincount,
+    						pars.use_naive_algo, run_fit_start, run_fits, run_fit_test_ind);
+    		for (int k = 0; k < (int) configs.size(); k++){
+    			if (config_group[k] != g) continue;
+    			const SweepConfig &config = configs[k];
+    			const vector<double> &config_starts = fit_starts_by_binsize[config.binsize];
+    			double fit_start_dis = max(config_starts[r1], config_starts[r2]);
+    			vector <ExpFitALD> fits_all_starts = run_fits; int fit_test_ind = run_fit_test_ind;
+    			vector <AlderResults> results_jackknife = run_results;
+    			if (sweep) printf("SWEEP:\t%d\t%s\t%s\n\n", k+1, pops.c_str(), config.desc.c_str());
+    			if (config.binsize != run.binsize || config.maxdis != run.maxdis
+    					|| fit_start_dis != run_fit_start
+    					|| !config.chrom_set.empty() || !config.nochrom_set.empty())
+    				results_jackknife = alder.refit_last_run(config.binsize, config.maxdis,
+    						config.chrom_set, config.nochrom_set, fit_start_dis, fits_all_starts,
+    						fit_test_ind);
+    			bool success = report_pair_test(results_jackknife, fit_start_dis,
+    					fits_all_starts, fit_test_ind,
+    					fits_all_starts_refs[r1][fit_test_ind_refs[r1]],
+    					fits_all_starts_refs[r2][fit_test_ind_refs[r2]], mixed_pop_name,
+    					ref_pop_names[r1], ref_pop_names[r2], pars.print_jackknife_fits, timer);
+
+    			if (success){
+    				all_curves[k].insert(make_pair(pops, results_jackknife));
+    				if (pars.online_mixfit) update_online_fit(online_fits[k], all_curves[k]);
+    			}
+    		}
+    	}
+    }
 
+    if (!screened_out.empty()){
+    	printhline();
+    	cout << "Pairs skipped by pre-screen (screening z < " << ADMIXTURE_TEST_Z_THRESH
+    			<< " - " << pars.prescreen_margin << "):" << endl;
+    	for (int i = 0; i < (int) screened_out.size(); i++)
+    		printf("SKIPPED:\t%s\t%s\t%s\t%.2f\n", mixed_pop_name.c_str(),
+    				ref_pop_names[screened_out[i].first].c_str(),
+    				ref_pop_names[screened_out[i].second].c_str(), screen_zs[screened_out[i]]);
+    	cout << endl;
     }
 
 
@@ -386,33 +792,55 @@ int main(int argc, char *argv[]) {
     //
     // Joe's edits
     //
-    if (all_curves.size() > 1){
-    	bool done = false;
-    	MultFitALD mfit(1, &all_curves);
-    	pair< vector<double>, map <string, vector<double> > > fit = mfit.GSL_optim();
-    	pair< vector<vector<double> >, vector<map <string, vector<double> > > > jk = mfit.GSL_jack();
-    	//pair< vector<double>, map <string, vector<double> > > fit = mfit.fit_curves_nnls();
-    	//pair< vector<vector<double> >, vector<map <string, vector<double> > > > jk = mfit.jackknife();
-    	done = mfit.print_fitted(&fit, &jk);
-
-    	while (!done){
-    		fit = mfit.add_mix();
-    		//if (mfit.nmix == 2) {
-    		//	cout << mfit.ss() << " fitted\n"; cout.flush();
-    		//	mfit.GSL_optim();
-    		//	cout << mfit.ss() << " after\n"; cout.flush();
-    		//}
-
-    		jk = mfit.GSL_jack();
-    		done = mfit.print_fitted(&fit, &jk);
+    for (int k = 0; k < (int) configs.size(); k++){
+    	if (sweep){
+    		printhline();
+    		printf("SWEEP:\t%d\t%s\tmixture fit\n\n", k+1, configs[k].desc.c_str());
     	}
-    	if (pars.raw_outname != NULL) {
-    		mfit.print_curves(pars.raw_outname);
+    	if (all_curves[k].size() > 1){
+    		bool done = false;
+    		if (pars.online_mixfit) update_online_fit(online_fits[k], all_curves[k], true);
+    		MultFitALD mfit(1, &all_curves[k]);
+    		if (online_fits[k] != NULL){ // warm start from the online fit
+    			mfit.times = online_fits[k]->times;
+    			delete online_fits[k];
+    		}
+    		pair< vector<double>, map <string, vector<double> > > fit;
+    		pair< vector<vector<double> >, vector<map <string, vector<double> > > > jk;
+    		if (pars.speculative_mixfit > 1) // the next few mixture counts at once
+    			done = mfit.GSL_speculate(pars.speculative_mixfit, &fit, &jk);
+    		else {
+    			fit = mfit.GSL_optim();
+    			jk = mfit.GSL_jack();
+    			//pair< vector<double>, map <string, vector<double> > > fit = mfit.fit_curves_nnls();
+    			//pair< vector<vector<double> >, vector<map <string, vector<double> > > > jk = mfit.jackknife();
+    			done = mfit.print_fitted(&fit, &jk);
+    		}
+
+    		while (!done){
+    			fit = mfit.add_mix();
+    			//if (mfit.nmix == 2) {
+    			//	cout << mfit.ss() << " fitted\n"; cout.flush();
+    			//	mfit.GSL_optim();
+    			//	cout << mfit.ss() << " after\n"; cout.flush();
+    			//}
+
+    			jk = mfit.GSL_jack();
+    			done = mfit.print_fitted(&fit, &jk);
+    		}
+    		if (pars.raw_outname != NULL) {
+    			stringstream raw_name;
+    			raw_name << pars.raw_outname;
+    			if (sweep) raw_name << ".sweep" << k+1;
+    			mfit.print_curves(raw_name.str().c_str());
+    		}
     	}
     }
   }
 
 
+  alder.close_run_store();
+  alder.close_sample_loo();
   delete[] mixed_geno;
   for (int r = 0; r < (int) num_ref_indivs.size(); r++) delete[] ref_genos[r];
 }
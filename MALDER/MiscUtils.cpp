@@ -6,6 +6,7 @@
 #include <utility>
 #include <map>
 #include <cstdio>
+#include <cstdarg>
 #include <cmath>
 #include "Alder.hpp"
 #include "MiscUtils.hpp"
@@ -128,4 +129,13 @@ namespace ALD {
   }
 
   string to_str(double x) { ostringstream oss; oss << x; return oss.str(); }
+
+  string str_printf(const char *format, ...) {
+    char buf[1000];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    return string(buf);
+  }
 }
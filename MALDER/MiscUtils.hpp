@@ -15,5 +15,6 @@ namespace ALD {
   void write_raw_output(const char *filename, bool print_raw_jackknife,
 			const vector <AlderResults> &results_jackknife);
   string to_str(double x);
+  string str_printf(const char *format, ...); // printf to a string
 
 }
@@ -19,26 +19,28 @@ MultFitALD::MultFitALD(int n, map<string, vector<AlderResults> >* ma){
     resphi = 2-phi;
 }
 
+// adds the squared residuals of curve r (bins past fit_start_dis) under the current times
+// (scalar exp with serial accumulation: no instruction set variants, see CpuKernels)
+double MultFitALD::curve_ss(double acc, const AlderResults &r, const vector<double> &amps){
+	int nbins = (int) r.bin_count.size()-1;
+	if (nbins == 0) return acc;
+	double affine = r.weighted_LD_avg[nbins];
+	for (int i = 0; i < nbins; i++){
+		double d = r.d_Morgans[i];
+		if (d < r.fit_start_dis) continue;
+		double pred = affine;
+		for (int j = 0; j < nmix; j++) pred += amps[j] * exp(-d * times[j]);
+		double diff = pred - r.weighted_LD_avg[i];
+		acc += diff * diff;
+	}
+	return acc;
+}
+
 double MultFitALD::ss(){
 	double toreturn = 0;
 	for (map<string, vector<AlderResults> >::iterator it = curves->begin(); it != curves->end(); it++){
-		string ps = it->first;
-		AlderResults r = it->second.back();
-
-		vector<double> amps = expamps[ps];
-		double affine = r.weighted_LD_avg[r.bin_count.size()-1];
-		for (int i =0; i < (int) r.bin_count.size()-1; i++){
-			double d = r.d_Morgans[i];
-			if (d < r.fit_start_dis) continue;
-			double pred = affine;
-			for (int j = 0; j < nmix; j++){
-				pred += amps[j] * exp(-d* times[j]);
-			}
-			//if (ps == "French;Ju|'hoan_North") cout << ps << " "<< i << " "<< d << " "<< pred << " "<< r.weighted_LD_avg[i] <<" "<< amps[0]<<" "<< amps[1]<< " "<< times[0]<< " "<< times[1]<< " "<< affine << "\n";
-			double diff = pred-r.weighted_LD_avg[i];
-			double toadd = diff*diff;
-			toreturn+= toadd;
-		}
+		const AlderResults &r = it->second.back();
+		toreturn = curve_ss(toreturn, r, expamps[it->first]);
 	}
 	return toreturn*100000;
 }
@@ -221,23 +223,8 @@ double GSL_ss_jack(const gsl_vector *x, void *params ){
 double MultFitALD::ss(int which){
 	double toreturn = 0;
 	for (map<string, vector<AlderResults> >::iterator it = curves->begin(); it != curves->end(); it++){
-		string ps = it->first;
-		AlderResults r = it->second[which];
-
-		vector<double> amps = expamps[ps];
-		double affine = r.weighted_LD_avg[r.bin_count.size()-1];
-		for (int i =0; i < (int) r.bin_count.size()-1; i++){
-			double d = r.d_Morgans[i];
-			if (d < r.fit_start_dis) continue;
-			double pred = affine;
-			for (int j = 0; j < nmix; j++){
-				pred += amps[j] * exp(-d* times[j]);
-			}
-			//if (ps == "French;Ju|'hoan_North") cout << ps << " "<< i << " "<< d << " "<< pred << " "<< r.weighted_LD_avg[i] <<" "<< amps[0]<<" "<< amps[1]<< " "<< times[0]<< " "<< times[1]<< " "<< affine << "\n";
-			double diff = pred-r.weighted_LD_avg[i];
-			double toadd = diff*diff;
-			toreturn+= toadd;
-		}
+		const AlderResults &r = it->second[which];
+		toreturn = curve_ss(toreturn, r, expamps[it->first]);
 	}
 	return toreturn*100000;
 }
@@ -794,6 +781,11 @@ pair< vector<double>, map <string, vector<double> > > MultFitALD::add_mix(){
 	return(GSL_optim());
 }
 
+// a curve added to the map since construction (amplitudes are set by the next fit)
+void MultFitALD::add_curve(const string &ps){
+	if (expamps.count(ps) == 0) expamps.insert(make_pair(ps, vector<double>(nmix, 0.001)));
+}
+
 pair< vector<vector<double> >, vector<map<string, vector<double> > > > MultFitALD::jackknife(){
 	pair<vector<vector<double> >, vector<map<string, vector<double> > > > toreturn;
 	vector<AlderResults> r = curves->begin()->second;
@@ -848,6 +840,62 @@ pair< vector<vector<double> >, vector<map<string, vector<double> > > > MultFitAL
 	return toreturn;
 }
 
+// speculative model-size search: fits the next nspec mixture counts (this one, then add_mix)
+// with their jackknives at once, and prints them in order up to the first that meets the
+// stopping rule of print_fitted. Each model is seeded from the last jackknife rep of the one
+// below, as in the sequential GSL_optim / GSL_jack / add_mix loop, so only that chain runs
+// serially; the other reps of all the models run on the thread pool. Output and results are
+// those of the sequential loop, and the object, fit and jk are left as it would leave them.
+bool MultFitALD::GSL_speculate(int nspec, pair< vector<double>, map <string, vector<double> > > *fit,
+		pair< vector<vector<double> >, vector<map <string, vector<double> > > > *jk){
+	int njack = curves->begin()->second.size()-1;
+	vector<MultFitALD> models; // each after its full-data fit
+	vector< pair< vector<double>, map <string, vector<double> > > > fits(nspec);
+	vector< pair< vector<vector<double> >, vector<map <string, vector<double> > > > > jks(nspec);
+	for (int k = 0; k < nspec; k++){
+		fits[k] = k == 0 ? GSL_optim() : add_mix();
+		models.push_back(*this);
+		jks[k].first.resize(njack);
+		jks[k].second.resize(njack);
+		if (k < nspec-1 && njack > 0){ // the last rep seeds the next model
+			GSL_optim(njack-1);
+			jks[k].first[njack-1] = times;
+			jks[k].second[njack-1] = expamps;
+		}
+	}
+	vector< pair<int, int> > reps; // (model, rep) left to fit
+	for (int k = 0; k < nspec; k++)
+		for (int i = 0; i < njack; i++)
+			if (k == nspec-1 || i < njack-1) reps.push_back(make_pair(k, i));
+#pragma omp parallel for schedule(dynamic)
+	for (int t = 0; t < (int) reps.size(); t++){
+		int k = reps[t].first, i = reps[t].second;
+		MultFitALD m = models[k];
+		m.GSL_optim(i);
+		jks[k].first[i] = m.times;
+		jks[k].second[i] = m.expamps;
+	}
+	bool done = false;
+	for (int k = 0; k < nspec; k++){
+		MultFitALD &m = models[k];
+		for (int i = 0; i < njack; i++){
+			m.times = jks[k].first[i];
+			m.expamps = jks[k].second[i];
+			stringstream ss;
+			ss << i;
+			m.print_fitted(ss.str());
+		}
+		done = m.print_fitted(&fits[k], &jks[k]);
+		if (done || k == nspec-1){
+			*this = m;
+			*fit = fits[k];
+			*jk = jks[k];
+			break;
+		}
+	}
+	return done;
+}
+
 void MultFitALD::print_curves(const char* outname){
 	ofstream outfile(outname);
 	outfile << "d ";
@@ -37,6 +37,7 @@ public:
 	map<string, double> affine_amps;
 	double ss();
 	double ss(int);
+	double curve_ss(double, const AlderResults &, const vector<double> &);
 	pair< vector<double>, map <string, vector<double> > > fit_curves();
 	pair< vector<double>, map <string, vector<double> > > fit_curves_nnls();
 	void fit_curves_jack(int);
@@ -52,6 +53,7 @@ public:
 	bool print_fitted(pair< vector<double>, map <string, vector<double> > >* , pair< vector<vector<double> >, vector<map <string, vector<double> > > >*);
 	void print_fitted(string);
 	pair< vector<double>, map <string, vector<double> > > add_mix();
+	void add_curve(const string &);
 	pair< vector<vector<double> >, vector<map <string, vector<double> > > > jackknife();
 	void print_curves(const char *);
 
@@ -59,6 +61,7 @@ public:
 	double nelder_term;
 	pair< vector<double>, map<string, vector<double> > > GSL_optim();
 	pair< vector<vector<double> >, vector<map <string, vector<double> > > >  GSL_jack();
+	bool GSL_speculate(int, pair< vector<double>, map <string, vector<double> > > *, pair< vector<vector<double> >, vector<map <string, vector<double> > > > *);
 	void GSL_optim(int);
 	//double get_timese(int, vector<double>, vector< vector<double> >);
 };
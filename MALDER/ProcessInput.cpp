@@ -4,6 +4,20 @@
 #include <utility>
 #include <algorithm>
 #include <set>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <omp.h>
+#include <zlib.h>
+#ifdef MALDER_ZSTD
+#include <zstd.h>
+#endif
 
 #include "mcio.h"
 #include "egsubs.h"
@@ -21,78 +35,469 @@ namespace ProcessInput {
   using std::make_pair;
   using std::set;
   using std::max;
+  using std::min;
   using std::count;
 
-  const int ADMIXED_POP_IND = 9999; // for use in process_indivs, process_geno
-
-  int cmap(SNP **snpmarkers, int numsnps) {
+  int cmap(const SnpTable &snps) {
     int t, k ; 
     double y1, y2 ; 
-    SNP *cupt ;  
     for (k=1 ; k<=10; ++k) { 
-      t = ranmod(numsnps) ;
-      cupt = snpmarkers[t] ; 
-      y1 = cupt -> genpos ; 
-      y2 = cupt -> physpos / 1.0e8  ; 
+      t = ranmod(snps.size()) ;
+      y1 = snps.genpos[t] ; 
+      y2 = snps.physpos[t] / 1.0e8  ; 
       if (fabs(y1-y2) > .001) return YES ;
     }
     return NO ;
   }
 
+  static unsigned int hash_id(const char *id, int len) { // FNV-1a
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < len; i++)
+      h = (h ^ (unsigned char) id[i]) * 16777619u;
+    return h;
+  }
+
+  void SnpTable::build_id_index(void) {
+    int cap = 1;
+    while (cap < 2*size()) cap <<= 1;
+    id_hash.assign(cap, -1);
+    for (int s = 0; s < size(); s++) {
+      int len = id_start[s+1] - id_start[s] - 1;
+      unsigned int h = hash_id(id(s), len) & (cap-1);
+      while (id_hash[h] != -1) {
+	if (strcmp(id(id_hash[h]), id(s)) == 0) break; // duplicate ID: keep first
+	h = (h+1) & (cap-1);
+      }
+      if (id_hash[h] == -1) id_hash[h] = s;
+    }
+  }
+
+  int SnpTable::find(const char *str, int len) const {
+    unsigned int mask = id_hash.size()-1;
+    for (unsigned int h = hash_id(str, len) & mask; id_hash[h] != -1; h = (h+1) & mask) {
+      int s = id_hash[h];
+      if (id_start[s+1] - id_start[s] - 1 == len && memcmp(id(s), str, len) == 0)
+	return s;
+    }
+    return -1;
+  }
+
+  // splits [p, end) into whitespace-delimited tokens; returns the number of tokens (storing at
+  // most max_toks)
+  static int split_line(const char *p, const char *end, const char **toks, int *lens,
+			int max_toks) {
+    int n = 0;
+    while (true) {
+      while (p < end && isspace((unsigned char) *p)) p++;
+      if (p == end) return n;
+      const char *tok = p;
+      while (p < end && !isspace((unsigned char) *p)) p++;
+      if (n < max_toks) {
+	toks[n] = tok;
+	lens[n] = p - tok;
+      }
+      n++;
+    }
+  }
+
+  static bool is_tok(const char *tok, int len, const char *str) {
+    return len == (int) strlen(str) && memcmp(tok, str, len) == 0;
+  }
+
+  // header and comment lines, as in admixtools (mcio.c: setskipit)
+  static bool skip_header_line(const char *tok, int len) {
+    return tok[0] == '#' || is_tok(tok, len, "SNP_ID") || is_tok(tok, len, "Indiv_ID")
+      || is_tok(tok, len, "Chr");
+  }
+
+  static void tok_copy(const char *tok, int len, char *buf, int buf_size) {
+    if (len > buf_size-1) len = buf_size-1;
+    memcpy(buf, tok, len);
+    buf[len] = '\0';
+  }
+
+  static double tok_atof(const char *tok, int len) {
+    char buf[64];
+    tok_copy(tok, len, buf, sizeof(buf));
+    return atof(buf);
+  }
+
+  static string line_str(const char *line, const char *end) {
+    const char *eol = (const char *) memchr(line, '\n', end - line);
+    return string(line, eol == NULL ? end : eol);
+  }
+
+  // a piece of the snp file, starting and ending at line boundaries
+  struct SnpChunk {
+    const char *begin, *end;
+    int num_snps, snp_offset;
+    long num_id_chars, id_offset;
+    const char *bad_line, *cm_line, *absurd_line; // first occurrences in this chunk
+    vector <const char *> bad_chrom_lines; // first 10
+    int num_bad_chrom, max_chrom;
+    double max_genpos;
+  };
+
+  static const int MAX_BAD_CHROM_WARNINGS = 10;
+
+  // parse: false to count records (and ID chars) only, true to fill snps at chunk offsets
+  static void scan_snp_chunk(SnpChunk &chunk, bool parse, SnpTable &snps) {
+    const int MAX_TOKS = 4;
+    const char *toks[MAX_TOKS]; int lens[MAX_TOKS];
+    int s = chunk.snp_offset;
+    long c = chunk.id_offset;
+    for (const char *line = chunk.begin; line < chunk.end; ) {
+      const char *eol = (const char *) memchr(line, '\n', chunk.end - line);
+      if (eol == NULL) eol = chunk.end;
+      int nsplit = split_line(line, eol, toks, lens, MAX_TOKS);
+      if (nsplit > 0 && !skip_header_line(toks[0], lens[0])) {
+	if (!parse) {
+	  if (nsplit < 4 && chunk.bad_line == NULL) chunk.bad_line = line;
+	  chunk.num_snps++;
+	  chunk.num_id_chars += lens[0] + 1;
+	}
+	else {
+	  memcpy(&snps.id_chars[c], toks[0], lens[0]);
+	  snps.id_chars[c + lens[0]] = '\0';
+	  snps.id_start[s] = c;
+	  c += lens[0] + 1;
+
+	  char buf[64];
+	  tok_copy(toks[1], lens[1], buf, sizeof(buf));
+	  int chrom = str2chrom(buf);
+	  snps.ignore[s] = NO;
+	  if (chrom > chunk.max_chrom || chrom <= 0) {
+	    if ((int) chunk.bad_chrom_lines.size() < MAX_BAD_CHROM_WARNINGS)
+	      chunk.bad_chrom_lines.push_back(line);
+	    chunk.num_bad_chrom++;
+	    chrom = max(chrom, 0);
+	    snps.ignore[s] = YES;
+	  }
+	  snps.chrom[s] = chrom;
+
+	  double genpos = snps.genpos[s] = tok_atof(toks[2], lens[2]);
+	  if (genpos > 100) { // cM
+	    if (genpos > 1.0e6 && chunk.absurd_line == NULL) chunk.absurd_line = line;
+	    if (chunk.cm_line == NULL) chunk.cm_line = line;
+	  }
+	  chunk.max_genpos = max(chunk.max_genpos, genpos);
+	  snps.physpos[s] = tok_atof(toks[3], lens[3]);
+	  s++;
+	}
+      }
+      line = eol + 1;
+    }
+  }
+
+  // reads a snp file (EIGENSTRAT/ANCESTRYMAP layout) with the same conventions as admixtools'
+  // getsnps (comment lines, chrom names, cM detection, positions from physical positions) but in
+  // file order, in one pass over the mmapped file split across threads
+  // verbatim: skip the cM and physical position conversions
+  // max_chrom: largest valid chrom label
+  static void load_snp_table(char *snpname, bool verbatim, int max_chrom, SnpTable &snps) {
+    int fd = open(snpname, O_RDONLY);
+    if (fd < 0) fatalx("unable to open snp file: %s\n", snpname);
+    struct stat st;
+    if (fstat(fd, &st) != 0) fatalx("unable to stat snp file: %s\n", snpname);
+    long len = st.st_size;
+    if (len == 0) fatalx("no snps found: snpfname: %s\n", snpname);
+    const char *buf = (const char *) mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (buf == MAP_FAILED) fatalx("unable to map snp file: %s\n", snpname);
+
+    int num_chunks = omp_get_max_threads();
+    vector <SnpChunk> chunks(num_chunks);
+    const char *start = buf;
+    for (int t = 0; t < num_chunks; t++) {
+      SnpChunk &chunk = chunks[t];
+      chunk.begin = start;
+      const char *stop = buf + len * (t+1) / num_chunks;
+      if (stop < start) stop = start;
+      if (stop > buf && stop < buf + len) { // move to the next line boundary
+	const char *eol = (const char *) memchr(stop-1, '\n', buf + len - (stop-1));
+	stop = eol == NULL ? buf + len : eol + 1;
+      }
+      chunk.end = start = stop;
+      chunk.num_snps = 0; chunk.num_id_chars = 0;
+      chunk.bad_line = chunk.cm_line = chunk.absurd_line = NULL;
+      chunk.num_bad_chrom = 0;
+      chunk.max_chrom = max_chrom;
+      chunk.max_genpos = -9999.0;
+    }
+
+#pragma omp parallel for schedule(static, 1)
+    for (int t = 0; t < num_chunks; t++)
+      scan_snp_chunk(chunks[t], false, snps);
+
+    int numsnps = 0; long num_id_chars = 0;
+    for (int t = 0; t < num_chunks; t++) {
+      if (chunks[t].bad_line != NULL)
+	fatalx("(readsnpdata) bad line: %s\n",
+	       line_str(chunks[t].bad_line, chunks[t].end).c_str());
+      chunks[t].snp_offset = numsnps; numsnps += chunks[t].num_snps;
+      chunks[t].id_offset = num_id_chars; num_id_chars += chunks[t].num_id_chars;
+    }
+    if (numsnps == 0) fatalx("no snps found: snpfname: %s\n", snpname);
+    snps.chrom.resize(numsnps);
+    snps.genpos.resize(numsnps);
+    snps.physpos.resize(numsnps);
+    snps.ignore.resize(numsnps);
+    snps.id_chars.resize(num_id_chars);
+    snps.id_start.resize(numsnps+1);
+    snps.id_start[numsnps] = num_id_chars;
+    snps.id_hash.clear();
+
+#pragma omp parallel for schedule(static, 1)
+    for (int t = 0; t < num_chunks; t++)
+      scan_snp_chunk(chunks[t], true, snps);
+
+    string cm_line;
+    double maxg = -9999.0;
+    int num_bad_chrom = 0;
+    for (int t = 0; t < num_chunks; t++) {
+      if (chunks[t].absurd_line != NULL)
+	fatalx("absurd genetic distance:\n%s\n",
+	       line_str(chunks[t].absurd_line, chunks[t].end).c_str());
+      if (cm_line.empty() && chunks[t].cm_line != NULL)
+	cm_line = line_str(chunks[t].cm_line, chunks[t].end);
+      maxg = max(maxg, chunks[t].max_genpos);
+      for (int i = 0; i < (int) chunks[t].bad_chrom_lines.size(); i++)
+	if (num_bad_chrom + i < MAX_BAD_CHROM_WARNINGS)
+	  printf("warning: bad chrom: %s\n",
+		 line_str(chunks[t].bad_chrom_lines[i], chunks[t].end).c_str());
+      num_bad_chrom += chunks[t].num_bad_chrom;
+    }
+    munmap((void *) buf, len);
+    close(fd);
+
+    if (verbatim) return;
+    // the genetic positions are converted to Morgans (assumed to be in cM) if and only if any
+    // genetic position is greater than 100
+    bool usecm = !cm_line.empty();
+    if (usecm) {
+      printf("*** warning.  genetic distances are in cM not Morgans\n");
+      printf("%s\n", cm_line.c_str());
+    }
+    // if all genetic positions are set to zero, set from physical position
+    if (maxg <= 0.00001) {
+      printf("genetic distance set from physical distance\n");
+      usecm = false;
+      for (int s = 0; s < numsnps; s++)
+	snps.genpos[s] = 1.0e-8 * snps.physpos[s];
+    }
+    if (usecm)
+      for (int s = 0; s < numsnps; s++)
+	snps.genpos[s] /= 100.0;
+    if (isnumword((char *) snps.id(0)))
+      printf("*** warning: first snp is number.  perhaps you are using .map format\n");
+  }
+
+  static bool is_plink_map(const char *snpname) {
+    string name(snpname);
+    const char *exts[3] = {".map", ".bim", ".pedsnp"};
+    for (int i = 0; i < 3; i++) {
+      int n = strlen(exts[i]);
+      if ((int) name.size() >= n && name.compare(name.size()-n, n, exts[i]) == 0)
+	return true;
+    }
+    return false;
+  }
+
+  // the admixtools readers (getsnps, getindivs) keep global and static state: one at a time
+  static pthread_mutex_t admixtools_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+  static bool is_plink_ind(const char *indivname) { // as admixtools' ispedfile
+    string name(indivname);
+    const char *exts[3] = {".ped", ".fam", ".pedind"};
+    for (int i = 0; i < 3; i++) {
+      int n = strlen(exts[i]);
+      if ((int) name.size() >= n && name.compare(name.size()-n, n, exts[i]) == 0)
+	return true;
+    }
+    return false;
+  }
+
+  // PLINK map files have a different column layout: read with admixtools and copy into snps
+  static void load_snp_table_getsnps(char *snpname, char *badsnpname, SnpTable &snps) {
+    SNP **snpmarkers;
+    int nignore = 0;
+    pthread_mutex_lock(&admixtools_mutex);
+    int numsnps = getsnps(snpname, &snpmarkers, 0.0, badsnpname, &nignore, 0);
+    snps.chrom.resize(numsnps);
+    snps.genpos.resize(numsnps);
+    snps.physpos.resize(numsnps);
+    snps.ignore.resize(numsnps);
+    snps.id_start.resize(numsnps+1);
+    snps.id_chars.clear();
+    snps.id_hash.clear();
+    for (int s = 0; s < numsnps; s++) {
+      SNP *cupt = snpmarkers[s];
+      snps.chrom[s] = cupt->chrom;
+      snps.genpos[s] = cupt->genpos;
+      snps.physpos[s] = cupt->physpos;
+      snps.ignore[s] = cupt->ignore;
+      snps.id_start[s] = snps.id_chars.size();
+      snps.id_chars.insert(snps.id_chars.end(), cupt->ID, cupt->ID + strlen(cupt->ID) + 1);
+    }
+    pthread_mutex_unlock(&admixtools_mutex);
+    snps.id_start[numsnps] = snps.id_chars.size();
+  }
+
+  // badsnp file: ignore listed snps (unless the second column is "fake"), as admixtools does
+  static void apply_badsnps(char *badsnpname, SnpTable &snps) {
+    FILE *bad_file = fopen(badsnpname, "r");
+    if (bad_file == NULL) fatalx("unable to open badsnp file: %s\n", badsnpname);
+    if (snps.id_hash.empty()) snps.build_id_index();
+    const int MAX_TOKS = 2;
+    const char *toks[MAX_TOKS]; int lens[MAX_TOKS];
+    const int buf_size = 1024;
+    char line[buf_size];
+    while (fgets(line, buf_size, bad_file) != NULL) {
+      int nsplit = split_line(line, line + strlen(line), toks, lens, MAX_TOKS);
+      if (nsplit == 0 || toks[0][0] == '#') continue;
+      int s = snps.find(toks[0], lens[0]);
+      if (s >= 0) {
+	snps.ignore[s] = YES;
+	if (nsplit >= 2 && lens[1] == 4 && tolower(toks[1][0]) == 'f'
+	    && memcmp(toks[1]+1, "ake", 3) == 0)
+	  snps.ignore[s] = NO;
+      }
+    }
+    fclose(bad_file);
+  }
+
   // returns locations (chrom, genpos) of valid (i.e., non-ignore) snps
   vector < pair <int, double> > process_snps(char *snpname, char *badsnpname, bool fast_snp_read,
-					     SNP ***snpmarkers_ptr, int checkmap, int &numsnps,
+					     SnpTable &snps, int checkmap,
 					     const set <int> &chrom_set,
-					     const set <int> &nochrom_set) {
-    int nignore = 0;
-    if (fast_snp_read) {
-      numsnps = 0;
-      FILE *snp_file = fopen(snpname, "r");
-      if (snp_file == NULL) fatalx("unable to open geno file\n");
-      const int buf_size = 1024;
-      char line[buf_size];
-      while (fgets(line, buf_size, snp_file) != NULL)
-	numsnps++;
-      ZALLOC(*snpmarkers_ptr, numsnps, SNP *);
-      ZALLOC((*snpmarkers_ptr)[0], numsnps, SNP);
-      fseek(snp_file, 0, SEEK_SET);
-      for (int s = 0; s < numsnps; s++) {
-	SNP * &cupt = (*snpmarkers_ptr)[s]; // &cupt: need to allocate the actual pointer
-	cupt = (*snpmarkers_ptr)[0] + s;
-	fgets(line, buf_size, snp_file);
-	sscanf(line, "%s%d%lf%lfd", cupt->ID, &cupt->chrom, &cupt->genpos, &cupt->physpos);
-      }
-      fclose(snp_file);
+					     const set <int> &nochrom_set, int max_chrom) {
+    if (is_plink_map(snpname))
+      load_snp_table_getsnps(snpname, badsnpname, snps);
+    else {
+      load_snp_table(snpname, fast_snp_read, max(max_chrom, MAXCH-1), snps);
+      if (badsnpname != NULL)
+	apply_badsnps(badsnpname, snps);
     }
-    else
-      numsnps = getsnps(snpname, snpmarkers_ptr, 0.0, badsnpname, &nignore, 0) ;
+    int numsnps = snps.size();
 
-    if (checkmap && (cmap(*snpmarkers_ptr, numsnps) == NO)) { 
+    if (checkmap && (cmap(snps) == NO)) { 
       printf("Error: genetic map from snp file looks fake.  "
 	     "If you mean to do this set checkmap: NO\n") ;
       fatalx("no real map\n") ;
     }
+    vector <double>().swap(snps.physpos); // only needed for checkmap
 
     vector < pair <int, double> > snp_locs;
     for (int i=0; i<numsnps; ++i) {
-      SNP *cupt = (*snpmarkers_ptr)[i] ;
-      //cupt -> tagnumber = i ;
-      int chrom = cupt -> chrom ; 
+      int chrom = snps.chrom[i] ; 
     
-      if (chrom<1) cupt -> ignore = YES ;
-      if (chrom>22) cupt -> ignore = YES ;
-      //if ((xchrom>0) && (chrom != xchrom)) cupt -> ignore = YES ;
-      //if (chrom == xnochrom) cupt -> ignore = YES ;
-      if (!chrom_set.empty() && !chrom_set.count(chrom)) cupt -> ignore = YES;
-      if (nochrom_set.count(chrom)) cupt -> ignore = YES;
-      if (cupt -> ignore == NO) snp_locs.push_back(make_pair(chrom, cupt->genpos));
+      if (chrom<1) snps.ignore[i] = YES ;
+      if (chrom>max_chrom) snps.ignore[i] = YES ;
+      if (!chrom_set.empty() && !chrom_set.count(chrom)) snps.ignore[i] = YES;
+      if (nochrom_set.count(chrom)) snps.ignore[i] = YES;
+      if (snps.ignore[i] == NO) snp_locs.push_back(make_pair(chrom, snps.genpos[i]));
     }
     printf("using %d of %d snps in data set\n", (int) snp_locs.size(), numsnps);
     return snp_locs;
   }
 
+  void pack_contigs(vector < pair <int, double> > &snp_locs, double min_span, double gap) {
+    int S = snp_locs.size(), num_contigs = 0, num_packs = 0, label = 0;
+    double pack_span = 0, end = 0; // data span and packed end of the current pack
+    double tot_span = 0, tot_length = 0, pack_start = 0; // summed over packs
+    for (int s = 0, s_end; s < S; s = s_end) {
+      int contig = snp_locs[s].first;
+      for (s_end = s+1; s_end < S && snp_locs[s_end].first == contig; s_end++) ;
+      double start = snp_locs[s].second, span = snp_locs[s_end-1].second - start;
+      double shift = 0; // the first contig of a pack keeps its positions
+      if (num_packs == 0 || pack_span >= min_span) {
+	if (num_packs) tot_length += end - pack_start;
+	num_packs++;
+	label = contig;
+	pack_span = 0;
+	pack_start = start;
+      }
+      else
+	shift = end + gap - start;
+      for (int i = s; i < s_end; i++)
+	snp_locs[i] = make_pair(label, snp_locs[i].second + shift);
+      end = start + shift + span;
+      pack_span += span;
+      tot_span += span;
+      num_contigs++;
+    }
+    if (num_packs) tot_length += end - pack_start;
+    printf("contig packing: %d contigs in %d packs (guard gap %g Morgans)\n", num_contigs,
+	   num_packs, gap);
+    printf("contig packing: data span %g Morgans, packed length %g Morgans\n", tot_span,
+	   tot_length);
+  }
+
+  void load_indiv_table(const char *indivname, IndivTable &indivs) {
+    indivs.ids.clear(); indivs.groups.clear(); indivs.ignore.clear();
+    if (is_plink_ind(indivname)) { // PLINK layout: read with admixtools
+      Indiv **indivmarkers;
+      pthread_mutex_lock(&admixtools_mutex);
+      int numindivs = getindivs((char *) indivname, &indivmarkers);
+      for (int i = 0; i < numindivs; i++) {
+	indivs.ids.push_back(indivmarkers[i]->ID);
+	indivs.groups.push_back(indivmarkers[i]->egroup);
+	indivs.ignore.push_back(indivmarkers[i]->ignore == YES);
+      }
+      pthread_mutex_unlock(&admixtools_mutex);
+      return;
+    }
+
+    FILE *file = fopen(indivname, "r");
+    if (file == NULL) fatalx("unable to open indiv file: %s\n", indivname);
+    vector <char> buf;
+    char block[1<<16];
+    size_t len;
+    while ((len = fread(block, 1, sizeof(block), file)) > 0)
+      buf.insert(buf.end(), block, block + len);
+    fclose(file);
+
+    const int MAX_TOKS = 3;
+    const char *toks[MAX_TOKS]; int lens[MAX_TOKS];
+    const char *end = buf.empty() ? NULL : &buf[0] + buf.size();
+    for (const char *line = buf.empty() ? NULL : &buf[0]; line < end; ) {
+      const char *eol = (const char *) memchr(line, '\n', end - line);
+      if (eol == NULL) eol = end;
+      int nsplit = split_line(line, eol, toks, lens, MAX_TOKS);
+      if (nsplit > 0 && !skip_header_line(toks[0], lens[0])) {
+	if (nsplit < 3) fatalx("%s bad line: %s\n", indivname, string(line, eol).c_str());
+	if (lens[0] >= IDSIZE) fatalx("ID too long: %s\n", string(toks[0], lens[0]).c_str());
+	indivs.ids.push_back(string(toks[0], lens[0]));
+	indivs.groups.push_back(string(toks[2], lens[2]));
+	indivs.ignore.push_back(is_tok(toks[2], lens[2], "Ignore"));
+      }
+      line = eol + 1;
+    }
+    if (indivs.size() == 0) fatalx("no indivs found: indivname: %s\n", indivname);
+  }
+
+  void *IndivLoader::load_main(void *arg) {
+    IndivLoader *loader = (IndivLoader *) arg;
+    load_indiv_table(loader->indivname, loader->indivs);
+    return NULL;
+  }
+
+  IndivLoader::IndivLoader(const char *_indivname, IndivTable &_indivs) :
+    indivname(_indivname), indivs(_indivs), joined(false) {
+    if (pthread_create(&thread, NULL, load_main, this) != 0)
+      fatalx("unable to start indiv file reader thread\n");
+  }
+
+  IndivLoader::~IndivLoader(void) {
+    wait();
+  }
+
+  void IndivLoader::wait(void) {
+    if (!joined) pthread_join(thread, NULL);
+    joined = true;
+  }
+
   // returns map from indices to groups (0, 1, 2, ... for refs, ADMIXPOP_ID for mixed, -1 o/w)
-  vector <int> process_indivs(char *indivname, Indiv ***indivmarkers_ptr, char *admixlist,
+  vector <int> process_indivs(const IndivTable &indivs, char *admixlist,
 			      char *admixpop, char *refpops, char *poplistname,
 			      int &num_mixed_indivs, string &mixed_pop_name,
 			      vector <int> &num_ref_indivs, vector <string> &ref_pop_names) {
@@ -100,7 +505,7 @@ namespace ProcessInput {
     const int MAXPOPS = 1000; // max pops for buffer allocation
 
     num_ref_indivs.clear(); ref_pop_names.clear();
-    int numindivs = getindivs(indivname, indivmarkers_ptr) ;
+    int numindivs = indivs.size() ;
     cout << "num indivs in full data set: " << numindivs << endl;
 
     // map indiv indices to groups
@@ -158,10 +563,10 @@ namespace ProcessInput {
     vector <int> indiv_pop_inds(numindivs, -1);
 
     for (int i=0; i<numindivs; ++i) { 
-      Indiv *indx = (*indivmarkers_ptr)[i] ;
-      if (indx->ignore == YES) continue;
-      int ind_reflist = indxindex(refpoplist, num_refs, indx -> egroup) ;
-      int ind_admixlist = indxindex(admixpoplist, nadmixpop, indx -> egroup) ;
+      if (indivs.ignore[i]) continue;
+      char *egroup = (char *) indivs.groups[i].c_str() ;
+      int ind_reflist = indxindex(refpoplist, num_refs, egroup) ;
+      int ind_admixlist = indxindex(admixpoplist, nadmixpop, egroup) ;
 
       if (ind_reflist >= 0) indiv_pop_inds[i] = ind_reflist;
       if (ind_admixlist >= 0) indiv_pop_inds[i] = ADMIXED_POP_IND;
@@ -185,13 +590,237 @@ namespace ProcessInput {
     return indiv_pop_inds;
   }
 
+  // geno file reader: plain, gzip or (if built with MALDER_ZSTD) zstd input, detected from the
+  // leading magic bytes; compressed input is decompressed by a separate thread into a ring of
+  // chunks that read_line consumes, so parsing overlaps decompression (no temporary files)
+  class GenoFile {
+
+    static const int NUM_CHUNKS = 8, CHUNK_SIZE = 1<<20;
+    enum { PLAIN, GZIP, ZSTD };
+
+    const char *name;
+    FILE *file;
+    int format;
+    // ring of decompressed chunks: chunks [chunk_read, chunk_write) are full
+    vector <char> chunks;
+    int chunk_len[NUM_CHUNKS];
+    long chunk_read, chunk_write;
+    int pos; // read position in chunk chunk_read
+    bool done; // producer finished (all chunks written)
+    const char *error;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    static void *inflate_main(void *arg) {
+      GenoFile *gf = (GenoFile *) arg;
+      gf->error = gf->format == GZIP ? gf->inflate_gzip() : gf->inflate_zstd();
+      pthread_mutex_lock(&gf->mutex);
+      gf->done = true;
+      pthread_cond_broadcast(&gf->cond);
+      pthread_mutex_unlock(&gf->mutex);
+      return NULL;
+    }
+
+    // producer: waits for a free chunk, returns it (or NULL if the reader is closing)
+    char *next_free_chunk(void) {
+      pthread_mutex_lock(&mutex);
+      while (chunk_write - chunk_read == NUM_CHUNKS && !done)
+	pthread_cond_wait(&cond, &mutex);
+      char *chunk = done ? NULL : &chunks[(chunk_write % NUM_CHUNKS) * (long) CHUNK_SIZE];
+      pthread_mutex_unlock(&mutex);
+      return chunk;
+    }
+
+    void publish_chunk(int len) {
+      pthread_mutex_lock(&mutex);
+      chunk_len[chunk_write % NUM_CHUNKS] = len;
+      chunk_write++;
+      pthread_cond_broadcast(&cond);
+      pthread_mutex_unlock(&mutex);
+    }
+
+    const char *inflate_gzip(void) {
+      vector <unsigned char> in(CHUNK_SIZE);
+      z_stream zs;
+      memset(&zs, 0, sizeof(zs));
+      if (inflateInit2(&zs, 15+32) != Z_OK) return "unable to initialize zlib";
+      const char *err = NULL;
+      char *out = next_free_chunk();
+      int out_len = 0;
+      bool eof = false, in_member = false;
+      while (out != NULL && err == NULL) {
+	if (zs.avail_in == 0 && !eof) {
+	  zs.avail_in = fread(&in[0], 1, CHUNK_SIZE, file);
+	  zs.next_in = &in[0];
+	  if (zs.avail_in == 0) {
+	    if (ferror(file)) { err = "read error"; break; }
+	    eof = true; // keep calling inflate until its pending output is flushed
+	  }
+	}
+	if (zs.avail_in > 0) in_member = true;
+	zs.next_out = (Bytef *) out + out_len;
+	zs.avail_out = CHUNK_SIZE - out_len;
+	int ret = inflate(&zs, Z_NO_FLUSH);
+	out_len = CHUNK_SIZE - zs.avail_out;
+	if (ret == Z_STREAM_END) { // concatenated gzip members (e.g. from bgzip)
+	  inflateReset(&zs);
+	  in_member = false;
+	}
+	else if (ret != Z_OK && ret != Z_BUF_ERROR)
+	  err = "corrupt gzip data";
+	if (out_len == CHUNK_SIZE) {
+	  publish_chunk(out_len);
+	  out = next_free_chunk();
+	  out_len = 0;
+	}
+	else if (eof) { // output space left and no input: inflate is drained
+	  if (in_member && err == NULL) err = "truncated gzip data";
+	  break;
+	}
+      }
+      if (out != NULL && out_len > 0) publish_chunk(out_len);
+      inflateEnd(&zs);
+      return err;
+    }
+
+    const char *inflate_zstd(void) {
+#ifdef MALDER_ZSTD
+      vector <char> in(ZSTD_DStreamInSize());
+      ZSTD_DStream *zds = ZSTD_createDStream();
+      ZSTD_initDStream(zds);
+      const char *err = NULL;
+      ZSTD_inBuffer zin = { &in[0], 0, 0 };
+      char *out = next_free_chunk();
+      ZSTD_outBuffer zout = { out, CHUNK_SIZE, 0 };
+      bool eof = false;
+      size_t frame_left = 0; // 0 when the last call that made progress completed its frame
+      while (out != NULL && err == NULL) {
+	if (zin.pos == zin.size && !eof) {
+	  zin.size = fread(&in[0], 1, in.size(), file);
+	  zin.pos = 0;
+	  if (zin.size == 0) {
+	    if (ferror(file)) { err = "read error"; break; }
+	    eof = true; // keep calling with empty input until buffered output is flushed
+	  }
+	}
+	size_t in_pos = zin.pos, out_pos = zout.pos;
+	size_t ret = ZSTD_decompressStream(zds, &zout, &zin);
+	if (ZSTD_isError(ret))
+	  err = "corrupt zstd data";
+	else if (zin.pos != in_pos || zout.pos != out_pos)
+	  frame_left = ret;
+	if (zout.pos == zout.size) {
+	  publish_chunk(zout.pos);
+	  out = next_free_chunk();
+	  zout.dst = out; zout.pos = 0;
+	}
+	else if (eof) { // output space left and no input: the decoder is drained
+	  if (frame_left != 0 && err == NULL) err = "truncated zstd data";
+	  break;
+	}
+      }
+      if (out != NULL && zout.pos > 0) publish_chunk(zout.pos);
+      ZSTD_freeDStream(zds);
+      return err;
+#else
+      return "zstd-compressed input requires building with MALDER_ZSTD (see Makefile)";
+#endif
+    }
+
+    // consumer: makes chunk chunk_read available (returns false at end of data)
+    bool wait_chunk(void) {
+      pthread_mutex_lock(&mutex);
+      while (chunk_read == chunk_write && !done)
+	pthread_cond_wait(&cond, &mutex);
+      bool avail = chunk_read < chunk_write;
+      pthread_mutex_unlock(&mutex);
+      if (!avail && error != NULL) fatalx("error reading geno file %s: %s\n", name, error);
+      return avail;
+    }
+
+    void finish_chunk(void) {
+      pthread_mutex_lock(&mutex);
+      chunk_read++;
+      pos = 0;
+      pthread_cond_broadcast(&cond);
+      pthread_mutex_unlock(&mutex);
+    }
+
+  public:
+    GenoFile(const char *_name) : name(_name), format(PLAIN), chunk_read(0), chunk_write(0),
+				  pos(0), done(false), error(NULL) {
+      file = fopen(name, "rb");
+      if (file == NULL) fatalx("unable to open geno file\n");
+      unsigned char magic[4] = {0, 0, 0, 0};
+      size_t got = fread(magic, 1, 4, file);
+      rewind(file);
+      if (got >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+	format = GZIP;
+      else if (got == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f &&
+	       magic[3] == 0xfd)
+	format = ZSTD;
+      if (format != PLAIN) {
+	chunks.resize((long) NUM_CHUNKS * CHUNK_SIZE);
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&cond, NULL);
+	if (pthread_create(&thread, NULL, inflate_main, this) != 0)
+	  fatalx("unable to start geno decompression thread\n");
+      }
+    }
+
+    ~GenoFile(void) {
+      if (format != PLAIN) {
+	pthread_mutex_lock(&mutex);
+	done = true; // stops the producer if still running
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+	pthread_join(thread, NULL);
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+      }
+      fclose(file);
+    }
+
+    bool compressed(void) const { return format != PLAIN; }
+
+    // as fgets: reads up to size-1 chars, stopping after a newline; false if no data left
+    bool read_line(char *line, int size) {
+      if (format == PLAIN)
+	return fgets(line, size, file) != NULL;
+      int n = 0;
+      while (n < size-1 && wait_chunk()) {
+	int len = chunk_len[chunk_read % NUM_CHUNKS];
+	const char *chunk = &chunks[(chunk_read % NUM_CHUNKS) * (long) CHUNK_SIZE];
+	const char *start = chunk + pos;
+	int avail = min(len - pos, size-1 - n);
+	const char *nl = (const char *) memchr(start, '\n', avail);
+	int take = nl == NULL ? avail : nl - start + 1;
+	memcpy(line + n, start, take);
+	n += take;
+	pos += take;
+	if (pos == len) finish_chunk();
+	if (nl != NULL) break;
+      }
+      line[n] = '\0';
+      return n > 0;
+    }
+
+    bool at_eof(void) {
+      if (format == PLAIN)
+	return fgetc(file) == EOF;
+      return !wait_chunk();
+    }
+  };
+
   // fills mixed_geno with valid_snps x num_mixed_indivs 0129-array
   // returns valid_snps x num_refs array of reference allele freqs
   // note: valid_snps includes those in chrom 1-22 and not badsnp file
   // it's imporant that mixed_geno and ref_genos are passed by value (copied) here!
   vector < vector <double> > process_geno(char *genotypename, const vector <int> &indiv_pop_inds,
 					  char *mixed_geno, vector <char *> ref_genos,
-					  SNP **snpmarkers, int numsnps) {
+					  const SnpTable &snps) {
+    int numsnps = snps.size();
     int num_refs = 0, numindivs = indiv_pop_inds.size();
     vector <int> mixed_indivs;
     for (int i = 0; i < numindivs; i++) {
@@ -203,8 +832,7 @@ namespace ProcessInput {
       if (0 <= indiv_pop_inds[i] && indiv_pop_inds[i] < num_refs)
 	ref_indivs[indiv_pop_inds[i]].push_back(i);
 
-    FILE *geno_file = fopen(genotypename, "r");
-    if (geno_file == NULL) fatalx("unable to open geno file\n");
+    GenoFile geno_file(genotypename);
 
     // don't initialize; push_back because of ignored snps
     vector < vector <double> > ref_freqs(num_refs);
@@ -213,13 +841,13 @@ namespace ProcessInput {
     for (int s = 0; s < numsnps; s++) {
       if ((s & 0x3fff) == 0)
 	cout << "." << flush;
-      if (fgets(line, numindivs+10, geno_file) == NULL)
+      if (!geno_file.read_line(line, numindivs+10))
 	fatalx("premature EOF (expected %d snps)\n", numsnps);
       if ((int) strlen(line) != numindivs+1)
 	fatalx("geno file line has wrong length: expected %d, got %d\n",
 	       numindivs, strlen(line)-1);
 
-      if (snpmarkers[s]->ignore == NO) { // skip snps flagged to ignore in process_snps
+      if (snps.ignore[s] == NO) { // skip snps flagged to ignore in process_snps
 	// admixed entries: add to mixed_geno buffer
 	for (int j = 0; j < (int) mixed_indivs.size(); j++)
 	  *mixed_geno++ = line[mixed_indivs[j]]-'0';
@@ -239,21 +867,117 @@ namespace ProcessInput {
     }
     cout << " done" << endl;
 
-    if (fgetc(geno_file) != EOF)
+    if (!geno_file.at_eof())
       fatalx("expected EOF after %d snps, but file still has data\n", numsnps);
 
-    fclose(geno_file);
     return ref_freqs;
   }
 
-  vector <double> process_weights(char *weightname, SNP **snpmarkers, int numsnps) {
-    vector <double> weights;
+  vector < vector <double> > process_geno(char *genotypename, const vector <int> &indiv_pop_inds,
+					  const SnpTable &snps, const string &cache_name,
+					  ALD::GenoStream &geno) {
+    int numsnps = snps.size();
+    int num_refs = 0, numindivs = indiv_pop_inds.size();
+    vector <int> mixed_indivs;
+    for (int i = 0; i < numindivs; i++) {
+      if (indiv_pop_inds[i] == ADMIXED_POP_IND) mixed_indivs.push_back(i);
+      else num_refs = max(num_refs, indiv_pop_inds[i]+1);
+    }
+    vector < vector <int> > ref_indivs(num_refs);
+    for (int i = 0; i < numindivs; i++)
+      if (0 <= indiv_pop_inds[i] && indiv_pop_inds[i] < num_refs)
+	ref_indivs[indiv_pop_inds[i]].push_back(i);
+    // row layout of the stream: mixed indivs, then each ref's indivs
+    vector <int> cols = mixed_indivs, num_ref_indivs(num_refs);
+    for (int r = 0; r < num_refs; r++) {
+      cols.insert(cols.end(), ref_indivs[r].begin(), ref_indivs[r].end());
+      num_ref_indivs[r] = ref_indivs[r].size();
+    }
+    int W = cols.size();
+
+    GenoFile geno_file(genotypename);
+    if (geno_file.compressed() && cache_name.empty())
+      fatalx("stream_geno with a compressed geno file requires stream_cache\n");
+    FILE *cache_file = NULL;
+    if (!cache_name.empty()) {
+      cache_file = fopen(cache_name.c_str(), "wb");
+      if (cache_file == NULL) fatalx("unable to open stream cache file: %s\n",
+				     cache_name.c_str());
+    }
+
+    vector < vector <double> > ref_freqs(num_refs);
+    vector <long> file_rows;
+    cout << "scanning genotype data (streaming mode)" << flush;
+    char line[numindivs+10];
+    vector <char> row(W);
+    for (int s = 0; s < numsnps; s++) {
+      if ((s & 0x3fff) == 0)
+	cout << "." << flush;
+      if (!geno_file.read_line(line, numindivs+10))
+	fatalx("premature EOF (expected %d snps)\n", numsnps);
+      if ((int) strlen(line) != numindivs+1)
+	fatalx("geno file line has wrong length: expected %d, got %d\n",
+	       numindivs, strlen(line)-1);
+
+      if (snps.ignore[s] == NO) {
+	file_rows.push_back(s);
+	for (int j = 0; j < W; j++)
+	  row[j] = line[cols[j]]-'0';
+	const char *ref_row = &row[mixed_indivs.size()];
+	for (int r = 0; r < num_refs; r++) {
+	  int gtype_tot = 0, gtype_ctr = 0;
+	  for (int j = 0; j < num_ref_indivs[r]; j++) {
+	    int gtype = *ref_row++;
+	    if (gtype != 9) {
+	      gtype_tot += gtype;
+	      gtype_ctr++;
+	    }
+	  }
+	  ref_freqs[r].push_back(0.5 * gtype_tot / gtype_ctr); // can be nan
+	}
+	if (cache_file != NULL && W > 0 && fwrite(&row[0], 1, W, cache_file) != (size_t) W)
+	  fatalx("error writing stream cache file: %s\n", cache_name.c_str());
+      }
+    }
+    cout << " done" << endl;
+
+    if (!geno_file.at_eof())
+      fatalx("expected EOF after %d snps, but file still has data\n", numsnps);
+
+    if (cache_file != NULL && fclose(cache_file) != 0)
+      fatalx("error writing stream cache file: %s\n", cache_name.c_str());
+    geno.set_stream(genotypename, numindivs+1, cols, mixed_indivs.size(), num_ref_indivs,
+		    file_rows, cache_name);
+    return ref_freqs;
+  }
+
+  vector <double> process_weights(char *weightname, SnpTable &snps) {
     printf("loading weights from file: %s\n", weightname) ; 
-    printf("num weights set: %d\n", getweights_def(weightname, snpmarkers, numsnps, NAN)) ;
+    FILE *weight_file = fopen(weightname, "r");
+    if (weight_file == NULL) fatalx("unable to open weight file: %s\n", weightname);
+    if (snps.id_hash.empty()) snps.build_id_index();
+    vector <double> snp_weights(snps.size(), NAN);
+    const int MAX_TOKS = 2;
+    const char *toks[MAX_TOKS]; int lens[MAX_TOKS];
+    const int buf_size = 1024;
+    char line[buf_size];
+    int num_set = 0;
+    while (fgets(line, buf_size, weight_file) != NULL) {
+      int nsplit = split_line(line, line + strlen(line), toks, lens, MAX_TOKS);
+      if (nsplit < 2 || skip_header_line(toks[0], lens[0])) continue;
+      int s = snps.find(toks[0], lens[0]);
+      if (s < 0) continue;
+      snp_weights[s] = tok_atof(toks[1], lens[1]);
+      printf("weight set: %20s %9.3f\n", snps.id(s), snp_weights[s]) ;
+      num_set++;
+    }
+    fclose(weight_file);
+    printf("num weights set: %d\n", num_set) ;
     // need to get rid of invalid snps
-    for (int s = 0; s < numsnps; s++)
-      if (snpmarkers[s]->ignore == NO)
-	weights.push_back(snpmarkers[s]->weight);
+    vector <double> weights;
+    for (int s = 0; s < snps.size(); s++)
+      if (snps.ignore[s] == NO)
+	weights.push_back(snp_weights[s]);
     return weights;
   }
 
@@ -2,8 +2,10 @@
 #include <vector>
 #include <utility>
 #include <set>
+#include <pthread.h>
 
 #include "mcio.h"
+#include "GenoStream.hpp"
 
 namespace ProcessInput {
 
@@ -12,16 +14,71 @@ namespace ProcessInput {
   using std::pair;
   using std::set;
 
-  int cmap(SNP **snpmarkers, int numsnps);
+  const int ADMIXED_POP_IND = 9999; // for use in process_indivs, process_geno
+
+  // snp metadata in file order (= geno file row order), stored by column
+  struct SnpTable {
+    vector <int> chrom;
+    vector <double> genpos, physpos;
+    vector <char> ignore;
+    vector <char> id_chars; // '\0'-terminated IDs, concatenated
+    vector <long> id_start;
+    vector <int> id_hash; // open-addressing table of snp indices (-1 = empty)
+
+    int size(void) const { return chrom.size(); }
+    const char *id(int s) const { return &id_chars[id_start[s]]; }
+    void build_id_index(void);
+    int find(const char *id, int len) const; // first snp with this ID, or -1 (needs index)
+  };
+
+  int cmap(const SnpTable &snps);
+
+  // indiv metadata in file order (= geno file column order)
+  struct IndivTable {
+    vector <string> ids, groups;
+    vector <char> ignore; // group "Ignore"
+
+    int size(void) const { return ids.size(); }
+  };
+
+  // reads an indiv file; EIGENSTRAT layout is parsed here without global state (and without
+  // output), so several indiv files can be read at once; PLINK layout goes through admixtools
+  void load_indiv_table(const char *indivname, IndivTable &indivs);
+
+  // reads an indiv file on a separate thread, e.g. while the snp file is read; the table is
+  // ready after wait() (also called by the destructor)
+  class IndivLoader {
+    const char *indivname;
+    IndivTable &indivs;
+    pthread_t thread;
+    bool joined;
+
+    static void *load_main(void *arg);
+    IndivLoader(const IndivLoader &);
+    IndivLoader &operator=(const IndivLoader &);
+  public:
+    IndivLoader(const char *indivname, IndivTable &indivs);
+    ~IndivLoader(void);
+    void wait(void);
+  };
 
   // returns locations (chrom, genpos) of valid (i.e., non-ignore) snps
+  // fast_snp_read: take positions verbatim (no cM or physical position conversion)
+  // max_chrom: largest chrom label used (22: autosomes)
   vector < pair <int, double> > process_snps(char *snpname, char *badsnpname, bool fast_snp_read,
-					     SNP ***snpmarkers_ptr, int checkmap, int &numsnps,
+					     SnpTable &snps, int checkmap,
 					     const set <int> &chrom_set,
-					     const set <int> &nochrom_set);
+					     const set <int> &nochrom_set, int max_chrom=22);
+
+  // contig packing: merges runs of consecutive contigs (chroms) of snp_locs into packs of data
+  // span at least min_span (Morgans); each contig after the first of a pack is shifted to start
+  // gap Morgans past the end of the previous one, so with gap > maxdis no pair across contigs
+  // is binned. Packs take the label of their first contig and become the chroms (and jackknife
+  // blocks) of the run, so each needs one FFT setup rather than one per contig.
+  void pack_contigs(vector < pair <int, double> > &snp_locs, double min_span, double gap);
 
   // returns map from indices to groups (0, 1, 2, ... for refs, ADMIXPOP_ID for mixed, -1 o/w)
-  vector <int> process_indivs(char *indivname, Indiv ***indivmarkers_ptr, char *admixlist,
+  vector <int> process_indivs(const IndivTable &indivs, char *admixlist,
 			      char *admixpop, char *refpops, char *poplistname,
 			      int &num_mixed_indivs, string &mixed_pop_name,
 			      vector <int> &num_ref_indivs, vector <string> &ref_pop_names);
@@ -32,7 +89,13 @@ namespace ProcessInput {
   // it's imporant that mixed_geno and ref_genos are passed by value (copied) here!
   vector < vector <double> > process_geno(char *genotypename, const vector <int> &indiv_pop_inds,
 					  char *mixed_geno, vector <char *> ref_genos,
-					  SNP **snpmarkers, int numsnps);
-  vector <double> process_weights(char *weightname, SNP **snpmarkers, int numsnps);
+					  const SnpTable &snps);
+  // streaming mode: validates the geno file and computes ref freqs in one pass without holding
+  // genotypes in memory; sets up geno to read them by chrom later, from a binary cache of the
+  // used snps written to cache_name during the pass if cache_name is non-empty
+  vector < vector <double> > process_geno(char *genotypename, const vector <int> &indiv_pop_inds,
+					  const SnpTable &snps, const string &cache_name,
+					  ALD::GenoStream &geno);
+  vector <double> process_weights(char *weightname, SnpTable &snps);
 
 }
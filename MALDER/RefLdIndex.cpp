@@ -0,0 +1,143 @@
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "nicklib.h"
+
+#include "RefLdIndex.hpp"
+
+namespace ALD {
+
+  using std::string;
+  using std::vector;
+
+  static const char REF_LD_INDEX_MAGIC[8] = {'M','A','L','D','L','D','X','1'};
+
+  const double RefLdIndex::D_SCALE = 16384;  // |D| < 2
+  const double RefLdIndex::D2_SCALE = 8192;  // |D^2| < 4 (unbiased estimates can be negative)
+
+  RefLdIndex::RefLdIndex(void) : max_ld_dist(0), map_addr(NULL), map_len(0), data_start(0) {}
+
+  RefLdIndex::~RefLdIndex(void) {
+    if (map_addr != NULL) munmap(map_addr, map_len);
+  }
+
+  void RefLdIndex::set_snps(const vector <int> &chroms, const vector <double> &pos,
+			    double _max_ld_dist) {
+    snp_chroms = chroms;
+    snp_pos = pos;
+    max_ld_dist = _max_ld_dist;
+    int S = pos.size();
+    row_start = vector <long> (S+1, 0);
+    int s2 = 0;
+    for (int s1 = 0; s1 < S; s1++) {
+      if (s2 <= s1) s2 = s1+1;
+      while (s2 < S && chroms[s2] == chroms[s1] && pos[s2] < pos[s1] + max_ld_dist) s2++;
+      row_start[s1+1] = row_start[s1] + (s2 - s1 - 1);
+    }
+  }
+
+  template <class T> static void write_arr(FILE *f, const T *arr, long len) {
+    if (len > 0 && fwrite(arr, sizeof(T), len, f) != (size_t) len)
+      fatalx("error writing ref LD index\n");
+  }
+
+  template <class T> static bool read_arr(const char *&p, const char *end, T *arr, long len) {
+    if (len < 0 || end - p < (long) sizeof(T) * len) return false;
+    memcpy(arr, p, sizeof(T) * len);
+    p += sizeof(T) * len;
+    return true;
+  }
+
+  void RefLdIndex::write_header(FILE *f) const {
+    int num_snps = snp_pos.size(), num_refs = refs.size();
+    write_arr(f, REF_LD_INDEX_MAGIC, 8);
+    write_arr(f, &max_ld_dist, 1);
+    write_arr(f, &num_snps, 1);
+    write_arr(f, &num_refs, 1);
+    write_arr(f, &snp_chroms[0], num_snps);
+    write_arr(f, &snp_pos[0], num_snps);
+    for (int r = 0; r < num_refs; r++) {
+      int name_len = refs[r].name.size();
+      write_arr(f, &name_len, 1);
+      write_arr(f, refs[r].name.c_str(), name_len);
+      write_arr(f, &refs[r].num_indivs, 1);
+      write_arr(f, &refs[r].snp_sum[0], num_snps);
+      write_arr(f, &refs[r].snp_missing[0], num_snps);
+    }
+    // align the blocks
+    long pad = (8 - ftell(f) % 8) % 8;
+    write_arr(f, "\0\0\0\0\0\0\0", pad);
+  }
+
+  void RefLdIndex::write_block(FILE *f, const vector <short> &block) {
+    write_arr(f, block.empty() ? NULL : &block[0], block.size());
+  }
+
+  bool RefLdIndex::open(const char *filename) {
+    int fd = ::open(filename, O_RDONLY);
+    if (fd == -1) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); return false; }
+    map_len = st.st_size;
+    void *addr = map_len > 0 ? mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (addr == MAP_FAILED) return false;
+    map_addr = (char *) addr;
+
+    const char *p = map_addr, *end = map_addr + map_len;
+    char magic[8];
+    int num_snps, num_refs;
+    if (!read_arr(p, end, magic, 8) || memcmp(magic, REF_LD_INDEX_MAGIC, 8) != 0 ||
+	!read_arr(p, end, &max_ld_dist, 1) || !read_arr(p, end, &num_snps, 1) ||
+	!read_arr(p, end, &num_refs, 1) || num_snps < 0 || num_refs < 0)
+      return false;
+    vector <int> chroms(num_snps);
+    vector <double> pos(num_snps);
+    if (!read_arr(p, end, &chroms[0], num_snps) || !read_arr(p, end, &pos[0], num_snps))
+      return false;
+    set_snps(chroms, pos, max_ld_dist);
+    refs = vector <Ref> (num_refs);
+    for (int r = 0; r < num_refs; r++) {
+      int name_len;
+      if (!read_arr(p, end, &name_len, 1) || name_len < 0 || end - p < name_len) return false;
+      refs[r].name = string(p, name_len);
+      p += name_len;
+      refs[r].snp_sum = refs[r].snp_missing = vector <int> (num_snps);
+      if (!read_arr(p, end, &refs[r].num_indivs, 1) ||
+	  !read_arr(p, end, &refs[r].snp_sum[0], num_snps) ||
+	  !read_arr(p, end, &refs[r].snp_missing[0], num_snps))
+	return false;
+    }
+    data_start = (p - map_addr + 7) / 8 * 8;
+    return data_start + (long) sizeof(short) * 2 * row_start[num_snps] * num_refs <= map_len;
+  }
+
+  const short *RefLdIndex::ref_block(int r) const {
+    return (const short *) (map_addr + data_start) + 2 * row_start.back() * r;
+  }
+
+  int RefLdIndex::find_ref(const string &name) const {
+    for (int r = 0; r < (int) refs.size(); r++)
+      if (refs[r].name == name) return r;
+    return -1;
+  }
+
+  short RefLdIndex::quantize(double x, double scale, long &num_clipped) {
+    if (std::isnan(x)) return NAN_CODE;
+    double q = floor(x * scale + 0.5);
+    if (q < -32767 || q > 32767) {
+      num_clipped++;
+      q = q < 0 ? -32767 : 32767;
+    }
+    return (short) q;
+  }
+
+}
@@ -0,0 +1,71 @@
+#ifndef REFLDINDEX_HPP
+#define REFLDINDEX_HPP
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cmath>
+
+namespace ALD {
+
+  using std::string;
+  using std::vector;
+
+  // on-disk index of reference pop LD (D and unbiased D^2, as computed by Alder from the ref
+  // genotypes) for all pairs of snps on the same chrom within max_ld_dist, so that the LD
+  // correlation computation only needs to compute the test pop half at run time
+  //
+  // file: header (snps, and per ref its name, indiv count and per-snp allele sums and missing
+  // counts, used to check that a run has the same ref data), then one block per ref of
+  // (D, D^2) int16 pairs: for each snp s1 in order, its pairs with the following snps s2 of its
+  // chrom within max_ld_dist (so each chrom is a contiguous chunk); the blocks are mmapped
+  //
+  // quantization: D = q / D_SCALE (|error| <= 0.5 / D_SCALE), D^2 = q / D2_SCALE (|error| <=
+  // 0.5 / D2_SCALE); values beyond the int16 range are clipped, NaN is stored as NAN_CODE
+  class RefLdIndex {
+
+  public:
+    static const double D_SCALE, D2_SCALE;
+    static const short NAN_CODE = -32768;
+
+    struct Ref {
+      string name;
+      int num_indivs;
+      vector <int> snp_sum, snp_missing; // by index snp
+    };
+
+    double max_ld_dist;
+    vector <int> snp_chroms; // chrom labels
+    vector <double> snp_pos;
+    vector <Ref> refs;
+    vector <long> row_start; // first pair of each snp's row within a ref block (num_snps+1)
+
+    RefLdIndex(void);
+    ~RefLdIndex(void);
+
+    // sets the snps and computes row_start
+    void set_snps(const vector <int> &chroms, const vector <double> &pos, double max_ld_dist);
+    // writing: header, then the ref blocks in order
+    void write_header(FILE *f) const;
+    static void write_block(FILE *f, const vector <short> &block);
+    // reading: returns false if the file is not a readable index
+    bool open(const char *filename);
+    const short *ref_block(int r) const; // (D, D^2) pairs
+    int find_ref(const string &name) const; // -1 if absent
+
+    static short quantize(double x, double scale, long &num_clipped);
+    static double dequantize(short q, double scale) {
+      return q == NAN_CODE ? NAN : q / scale;
+    }
+
+  private:
+    char *map_addr;
+    long map_len, data_start;
+
+    RefLdIndex(const RefLdIndex &);
+    RefLdIndex &operator=(const RefLdIndex &);
+  };
+
+}
+
+#endif
@@ -49,18 +49,18 @@ int nnls(double* a,  int mda,  int m,  int n, double* b,
  
  
   /* Local variables */
-  static int iter;
-  static double temp, wmax;
-  static int i__, j, l;
-  static double t, alpha, asave;
-  static int itmax, izmax, nsetp;
-  static double unorm, ztest, cc;
+  int iter;
+  double temp, wmax;
+  int i__, j, l;
+  double t, alpha, asave;
+  int itmax, izmax, nsetp;
+  double unorm, ztest, cc;
   double dummy[2];
-  static int ii, jj, ip;
-  static double sm;
-  static int iz, jz;
-  static double up, ss;
-  static int rtnkey, iz1, iz2, npp1;
+  int ii, jj = 0, ip;
+  double sm;
+  int iz, jz;
+  double up, ss;
+  int rtnkey, iz1, iz2, npp1;
  
   /*     ------------------------------------------------------------------ 
    */
@@ -446,7 +446,7 @@ int g1(double* a, double* b, double* cterm, double* sterm, double* sig)
   /* System generated locals */
   double d;
  
-  static double xr, yr;
+  double xr, yr;
  
  
   if (nnls_abs(*a) > nnls_abs(*b)) {
@@ -492,12 +492,12 @@ int h12(int mode, int* lpivot, int* l1,
   /* double sqrt(); */
  
   /* Local variables */
-  static int incr;
-  static double b;
-  static int i__, j;
-  static double clinv;
-  static int i2, i3, i4;
-  static double cl, sm;
+  int incr;
+  double b;
+  int i__, j;
+  double clinv;
+  int i2, i3, i4;
+  double cl, sm;
  
   /*     ------------------------------------------------------------------ 
    */